@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <string.h>
 
 /*
 	ADSB.h
@@ -7,169 +8,13 @@
 	their associated objects.
 */
 
-/*
-	AdsbMessage
-	In order to insure allignment with the message within the adsbFrame struct,
-	I have created a separate union of the message portion in all of its forms.
-
-	Since the messages are sent MSB (Most Significant Bit) first,
-	Bit-fields in structs are usually ordered in the LSB first.
-	So I input the 112 bit raw data frame Little Endian,
-	then I reverse the order of the bit-fields so that they align correctly.
-
-	ADS-B version differences:
-	TC=28 added in ver 1
-	NUC (Navigational Uncertainty Categories) swapped in favor of NIC (Navigational Integrity Categories)
-	TC=28 changed in ver 2, NICb defined in Air Pos messages (TC=9-18)
-	NICa and NICc defined in TC=31
-
-	I probably will not worry about the navigational uncertainty/integrity,
-	because it requires knowing ADS-B versions of the transponder.
-	Part of the navigational uncertainty/integrity is encoded into the typecode,
-	which is why there are multiple type codes for certain messages.
-*/
-
-/*
-	SubSpecFields (deprecated)
-	These are the specific fields for ground speed (gs), or airborne speed (as),
-	as they relate within the Airborne Velocity (av) struct and message type.
-*/
-
-/*union SubSpecFields
-{
-	struct __attribute__((packed))
-	{
-		uint32_t vns	: 10;	//North-South velocity
-		uint32_t dns	: 1;	//N-S direction (0 South to North, 1 North to South)
-		uint32_t vew	: 10;	//E-W velocity
-		uint32_t dew	: 1;	//E-W direction (0 West to East, 1 East to West)
-	} gs;	//if subtype is 1, speed is decimal value - 1
-		//if st=2, speed is 4 * (dec value - 1)
-		//in knots
-
-	struct __attribute__((packed))
-	{
-		uint32_t as	: 10;	//speed = as - 1 or 4*(as-1) (0 means not available)
-		uint32_t t	: 1;	//type 0 = IAS, 1 = TAS
-		uint32_t hdg	: 10;	//heading = hdg * 360/1024 degrees
-		uint32_t sh	: 1;	//heading status (0 means hdg not available)
-	} as;	//st=4 is the same as st=2, airpseed is multiplied by 4.
-};*/
-
-union AdsbMessage
-{
-	uint8_t me[7];	//Message (56 bits including TC)
-
-	struct __attribute__((packed))
-	{
-		uint64_t c8	: 6;
-		uint64_t c7	: 6;
-		uint64_t c6	: 6;
-		uint64_t c5	: 6;
-		uint64_t c4	: 6;
-		uint64_t c3	: 6;	//of an ASCII character
-		uint64_t c2	: 6;	//each char is the lower 6 bits
-		uint64_t c1	: 6;	//call sign chars
-		uint64_t cat	: 3;	//craft category is determined by both this and exact tc value
-		uint64_t tc	: 5;
-	} id;	//to be used if tc <= 4
-
-	struct __attribute__((packed))
-	{
-		uint64_t loncpr		: 17;	//longitude
-		uint64_t latcpr		: 17;	//CPR encoded latitude
-		uint64_t f		: 1;	//CPR format (even frame or odd frame)
-		uint64_t t		: 1;	//time
-		uint64_t alt		: 12;	//encoded altitude
-		uint64_t saf		: 1;	//single antenna flag
-		uint64_t ss		: 2;	//surveillance status
-		uint64_t tc		: 5;
-	} ab;	//layout of message if of airborne position type
-		//used if tc is 9-18 or 20-22
-		//alt is baro if 9-18, GNSS alt 20-22
-		//Keep in mind, not only is the baro alt in ft and GNSS in meters
-		//the 8th bit of the alt for baro indicates whether the altitude is
-		//in 25ft increments or 100ft increments.
-	
-	struct __attribute__((packed))
-	{
-		uint64_t loncpr		: 17;	//longitude
-		uint64_t latcpr		: 17;	//latitude (calculated differently from airborne)
-		uint64_t f		: 1;	//even or odd CPR format
-		uint64_t t		: 1;	//time
-		uint64_t trk		: 7;	//ground track (degrees) = 360*trk / 128
-		uint64_t s		: 1;	//ground track status (invalid or valid)
-		uint64_t mov		: 7;	//movement (ground speed)
-		uint64_t tc		: 5;
-	} sp;	//surface position tc 5-8
-
-	struct __attribute__((packed))
-	{
-		uint64_t diff	: 7;	//GNSS - Baro alt (divided by 25ft)
-		uint64_t sdif	: 1;	//sign bit for GNSS alt - Baro alt
-		uint64_t res	: 2;
-		uint64_t vr	: 9;	//vertical rate
-		uint64_t svr	: 1;	//vertical rate sign bit
-		uint64_t src	: 1;	//source for vertical rate (GNSS or Baro)
-		uint32_t vns	: 10;	//North-South velocity
-		uint32_t dns	: 1;	//N-S direction (0 South to North, 1 North to South)
-		uint32_t vew	: 10;	//E-W velocity
-		uint32_t dew	: 1;	//E-W direction (0 West to East, 1 East to West)
-		uint64_t nuc	: 3;	//navigational uncertainty, different between ADS-B versions
-		uint64_t ifr	: 1;	//IFR capability flag
-		uint64_t ic	: 1;	//intent change flag
-		uint64_t st	: 3;	//subtypes 1 and 2 are ground speed, 3 and 4 are TAS or IAS
-		uint64_t tc	: 5;
-	} avg;	//airborne velocities tc=19 ground speed specific
-
-	struct __attribute__((packed))
-	{
-		uint64_t diff	: 7;	//GNSS - Baro alt (divided by 25ft)
-		uint64_t sdif	: 1;	//sign bit for GNSS alt - Baro alt
-		uint64_t res	: 2;
-		uint64_t vr	: 9;	//vertical rate
-		uint64_t svr	: 1;	//vertical rate sign bit
-		uint64_t src	: 1;	//source for vertical rate (GNSS or Baro)
-		uint32_t as	: 10;	//speed = as - 1 or 4*(as-1) (0 means not available)
-		uint32_t t	: 1;	//type 0 = IAS, 1 = TAS
-		uint32_t hdg	: 10;	//heading = hdg * 360/1024 degrees
-		uint32_t sh	: 1;	//heading status (0 means hdg not available)
-		uint64_t nuc	: 3;	//navigational uncertainty, different between ADS-B versions
-		uint64_t ifr	: 1;	//IFR capability flag
-		uint64_t ic	: 1;	//intent change flag
-		uint64_t st	: 3;	//subtypes 1 and 2 are ground speed, 3 and 4 are TAS or IAS
-		uint64_t tc	: 5;
-	} ava;	//airborne velocities tc=19 IAS/TAS specific
-
-	struct __attribute__((packed))
-	{
-		uint64_t res	: 1;
-		uint64_t sils	: 1;	//SIL supplement bit
-		uint64_t hrd	: 1;	//Horizontal Reference Direction
-		uint64_t bai	: 1;	//Baro Alt Integrity (Track Angle on surface)
-		uint64_t sil	: 2;	//Source Integrity Level
-		uint64_t gva	: 2;	//Geometric Vertical Accuracy (unused on surface)
-		uint64_t nacp	: 4;	//Navigational Accuracy Category - position
-		uint64_t nica	: 1;	//NIC supplement - A
-		uint64_t ver	: 3;	//ADS-B version
-		uint64_t om	: 16;	//operational machine code
-		uint64_t cc	: 16;	//capacity class code
-		uint64_t st	: 3;	//subtype (0 airborne, 1 surface)
-		uint64_t tc	: 5;
-	} os;	//operational status tc=31
-		//ADS-B version 1 doesn't have SILS, ADS-B ver 0 is very different but unused
-		//we might not worry about decoding these messages
-};
-
 /*
 	AdsbFrame
-	This union allows access to the 112 bit ADS-B broadcast frame as either
-	7 16 bit integers, or the individual components thereof.
-
-	WARNING: The ADS-B messages are transmitted in MSB first,
-	the alignment between assigning the 16 bit integers and the data within
-	might be incorrect at this moment.
-	AFAIK bit-fields are LsB first, so I might have to swap everything at some point.
+	The 112 bit ADS-B broadcast frame, in the order it is sent:
+	frame[0] is the first byte, and its top bit the first bit.
+	The fields are read and written with the accessors from
+	ADSB_FIELDS below, not bit-fields, so the layout doesn't depend
+	on the compiler or ABI.
 
 	Downlink Format:
 	17 if sent from a Mode S transponder,
@@ -204,13 +49,154 @@ union AdsbMessage
 union AdsbFrame
 {
 	uint8_t frame[14];	//A broadcast frame is 112 bits long, or 8 bits * 14
-
-	struct __attribute__((packed))
-	{
-		uint32_t pi	: 24;	//Parity and Interrogator ID
-		union AdsbMessage me;	//Message (as described above)
-		uint32_t icao	: 24;	//ICAO aircraft address
-		uint8_t ca	: 3;	//Transponder Capability
-		uint8_t df	: 5;	//Downlink Format
-	};
 };
+
+/*
+	ADSB_FIELDS
+	Every field as X(name, first bit, bits), bit 0 being the first
+	bit of the frame. ME (the message) is bits 32-87 and its first
+	5 bits are always TC, the rest depend on it:
+	Id  identification, tc 1-4
+	Ab  airborne position, tc 9-18 (baro alt) and 20-22 (GNSS height)
+	Sp  surface position, tc 5-8
+	Av  airborne velocity, tc 19, st 1-2 ground speed, 3-4 airspeed
+	Os  operational status, tc 31
+
+	ADS-B version differences:
+	TC=28 added in ver 1
+	NUC (Navigational Uncertainty Categories) swapped in favor of
+	NIC (Navigational Integrity Categories)
+	TC=28 changed in ver 2, NICb defined in Air Pos messages (TC=9-18)
+	NICa and NICc defined in TC=31
+
+	I probably will not worry about the navigational uncertainty/integrity,
+	because it requires knowing ADS-B versions of the transponder.
+	Part of the navigational uncertainty/integrity is encoded into the
+	typecode, which is why there are multiple type codes for certain
+	messages.
+*/
+#define ADSB_FIELDS(X) \
+	X(Df,		0,	5)	/* Downlink Format */ \
+	X(Ca,		5,	3)	/* Transponder Capability */ \
+	X(Icao,		8,	24)	/* ICAO aircraft address */ \
+	X(Tc,		32,	5)	/* Type Code */ \
+	X(Pi,		88,	24)	/* Parity and Interrogator ID */ \
+	\
+	/* craft category is determined by both this and exact tc value */ \
+	X(IdCat,	37,	3) \
+	/* call sign chars, each is the lower 6 bits of an ASCII char */ \
+	X(IdCall,	40,	48) \
+	\
+	X(AbSs,		37,	2)	/* surveillance status */ \
+	X(AbSaf,	39,	1)	/* single antenna flag */ \
+	/* encoded altitude, baro in ft if tc 9-18, GNSS in meters 20-22 */ \
+	/* for baro bit 4 says if it is in 25ft or 100ft increments */ \
+	X(AbAlt,	40,	12) \
+	X(AbT,		52,	1)	/* time */ \
+	X(AbF,		53,	1)	/* CPR format (even or odd frame) */ \
+	X(AbLatCpr,	54,	17)	/* CPR encoded latitude */ \
+	X(AbLonCpr,	71,	17)	/* CPR encoded longitude */ \
+	\
+	X(SpMov,	37,	7)	/* movement (ground speed) */ \
+	X(SpS,		44,	1)	/* ground track status */ \
+	X(SpTrk,	45,	7)	/* ground track = 360*trk / 128 */ \
+	X(SpT,		52,	1)	/* time */ \
+	X(SpF,		53,	1)	/* even or odd CPR format */ \
+	X(SpLatCpr,	54,	17)	/* decoded differently from air */ \
+	X(SpLonCpr,	71,	17) \
+	\
+	/* 1 and 2 are ground speed, 3 and 4 are TAS or IAS */ \
+	X(AvSt,		37,	3) \
+	X(AvIc,		40,	1)	/* intent change flag */ \
+	X(AvIfr,	41,	1)	/* IFR capability flag */ \
+	X(AvNuc,	42,	3)	/* navigational uncertainty */ \
+	X(AvDew,	45,	1)	/* E-W direction (1 East to West) */ \
+	X(AvVew,	46,	10)	/* E-W velocity */ \
+	X(AvDns,	56,	1)	/* N-S direction (1 North to South) */ \
+	X(AvVns,	57,	10)	/* N-S velocity */ \
+	X(AvSh,		45,	1)	/* heading status (0 not available) */ \
+	X(AvHdg,	46,	10)	/* heading = hdg * 360/1024 degrees */ \
+	X(AvT,		56,	1)	/* airspeed type 0 = IAS, 1 = TAS */ \
+	X(AvAs,		57,	10)	/* speed = as - 1 (0 not available) */ \
+	X(AvSrc,	67,	1)	/* vert rate source (GNSS or Baro) */ \
+	X(AvSvr,	68,	1)	/* vertical rate sign bit */ \
+	X(AvVr,		69,	9)	/* vertical rate */ \
+	X(AvSdif,	80,	1)	/* sign bit for GNSS alt - Baro alt */ \
+	X(AvDiff,	81,	7)	/* GNSS - Baro alt (in 25ft) */ \
+	\
+	X(OsSt,		37,	3)	/* subtype (0 airborne, 1 surface) */ \
+	X(OsCc,		40,	16)	/* capacity class code */ \
+	X(OsOm,		56,	16)	/* operational mode code */ \
+	X(OsVer,	72,	3)	/* ADS-B version */ \
+	X(OsNica,	75,	1)	/* NIC supplement - A */ \
+	X(OsNacp,	76,	4)	/* Nav Accuracy Category - pos */ \
+	X(OsGva,	80,	2)	/* Geometric Vertical Accuracy */ \
+	X(OsSil,	82,	2)	/* Source Integrity Level */ \
+	X(OsBai,	84,	1)	/* Baro Alt Integrity */ \
+	X(OsHrd,	85,	1)	/* Horizontal Reference Direction */ \
+	X(OsSils,	86,	1)	/* SIL supplement bit */
+
+/*
+	adsbLoad
+	Returns the 8 frame bytes from byte as a big endian integer.
+	byte is at most 6, so every field is inside one load.
+*/
+static inline uint64_t adsbLoad(const union AdsbFrame *f, int byte)
+{
+	uint64_t v;
+	memcpy(&v, f->frame + byte, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline void adsbStore(union AdsbFrame *f, int byte, uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	memcpy(f->frame + byte, &v, 8);
+	return;
+}
+
+#define ADSB_BYTE(pos) ((pos) / 8 < 6 ? (pos) / 8 : 6)
+
+/*
+	adsbBits, adsbSetBits
+	Read and write bits bits from pos, one load and a shift and mask.
+	With the constants from ADSB_FIELDS that is all that is left.
+*/
+static inline uint64_t adsbBits(const union AdsbFrame *f, int pos, int bits)
+{
+	return adsbLoad(f, ADSB_BYTE(pos)) << (pos - 8 * ADSB_BYTE(pos)) >>
+		(64 - bits);
+}
+
+static inline void adsbSetBits(union AdsbFrame *f, int pos, int bits,
+	uint64_t v)
+{
+	int shift = 64 - bits - (pos - 8 * ADSB_BYTE(pos));
+	uint64_t mask = ((1ull << bits) - 1) << shift;
+
+	adsbStore(f, ADSB_BYTE(pos), (adsbLoad(f, ADSB_BYTE(pos)) & ~mask) |
+		(v << shift & mask));
+	return;
+}
+
+/*
+	adsb<name>, adsbSet<name>
+	The accessor pair for every field, adsbTc(f), adsbSetTc(f, 19) etc.
+	Setting a field keeps the bits of v that fit.
+*/
+#define ADSB_ACCESSORS(name, pos, bits) \
+	static inline uint64_t adsb##name(const union AdsbFrame *f) \
+	{ \
+		return adsbBits(f, pos, bits); \
+	} \
+	static inline void adsbSet##name(union AdsbFrame *f, uint64_t v) \
+	{ \
+		adsbSetBits(f, pos, bits, v); \
+	}
+ADSB_FIELDS(ADSB_ACCESSORS)
+#undef ADSB_ACCESSORS
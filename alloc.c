@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include "alloc.h"
+
+struct ArenaSpill
+{
+	struct ArenaSpill *next;
+	size_t size;
+};
+
+//spills are aligned the same as the arena
+#define SPILLHEAD ((sizeof(struct ArenaSpill) + ARENA_ALIGN - 1) & \
+	~(size_t)(ARENA_ALIGN - 1))
+
+static __thread struct Arena arena;
+
+void *arenaAlloc(struct Arena *a, size_t n)
+{
+	struct ArenaSpill *s;
+
+	n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if(a->size - a->used >= n)
+	{
+		a->used += n;
+		if(a->used + a->spilled > a->peak)
+			a->peak = a->used + a->spilled;
+		return a->base + a->used - n;
+	}
+
+	s = malloc(SPILLHEAD + n);
+	if(s == NULL)
+		return NULL;
+	s->next = a->spill;
+	s->size = n;
+	a->spill = s;
+	a->spilled += n;
+	if(a->used + a->spilled > a->peak)
+		a->peak = a->used + a->spilled;
+	return (char*)s + SPILLHEAD;
+}
+
+size_t arenaMark(const struct Arena *a)
+{
+	return a->used;
+}
+
+void arenaRelease(struct Arena *a, size_t mark)
+{
+	struct ArenaSpill *s;
+
+	if(mark < a->used)
+		a->used = mark;
+	if(a->used > 0 || a->spill == NULL)
+		return;
+
+	while(a->spill != NULL)
+	{
+		s = a->spill;
+		a->spill = s->next;
+		free(s);
+	}
+	a->spilled = 0;
+	free(a->base);
+	a->base = malloc(a->peak);
+	a->size = a->base != NULL ? a->peak : 0;
+	return;
+}
+
+void freeArena(struct Arena *a)
+{
+	struct ArenaSpill *s;
+
+	while(a->spill != NULL)
+	{
+		s = a->spill;
+		a->spill = s->next;
+		free(s);
+	}
+	free(a->base);
+	a->base = NULL;
+	a->size = a->used = a->spilled = a->peak = 0;
+	return;
+}
+
+struct Arena *threadArena(void)
+{
+	return &arena;
+}
+
+#ifdef DEBUGALLOC
+static __thread unsigned long allocations;
+
+void *__libc_malloc(size_t n);
+void *__libc_calloc(size_t count, size_t n);
+void *__libc_realloc(void *p, size_t n);
+
+//these take the place of glibc's, for libc's own calls too
+void *malloc(size_t n)
+{
+	allocations++;
+	return __libc_malloc(n);
+}
+
+void *calloc(size_t count, size_t n)
+{
+	allocations++;
+	return __libc_calloc(count, n);
+}
+
+void *realloc(void *p, size_t n)
+{
+	allocations++;
+	return __libc_realloc(p, n);
+}
+
+unsigned long heapAllocations(void)
+{
+	return allocations;
+}
+#else
+unsigned long heapAllocations(void)
+{
+	return 0;
+}
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+#include <stddef.h>
+
+/*
+	ALLOC.H
+	Scratch memory for the paths that run for as long as the program
+	does (decoding, the display, the logs and the maps), so once they
+	have warmed up they never go to malloc. On a Pi that runs for
+	months, freeing and allocating every refresh fragments the heap
+	and shows up as jitter.
+
+	Each thread has an arena, work takes what it needs from it and
+	gives it back with arenaRelease. What doesn't fit is malloc'd
+	until the arena is released to empty, which frees it and grows
+	the arena to the most that was used at once, so the next time
+	round it all fits.
+
+	Built with DEBUGALLOC, malloc, calloc and realloc are counted for
+	each thread (through glibc's __libc_ functions), so main can check
+	nothing is allocated after warming up.
+*/
+
+#define ARENA_ALIGN _Alignof(max_align_t)	//what malloc gives
+
+struct ArenaSpill;
+
+/*
+	Arena
+	All zero is an empty arena, the first round spills and sizes it.
+*/
+struct Arena
+{
+	char *base;
+	size_t size, used;
+	size_t spilled, peak;		//bytes of spill, most used at once
+	struct ArenaSpill *spill;	//allocations that didn't fit
+};
+
+/*
+	arenaAlloc
+	Returns n bytes aligned to ARENA_ALIGN, or NULL if out of memory.
+*/
+void *arenaAlloc(struct Arena *a, size_t n);
+
+/*
+	arenaMark
+	Returns what to give arenaRelease to free everything taken after
+	this.
+*/
+size_t arenaMark(const struct Arena *a);
+
+/*
+	arenaRelease
+	Frees everything taken since mark. At 0, frees the spills and
+	grows the arena if there were any.
+*/
+void arenaRelease(struct Arena *a, size_t mark);
+
+/*
+	freeArena
+	Frees all of it, the arena is empty again after.
+*/
+void freeArena(struct Arena *a);
+
+/*
+	threadArena
+	Returns the calling thread's arena. Threads that use it free it
+	with freeArena before they end.
+*/
+struct Arena *threadArena(void);
+
+/*
+	heapAllocations
+	Returns how many times the calling thread has called malloc,
+	calloc or realloc, 0 unless built with DEBUGALLOC.
+*/
+unsigned long heapAllocations(void);
@@ -0,0 +1,669 @@
+//archives outgrow 2GB within months, even on 32 bit
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "archive.h"
+
+#define COLUMNS 6		//time, lat, lng, alt, speed, track
+#define MAXRECORD 36		//bytes an update can take, 10 for time
+#define MAXPLANE 8		//icao, updates and bytes before the columns
+
+_Static_assert(ARCHIVE_HEADER + ARCHIVE_RECORDS * (MAXRECORD + MAXPLANE) <=
+	OUTPUT_FLUSH, "a block has to fit in one output record");
+
+static void putLE(uint8_t *p, uint64_t v, int bytes)
+{
+	int i;
+	for(i = 0;i < bytes;i++)
+		p[i] = (uint8_t)(v >> 8 * i);
+	return;
+}
+
+static uint64_t getLE(const uint8_t *p, int bytes)
+{
+	uint64_t v = 0;
+	int i;
+	for(i = bytes - 1;i >= 0;i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+static uint8_t *putVarint(uint8_t *p, uint64_t v)
+{
+	while(v >= 0x80)
+	{
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+//small changes either way take small varints
+static uint8_t *putDelta(uint8_t *p, int64_t d)
+{
+	return putVarint(p, (uint64_t)d << 1 ^ (uint64_t)(d >> 63));
+}
+
+//returns NULL if the varint runs past end
+static const uint8_t *getVarint(const uint8_t *p, const uint8_t *end,
+	uint64_t *v)
+{
+	int shift = 0;
+	*v = 0;
+	while(p < end && shift < 64)
+	{
+		*v |= (uint64_t)(*p & 0x7F) << shift;
+		if((*p++ & 0x80) == 0)
+			return p;
+		shift += 7;
+	}
+	return NULL;
+}
+
+static const uint8_t *getDelta(const uint8_t *p, const uint8_t *end,
+	int64_t *d)
+{
+	uint64_t v;
+	p = getVarint(p, end, &v);
+	*d = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+	return p;
+}
+
+static void bloomAdd(uint64_t bloom[ARCHIVE_BLOOM], int icao)
+{
+	uint32_t h = (uint32_t)icao * 2654435761u;
+	bloom[h >> 30] |= 1ull << (h >> 24 & 63);
+	bloom[h >> 14 & 3] |= 1ull << (h >> 8 & 63);
+	return;
+}
+
+static int bloomHas(const uint64_t bloom[ARCHIVE_BLOOM], int icao)
+{
+	uint32_t h = (uint32_t)icao * 2654435761u;
+	return (bloom[h >> 30] >> (h >> 24 & 63) & 1) &&
+		(bloom[h >> 14 & 3] >> (h >> 8 & 63) & 1);
+}
+
+/*
+	sortOrder
+	Stable merge sort of order by key, tmp is scratch of n.
+	Stable so a plane's updates in the same second keep their order.
+*/
+static void sortOrder(int order[], int tmp[], const int64_t key[], int n)
+{
+	int width, lo, mid, hi, i, j, k, *src = order, *dst = tmp, *swap;
+
+	for(width = 1;width < n;width *= 2)
+	{
+		for(lo = 0;lo < n;lo += 2 * width)
+		{
+			mid = lo + width < n ? lo + width : n;
+			hi = lo + 2 * width < n ? lo + 2 * width : n;
+			for(i = lo, j = mid, k = lo;k < hi;k++)
+				if(i < mid && (j >= hi || key[src[i]] <= key[src[j]]))
+					dst[k] = src[i++];
+				else
+					dst[k] = src[j++];
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if(src != order)
+		memcpy(order, src, sizeof(int) * n);
+	return;
+}
+
+//column col of r, a field that isn't known repeats prev
+static int64_t columnValue(const struct ArchiveRecord *r, int col,
+	int64_t prev)
+{
+	switch(col)
+	{
+	case 0:
+		return (int64_t)r->time;
+	case 1:
+		return llround(r->lat * ARCHIVE_LATLNG);
+	case 2:
+		return llround(r->lng * ARCHIVE_LATLNG);
+	case 3:
+		return r->flags & ALTVALID ? r->alt : prev;
+	case 4:
+		return r->flags & SPDVALID ? llround(r->spd * 10.) : prev;
+	default:
+		return r->flags & TRKVALID ? llround(r->trk * 10.) : prev;
+	}
+}
+
+static void setColumn(struct ArchiveRecord *r, int col, int64_t v)
+{
+	switch(col)
+	{
+	case 0:
+		r->time = (time_t)v;
+		break;
+	case 1:
+		r->lat = (double)v / ARCHIVE_LATLNG;
+		break;
+	case 2:
+		r->lng = (double)v / ARCHIVE_LATLNG;
+		break;
+	case 3:
+		r->alt = (int)v;
+		break;
+	case 4:
+		r->spd = (double)v / 10.;
+		break;
+	default:
+		r->trk = (double)v / 10.;
+	}
+	return;
+}
+
+int openArchive(struct Archive *a, const char *name)
+{
+	FILE *f;
+	char *idxname;
+	size_t n = strlen(name);
+
+	memset(a, 0, sizeof(*a));
+	//blocks are only ever appended, so the next one goes at the end
+	f = fopen(name, "rb");
+	if(f != NULL)
+	{
+		if(fseeko(f, 0, SEEK_END) == 0)
+			a->offset = (uint64_t)ftello(f);
+		fclose(f);
+	}
+
+	a->recs = malloc(sizeof(struct ArchiveRecord) * ARCHIVE_RECORDS);
+	a->order = malloc(sizeof(int) * ARCHIVE_RECORDS * 2);
+	a->key = malloc(sizeof(int64_t) * ARCHIVE_RECORDS);
+	a->columns = malloc(MAXRECORD * ARCHIVE_RECORDS);
+	idxname = malloc(n + 5);
+	if(a->recs == NULL || a->order == NULL || a->key == NULL ||
+		a->columns == NULL || idxname == NULL)
+		goto fail;
+	memcpy(idxname, name, n);
+	memcpy(idxname + n, ".idx", 5);
+	if(openOutput(&a->data, name, OUTPUT_NOSYNC))
+		goto fail;
+	if(openOutput(&a->index, idxname, OUTPUT_NOSYNC))
+	{
+		closeOutput(&a->data);
+		goto fail;
+	}
+	free(idxname);
+	return 0;
+
+fail:
+	free(idxname);
+	free(a->recs);
+	free(a->order);
+	free(a->key);
+	free(a->columns);
+	return -1;
+}
+
+static void writeEntry(struct Archive *a, const struct ArchiveIndex *e)
+{
+	uint8_t *p = (uint8_t*)reserveOutput(&a->index);
+	int i;
+
+	putLE(p, e->offset, 8);
+	putLE(p + 8, (uint64_t)e->t0, 8);
+	putLE(p + 16, (uint64_t)e->t1, 8);
+	putLE(p + 24, e->length, 4);
+	putLE(p + 28, e->records, 4);
+	for(i = 0;i < ARCHIVE_BLOOM;i++)
+		putLE(p + 32 + 8 * i, e->bloom[i], 8);
+	commitOutput(&a->index, ARCHIVE_ENTRY);
+	return;
+}
+
+//a plane's updates from order[i] to order[j - 1], returns the end
+static uint8_t *encodeColumns(struct Archive *a, int i, int j, int64_t t0)
+{
+	uint8_t *c = a->columns;
+	const struct ArchiveRecord *r;
+	int64_t prev, v;
+	int col, k;
+
+	for(col = 0;col < COLUMNS;col++)
+	{
+		prev = col ? 0 : t0;
+		for(k = i;k < j;k++)
+		{
+			v = columnValue(&a->recs[a->order[k]], col, prev);
+			c = putDelta(c, v - prev);
+			prev = v;
+		}
+	}
+	for(k = i;k < j;k++)
+	{
+		r = &a->recs[a->order[k]];
+		*c++ = (r->flags & ALTVALID ? 1 : 0) |
+			(r->flags & SPDVALID ? 2 : 0) | (r->flags & TRKVALID ? 4 : 0);
+	}
+	return c;
+}
+
+/*
+	sealBlock
+	Encodes the waiting updates straight into the output buffer.
+	The index entry is only written if the block wasn't dropped,
+	and offset only moves on by what actually reaches the file.
+*/
+static void sealBlock(struct Archive *a)
+{
+	struct ArchiveIndex e;
+	uint8_t *start, *p, *c;
+	unsigned long dropped;
+	int64_t t0, t1;
+	int i, j, planes = 0;
+
+	if(a->count == 0)
+		return;
+	t0 = t1 = a->recs[0].time;
+	for(i = 0;i < a->count;i++)
+	{
+		a->order[i] = i;
+		a->key[i] = a->recs[i].icao;
+		if(a->recs[i].time < t0)
+			t0 = a->recs[i].time;
+		if(a->recs[i].time > t1)
+			t1 = a->recs[i].time;
+	}
+	sortOrder(a->order, a->order + ARCHIVE_RECORDS, a->key, a->count);
+
+	memset(&e, 0, sizeof(e));
+	start = (uint8_t*)reserveOutput(&a->data);
+	p = start + ARCHIVE_HEADER;
+	for(i = 0;i < a->count;i = j)
+	{
+		for(j = i;j < a->count &&
+			a->recs[a->order[j]].icao == a->recs[a->order[i]].icao;j++)
+			;
+		c = encodeColumns(a, i, j, t0);
+		putLE(p, (uint64_t)a->recs[a->order[i]].icao, 3);
+		p = putVarint(p + 3, (uint64_t)(j - i));
+		p = putVarint(p, (uint64_t)(c - a->columns));
+		memcpy(p, a->columns, c - a->columns);
+		p += c - a->columns;
+		bloomAdd(e.bloom, a->recs[a->order[i]].icao);
+		planes++;
+	}
+	memcpy(start, ARCHIVE_MAGIC, 4);
+	putLE(start + 4, (uint64_t)(p - start - ARCHIVE_HEADER), 4);
+	putLE(start + 8, (uint64_t)t0, 8);
+	putLE(start + 16, (uint64_t)t1, 8);
+	putLE(start + 24, (uint64_t)planes, 4);
+	putLE(start + 28, (uint64_t)a->count, 4);
+
+	e.offset = a->offset;
+	e.t0 = t0;
+	e.t1 = t1;
+	e.length = (uint32_t)(p - start - ARCHIVE_HEADER);
+	e.records = (uint32_t)a->count;
+	dropped = a->data.dropped;
+	commitOutput(&a->data, p - start);
+	a->offset += p - start;
+	if(a->data.dropped == dropped)
+		writeEntry(a, &e);
+	else
+		a->offset -= a->data.dropped - dropped;
+	a->count = 0;
+	return;
+}
+
+void archivePlane(struct Archive *a, const struct Plane *p, time_t now)
+{
+	struct ArchiveRecord *r;
+
+	if(a->count > 0 && now - a->recs[0].time >= ARCHIVE_SPAN)
+		sealBlock(a);
+	r = &a->recs[a->count++];
+	r->icao = p->icao;
+	r->time = now;
+	r->lat = p->lat;
+	r->lng = p->lng;
+	r->alt = p->alt;
+	r->spd = p->spd;
+	r->trk = p->trk;
+	r->flags = p->pflags & (POSVALID | ALTVALID | SPDVALID | TRKVALID);
+	if(a->count == ARCHIVE_RECORDS)
+		sealBlock(a);
+	return;
+}
+
+void flushArchive(struct Archive *a, time_t now)
+{
+	unsigned long dropped = a->data.dropped;
+
+	if(a->count > 0 && now - a->recs[0].time >= ARCHIVE_SPAN)
+		sealBlock(a);
+	flushOutput(&a->data, now);
+	a->offset -= a->data.dropped - dropped;
+	flushOutput(&a->index, now);
+	return;
+}
+
+int closeArchive(struct Archive *a)
+{
+	int failed;
+
+	sealBlock(a);
+	failed = closeOutput(&a->data);
+	failed |= closeOutput(&a->index);
+	free(a->recs);
+	free(a->order);
+	free(a->key);
+	free(a->columns);
+	return failed ? -1 : 0;
+}
+
+/*
+	readBlock
+	Returns 0 with the block at offset in r->buf and its header in h,
+	-1 if there isn't a whole block there.
+*/
+static int readBlock(struct ArchiveReader *r, uint64_t offset,
+	struct ArchiveBlock *h)
+{
+	uint8_t head[ARCHIVE_HEADER], *buf;
+
+	if(fseeko(r->file, (off_t)offset, SEEK_SET) ||
+		fread(head, 1, ARCHIVE_HEADER, r->file) != ARCHIVE_HEADER ||
+		memcmp(head, ARCHIVE_MAGIC, 4))
+		return -1;
+	memcpy(h->magic, head, 4);
+	h->length = (uint32_t)getLE(head + 4, 4);
+	h->t0 = (int64_t)getLE(head + 8, 8);
+	h->t1 = (int64_t)getLE(head + 16, 8);
+	h->planes = (uint32_t)getLE(head + 24, 4);
+	h->records = (uint32_t)getLE(head + 28, 4);
+	if(h->length > r->bufsize)
+	{
+		buf = realloc(r->buf, h->length);
+		if(buf == NULL)
+			return -1;
+		r->buf = buf;
+		r->bufsize = h->length;
+	}
+	return fread(r->buf, 1, h->length, r->file) == h->length ? 0 : -1;
+}
+
+static int addBlock(struct ArchiveReader *r, const struct ArchiveIndex *e,
+	int *cap)
+{
+	struct ArchiveIndex *blocks;
+	if(r->count == *cap)
+	{
+		*cap = *cap ? *cap * 2 : 64;
+		blocks = realloc(r->blocks, sizeof(struct ArchiveIndex) * *cap);
+		if(blocks == NULL)
+			return -1;
+		r->blocks = blocks;
+	}
+	r->blocks[r->count++] = *e;
+	return 0;
+}
+
+/*
+	findBlocks
+	Indexes the blocks from offset up to end from their headers,
+	for the part of the file the index doesn't cover.
+	Stops at anything that isn't a whole block.
+*/
+static int findBlocks(struct ArchiveReader *r, uint64_t offset, uint64_t end,
+	int *cap)
+{
+	struct ArchiveBlock h;
+	struct ArchiveIndex e;
+	const uint8_t *p, *stop;
+	uint64_t v;
+	uint32_t i;
+
+	while(offset + ARCHIVE_HEADER <= end && readBlock(r, offset, &h) == 0 &&
+		offset + ARCHIVE_HEADER + h.length <= end)
+	{
+		memset(&e, 0, sizeof(e));
+		e.offset = offset;
+		e.t0 = h.t0;
+		e.t1 = h.t1;
+		e.length = h.length;
+		e.records = h.records;
+		p = r->buf;
+		stop = r->buf + h.length;
+		for(i = 0;i < h.planes && p != NULL && p + 3 <= stop;i++)
+		{
+			bloomAdd(e.bloom, (int)getLE(p, 3));
+			p = getVarint(p + 3, stop, &v);
+			if(p != NULL)
+				p = getVarint(p, stop, &v);
+			if(p != NULL)
+				p += v;
+		}
+		if(addBlock(r, &e, cap))
+			return -1;
+		offset += ARCHIVE_HEADER + h.length;
+	}
+	return 0;
+}
+
+int openArchiveReader(struct ArchiveReader *r, const char *name)
+{
+	struct ArchiveIndex *idx = NULL, *grown, e;
+	uint8_t entry[ARCHIVE_ENTRY];
+	FILE *f;
+	char *idxname;
+	uint64_t size, offset = 0, gap;
+	size_t n = strlen(name);
+	int count = 0, cap = 0, rcap = 0, i;
+
+	memset(r, 0, sizeof(*r));
+	r->file = fopen(name, "rb");
+	idxname = malloc(n + 5);
+	if(r->file == NULL || idxname == NULL || fseeko(r->file, 0, SEEK_END))
+		goto fail;
+	size = (uint64_t)ftello(r->file);
+	memcpy(idxname, name, n);
+	memcpy(idxname + n, ".idx", 5);
+
+	//a missing index just means every block is found from the headers
+	f = fopen(idxname, "rb");
+	while(f != NULL && fread(entry, 1, ARCHIVE_ENTRY, f) == ARCHIVE_ENTRY)
+	{
+		if(count == cap)
+		{
+			cap = cap ? cap * 2 : 64;
+			grown = realloc(idx, sizeof(struct ArchiveIndex) * cap);
+			if(grown == NULL)
+			{
+				fclose(f);
+				goto fail;
+			}
+			idx = grown;
+		}
+		e.offset = getLE(entry, 8);
+		e.t0 = (int64_t)getLE(entry + 8, 8);
+		e.t1 = (int64_t)getLE(entry + 16, 8);
+		e.length = (uint32_t)getLE(entry + 24, 4);
+		e.records = (uint32_t)getLE(entry + 28, 4);
+		for(i = 0;i < ARCHIVE_BLOOM;i++)
+			e.bloom[i] = getLE(entry + 32 + 8 * i, 8);
+		//a later block in the same place means these were dropped
+		while(count > 0 && idx[count - 1].offset + ARCHIVE_HEADER +
+			idx[count - 1].length > e.offset)
+			count--;
+		idx[count++] = e;
+	}
+	if(f != NULL)
+		fclose(f);
+	//entries for blocks that never made it to the file
+	while(count > 0 &&
+		idx[count - 1].offset + ARCHIVE_HEADER + idx[count - 1].length > size)
+		count--;
+
+	for(i = 0;i <= count;i++)
+	{
+		gap = i < count ? idx[i].offset : size;
+		if(offset < gap && findBlocks(r, offset, gap, &rcap))
+			goto fail;
+		if(i < count)
+		{
+			if(addBlock(r, &idx[i], &rcap))
+				goto fail;
+			offset = idx[i].offset + ARCHIVE_HEADER + idx[i].length;
+		}
+	}
+	free(idx);
+	free(idxname);
+	return 0;
+
+fail:
+	free(idx);
+	free(idxname);
+	closeArchiveReader(r);
+	return -1;
+}
+
+/*
+	decodeBlock
+	Returns the amount of updates of icao (-1 for all) decoded from
+	r->buf into r->recs, or -1 if the block doesn't make sense.
+*/
+static int decodeBlock(struct ArchiveReader *r, const struct ArchiveBlock *h,
+	int icao)
+{
+	const uint8_t *p = r->buf, *end = r->buf + h->length, *next;
+	struct ArchiveRecord *rec;
+	uint64_t count, bytes;
+	int64_t prev, d;
+	uint32_t i;
+	int n = 0, plane, col, k;
+
+	for(i = 0;i < h->planes;i++)
+	{
+		if(p + 3 > end)
+			return -1;
+		plane = (int)getLE(p, 3);
+		p = getVarint(p + 3, end, &count);
+		if(p != NULL)
+			p = getVarint(p, end, &bytes);
+		if(p == NULL || bytes > (uint64_t)(end - p) ||
+			n + count > h->records)
+			return -1;
+		next = p + bytes;
+		if(icao >= 0 && plane != icao)
+		{
+			p = next;
+			continue;
+		}
+
+		rec = &r->recs[n];
+		for(col = 0;col < COLUMNS;col++)
+		{
+			prev = col ? 0 : h->t0;
+			for(k = 0;k < (int)count;k++)
+			{
+				p = getDelta(p, next, &d);
+				if(p == NULL)
+					return -1;
+				prev += d;
+				setColumn(&rec[k], col, prev);
+			}
+		}
+		if(next - p != (long)count)
+			return -1;
+		for(k = 0;k < (int)count;k++)
+		{
+			rec[k].icao = plane;
+			rec[k].flags = POSVALID | (p[k] & 1 ? ALTVALID : 0) |
+				(p[k] & 2 ? SPDVALID : 0) | (p[k] & 4 ? TRKVALID : 0);
+		}
+		n += (int)count;
+		p = next;
+	}
+	return n;
+}
+
+long scanArchive(struct ArchiveReader *r, time_t from, time_t to, int icao,
+	ArchiveVisit fn, void *arg)
+{
+	struct ArchiveBlock h;
+	const struct ArchiveIndex *e;
+	struct ArchiveRecord *recs;
+	int64_t *key;
+	int *order;
+	long found = 0;
+	int b, n, i;
+
+	for(b = 0;b < r->count;b++)
+	{
+		e = &r->blocks[b];
+		if(e->t1 < (int64_t)from || e->t0 > (int64_t)to ||
+			(icao >= 0 && !bloomHas(e->bloom, icao)))
+			continue;
+		//a block that isn't what the index says was lost
+		if(readBlock(r, e->offset, &h))
+		{
+			if(ferror(r->file))
+				return -1;
+			continue;
+		}
+		if(h.t0 != e->t0 || h.t1 != e->t1 || h.length != e->length)
+			continue;
+
+		if((int)h.records > r->cap)
+		{
+			recs = realloc(r->recs,
+				sizeof(struct ArchiveRecord) * h.records);
+			if(recs != NULL)
+				r->recs = recs;
+			order = realloc(r->order, sizeof(int) * h.records * 2);
+			if(order != NULL)
+				r->order = order;
+			key = realloc(r->key, sizeof(int64_t) * h.records);
+			if(key != NULL)
+				r->key = key;
+			if(recs == NULL || order == NULL || key == NULL)
+				return -1;
+			r->cap = (int)h.records;
+		}
+		n = decodeBlock(r, &h, icao);
+		for(i = 0;i < n;i++)
+		{
+			r->order[i] = i;
+			r->key[i] = (int64_t)r->recs[i].time;
+		}
+		if(n > 0)
+			sortOrder(r->order, r->order + r->cap, r->key, n);
+		for(i = 0;i < n;i++)
+			if(r->recs[r->order[i]].time >= from &&
+				r->recs[r->order[i]].time <= to)
+			{
+				fn(&r->recs[r->order[i]], arg);
+				found++;
+			}
+	}
+	return found;
+}
+
+void closeArchiveReader(struct ArchiveReader *r)
+{
+	if(r->file != NULL)
+		fclose(r->file);
+	free(r->blocks);
+	free(r->buf);
+	free(r->recs);
+	free(r->order);
+	free(r->key);
+	memset(r, 0, sizeof(*r));
+	return;
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "logger.h"
+#include "output.h"
+
+/*
+	ARCHIVE.H
+	Long term storage of every position update, small enough to keep
+	months of it on an SD card, and quick to pull a time range or one
+	plane back out of.
+
+	Updates are collected into blocks of up to ARCHIVE_RECORDS, or
+	ARCHIVE_SPAN seconds. A block keeps each plane's updates together,
+	as columns of time, lat, lng, altitude, speed and track, each
+	stored as the zigzag varint of the change from the update before.
+	A plane in steady flight changes by a few units per update, so
+	most values take a byte, about 8 bytes an update against 80 for a
+	line of the CSV.
+
+	<name> is the blocks, appended through an OutputWriter (output.h),
+	<name>.idx has an ArchiveIndex per block. The index can be missing
+	or behind after a crash, the reader adds whatever blocks it is
+	missing from the block headers.
+
+	Everything is little endian.
+*/
+
+#define ARCHIVE_MAGIC "ADSA"
+#define ARCHIVE_RECORDS 640	//encoded blocks always fit OUTPUT_FLUSH
+#define ARCHIVE_SPAN 60		//seconds, so quiet receivers still write
+#define ARCHIVE_LATLNG 1e5	//units per degree, about a meter
+
+/*
+	ArchiveBlock
+	The header of every block, then for each plane in ICAO order:
+	icao (3 bytes), varint updates, varint bytes of its columns,
+	and the columns: time, lat, lng, alt, speed (tenths of a knot),
+	track (tenths of a degree) as zigzag varint deltas, then a byte
+	per update of which of alt, speed and track were known.
+	The first time delta is from t0, the other first values from 0.
+*/
+struct ArchiveBlock
+{
+	char magic[4];
+	uint32_t length;	//bytes after the header
+	int64_t t0, t1;		//first and last update
+	uint32_t planes, records;
+};
+
+#define ARCHIVE_HEADER 32	//bytes of an ArchiveBlock in the file
+#define ARCHIVE_BLOOM 4		//64 bit words of ICAO filter per block
+
+/*
+	ArchiveIndex
+	One per block in the .idx file, 64 bytes.
+	bloom has 2 bits set for every plane in the block, a plane with
+	either bit clear isn't in it.
+*/
+struct ArchiveIndex
+{
+	uint64_t offset;
+	int64_t t0, t1;
+	uint32_t length, records;
+	uint64_t bloom[ARCHIVE_BLOOM];
+};
+
+#define ARCHIVE_ENTRY 64	//bytes of an ArchiveIndex in the file
+
+/*
+	ArchiveRecord
+	One position update. flags has POSVALID and any of ALTVALID,
+	SPDVALID and TRKVALID, the others are 0.
+*/
+struct ArchiveRecord
+{
+	int icao;
+	time_t time;
+	double lat, lng;
+	int alt;
+	double spd, trk;
+	enum PlaneFlags flags;
+};
+
+/*
+	Archive
+	The writer. Updates wait in recs until the block is sealed.
+*/
+struct Archive
+{
+	struct OutputWriter data, index;
+	uint64_t offset;	//where the next block starts
+	struct ArchiveRecord *recs;
+	int count;
+	int *order;		//recs by ICAO while sealing, and scratch
+	int64_t *key;
+	uint8_t *columns;	//one plane's columns while sealing
+};
+
+/*
+	openArchive
+	Returns 0 on success, -1 if the files can't be opened or out of
+	memory.
+	Appends to an existing archive.
+*/
+int openArchive(struct Archive *a, const char *name);
+
+/*
+	archivePlane
+	Adds the position update now of p. logPlane calls this for the
+	attached archive (see attachArchive in logger.h).
+*/
+void archivePlane(struct Archive *a, const struct Plane *p, time_t now);
+
+/*
+	flushArchive
+	Seals the block once it is ARCHIVE_SPAN seconds old, and passes
+	now on to flushOutput. Call it every pass like flushOutput.
+*/
+void flushArchive(struct Archive *a, time_t now);
+
+/*
+	closeArchive
+	Returns 0 if everything was written, -1 if not.
+	Seals the last block and closes both files.
+*/
+int closeArchive(struct Archive *a);
+
+/*
+	ArchiveReader
+	The index of every block, read in full by openArchiveReader.
+*/
+struct ArchiveReader
+{
+	FILE *file;
+	struct ArchiveIndex *blocks;
+	int count;
+	uint8_t *buf;		//the block being decoded
+	size_t bufsize;
+	struct ArchiveRecord *recs;	//and its updates
+	int *order;		//recs by time, and scratch
+	int64_t *key;
+	int cap;		//of recs
+};
+
+/*
+	openArchiveReader
+	Returns 0 on success, -1 if the archive can't be opened or out of
+	memory.
+	Blocks after the end of the index are found from their headers.
+*/
+int openArchiveReader(struct ArchiveReader *r, const char *name);
+
+/*
+	scanArchive
+	Returns the amount of updates passed to fn, or -1 on a read error.
+	Calls fn for every update from from to to (inclusive) in time
+	order, only those of icao unless it is -1.
+	Only reads the blocks whose time range, and for one plane, whose
+	filter match.
+*/
+typedef void (*ArchiveVisit)(const struct ArchiveRecord *rec, void *arg);
+long scanArchive(struct ArchiveReader *r, time_t from, time_t to, int icao,
+	ArchiveVisit fn, void *arg);
+
+/*
+	closeArchiveReader
+	Closes the file and frees the index.
+*/
+void closeArchiveReader(struct ArchiveReader *r);
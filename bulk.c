@@ -0,0 +1,461 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifndef UCRT
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "bulk.h"
+
+#define CHUNKSIZE (4 << 20)	//bytes of hex text per chunk (~130k frames)
+#define IQCHUNK (1 << 24)	//I/Q samples per chunk (8s at 2 Msps)
+#define MAXTHREADS 64
+
+/*
+	BulkChunk
+	One slot of the in-flight window.
+	A worker owns the slot from when it claims a chunk until
+	it sets ready, then the applying thread owns it until it
+	clears ready and bumps applied.
+*/
+struct BulkChunk
+{
+	struct AdsbEvent *ev;	//decoded events in file order
+	int evcnt, evsize;
+	int passed;		//frames that passed parity
+	int ready;
+
+	//I/Q chunks only
+	struct DemodFrame *fr;	//frames in sample order
+	int frcnt, frsize;
+	uint64_t first, last;	//samples the chunk owns
+	unsigned long candidates, checked, repaired;
+	uint16_t noise, threshold;
+};
+
+/*
+	BulkJob
+	Shared between the worker threads and the applying thread.
+*/
+struct BulkJob
+{
+	const char *data;
+	size_t len;
+	const struct Demod *demod;	//settings for I/Q chunks
+	void (*decode)(const struct BulkJob *job, long chunk,
+		struct BulkChunk *out);
+	long nchunks;
+	long next;	//next chunk a worker can take
+	long applied;	//chunks applied to the plane buffer so far
+	int window;	//amount of chunk slots
+	struct BulkChunk *slots;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/*
+	mapFile
+	Maps a whole file read only.
+	Returns NULL if the file can't be opened or is empty.
+
+	UCRT doesn't have mmap so there the file is just read in.
+*/
+static const char *mapFile(const char *filename, size_t *len)
+{
+#ifndef UCRT
+	int fd;
+	struct stat st;
+	void *p;
+
+	fd = open(filename, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+	if(fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	//mapping stays valid after close
+	if(p == MAP_FAILED)
+		return NULL;
+	//chunks are read front to back
+	madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+	*len = (size_t)st.st_size;
+	return (const char*)p;
+#else
+	FILE *f;
+	char *p;
+	long size;
+
+	f = fopen(filename, "rb");
+	if(f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if(size <= 0 || (p = malloc(size)) == NULL)
+	{
+		fclose(f);
+		return NULL;
+	}
+	*len = fread(p, 1, size, f);
+	fclose(f);
+	return p;
+#endif
+}
+
+static void unmapFile(const char *data, size_t len)
+{
+#ifndef UCRT
+	munmap((void*)data, len);
+#else
+	free((void*)data);
+#endif
+	return;
+}
+
+/*
+	chunkStart
+	Chunks are cut every CHUNKSIZE bytes, then moved forward to
+	just past the next newline so no line is split.
+	Each worker finds its own bounds this way, so no pass over
+	the file is needed up front.
+*/
+static size_t chunkStart(const struct BulkJob *job, long chunk)
+{
+	const char *nl;
+	size_t pos;
+
+	if(chunk <= 0)
+		return 0;
+	pos = (size_t)chunk * CHUNKSIZE;
+	if(pos >= job->len)
+		return job->len;
+	//the line containing the cut belongs to the chunk before
+	nl = memchr(job->data + pos - 1, '\n', job->len - pos + 1);
+	if(nl == NULL)
+		return job->len;
+	return (size_t)(nl - job->data) + 1;
+}
+
+static void decodeChunk(const struct BulkJob *job, long chunk,
+	struct BulkChunk *out)
+{
+	union AdsbFrame f;
+	struct AdsbEvent *ev;
+	size_t pos, end;
+	const char *p, *nl;
+	int n;
+
+	pos = chunkStart(job, chunk);
+	end = chunkStart(job, chunk + 1);
+	out->evcnt = 0;
+	out->passed = 0;
+
+	while(pos < end)
+	{
+		p = job->data + pos;
+		nl = memchr(p, '\n', end - pos);
+		n = parseHexFrame(p, nl ? (size_t)(nl - p) : end - pos, &f);
+		pos = nl ? (size_t)(nl - job->data) + 1 : end;
+		if(n < 0)
+			continue;
+
+		if(out->evcnt == out->evsize)
+		{
+			n = out->evsize ? out->evsize * 2 : 4096;
+			ev = realloc(out->ev, sizeof(struct AdsbEvent) * n);
+			//out of memory, the events so far are all the chunk has
+			if(ev == NULL)
+				return;
+			out->ev = ev;
+			out->evsize = n;
+		}
+		if(decodeEvent(&f, rlat, rlng, &out->ev[out->evcnt]) == 0)
+		{
+			out->passed++;
+			if(out->ev[out->evcnt].fl)
+				out->evcnt++;
+		}
+	}
+	return;
+}
+
+static void *bulkWorker(void *arg)
+{
+	struct BulkJob *job = arg;
+	struct BulkChunk *slot;
+	long chunk;
+
+	pthread_mutex_lock(&job->lock);
+	while(job->next < job->nchunks)
+	{
+		chunk = job->next;
+		//don't get more than a window ahead of the applying thread
+		if(chunk >= job->applied + job->window)
+		{
+			pthread_cond_wait(&job->cond, &job->lock);
+			continue;
+		}
+		job->next++;
+		slot = &job->slots[chunk % job->window];
+		pthread_mutex_unlock(&job->lock);
+
+		job->decode(job, chunk, slot);
+
+		pthread_mutex_lock(&job->lock);
+		slot->ready = 1;
+		pthread_cond_broadcast(&job->cond);
+	}
+	pthread_mutex_unlock(&job->lock);
+	return NULL;
+}
+
+/*
+	demodChunk
+	Each chunk starts demodulating a frame length before the samples
+	it owns, so a frame that starts in the chunk before is found and
+	skipped over like the sequential demodulator would, and it goes a
+	frame length past them so frames starting at the very end are
+	whole. Only frames starting in the chunk's own samples are kept,
+	so every frame is kept by exactly one chunk.
+*/
+static void demodFound(const struct DemodFrame *f, void *arg)
+{
+	struct BulkChunk *out = arg;
+	struct DemodFrame *fr;
+	int n;
+
+	if(f->sample < out->first || f->sample >= out->last)
+		return;
+	if(out->frcnt == out->frsize)
+	{
+		n = out->frsize ? out->frsize * 2 : 1024;
+		fr = realloc(out->fr, sizeof(struct DemodFrame) * n);
+		//out of memory, the frame is lost like a missed preamble
+		if(fr == NULL)
+			return;
+		out->fr = fr;
+		out->frsize = n;
+	}
+	out->fr[out->frcnt++] = *f;
+	return;
+}
+
+static void demodChunk(const struct BulkJob *job, long chunk,
+	struct BulkChunk *out)
+{
+	struct Demod d;
+	const struct Demod *cfg = job->demod;
+	uint64_t total, start, end, pos;
+	size_t n;
+
+	total = job->len / 2;
+	out->first = (uint64_t)chunk * IQCHUNK;
+	out->last = out->first + IQCHUNK < total ? out->first + IQCHUNK : total;
+	out->frcnt = 0;
+	if(initDemod(&d))
+		return;
+	setDemodKernel(&d, cfg->kernel);
+	setDemodRate(&d, cfg->rate);
+	d.repair = cfg->repair;
+	d.snr = cfg->snr;
+
+	start = out->first > d.framelen ? out->first - d.framelen : 0;
+	end = out->last + d.framelen < total ? out->last + d.framelen : total;
+	//frame samples are counted from the start of the file
+	d.pos = start;
+	d.skip = start;
+	for(pos = start;pos < end;pos += n)
+	{
+		n = end - pos < DEMOD_BLOCK ? (size_t)(end - pos) : DEMOD_BLOCK;
+		demodBlock(&d, (const uint8_t*)job->data + 2 * pos, n,
+			demodFound, out);
+	}
+
+	out->candidates = d.candidates;
+	out->checked = d.checked;
+	out->repaired = d.repaired;
+	out->noise = d.noise;
+	out->threshold = d.threshold;
+	freeDemod(&d);
+	return;
+}
+
+/*
+	startJob
+	Starts the worker threads on a mapped file, job->data, len,
+	decode and nchunks have to be set.
+	Returns the amount of threads started, 0 if none could be, in
+	which case there is nothing for endJob to clean up.
+*/
+static int startJob(struct BulkJob *job, int threads, pthread_t tid[])
+{
+	int i;
+
+	if(threads <= 0)
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads < 1)
+		threads = 1;
+	if(threads > MAXTHREADS)
+		threads = MAXTHREADS;
+
+	job->next = 0;
+	job->applied = 0;
+	job->window = threads * 2;
+	job->slots = calloc(job->window, sizeof(struct BulkChunk));
+	if(job->slots == NULL)
+		return 0;
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->cond, NULL);
+
+	//the window stays as it is, fewer threads just fill it slower
+	for(i = 0;i < threads;i++)
+		if(pthread_create(&tid[i], NULL, bulkWorker, job))
+			break;
+	if(i == 0)
+	{
+		pthread_mutex_destroy(&job->lock);
+		pthread_cond_destroy(&job->cond);
+		free(job->slots);
+	}
+	return i;
+}
+
+//waits for the next chunk in file order to be decoded
+static struct BulkChunk *nextChunk(struct BulkJob *job)
+{
+	struct BulkChunk *slot = &job->slots[job->applied % job->window];
+	pthread_mutex_lock(&job->lock);
+	while(!slot->ready)
+		pthread_cond_wait(&job->cond, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+	return slot;
+}
+
+//gives the chunk from nextChunk back to the workers
+static void doneChunk(struct BulkJob *job, struct BulkChunk *slot)
+{
+	pthread_mutex_lock(&job->lock);
+	slot->ready = 0;
+	job->applied++;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+	return;
+}
+
+//workers finish the chunk they have and take no more
+static void stopJob(struct BulkJob *job)
+{
+	pthread_mutex_lock(&job->lock);
+	job->next = job->nchunks;
+	pthread_cond_broadcast(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+	return;
+}
+
+static void endJob(struct BulkJob *job, int threads, pthread_t tid[])
+{
+	int i;
+	for(i = 0;i < threads;i++)
+		pthread_join(tid[i], NULL);
+	for(i = 0;i < job->window;i++)
+	{
+		free(job->slots[i].ev);
+		free(job->slots[i].fr);
+	}
+	free(job->slots);
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->cond);
+	unmapFile(job->data, job->len);
+	return;
+}
+
+int bulkDecodeHex(const char *filename, int threads,
+	struct Plane buf[], int bufsize)
+{
+	struct BulkJob job;
+	struct BulkChunk *slot;
+	pthread_t tid[MAXTHREADS];
+	int i, passed = 0;
+
+	job.data = mapFile(filename, &job.len);
+	if(job.data == NULL)
+		return -1;
+	job.decode = decodeChunk;
+	job.nchunks = (long)((job.len + CHUNKSIZE - 1) / CHUNKSIZE);
+	threads = startJob(&job, threads, tid);
+	if(threads == 0)
+	{
+		unmapFile(job.data, job.len);
+		return -1;
+	}
+
+	//apply chunks strictly in file order
+	while(job.applied < job.nchunks)
+	{
+		slot = nextChunk(&job);
+		for(i = 0;i < slot->evcnt;i++)
+			logPlane(buf, bufsize, slot->ev[i].icao, slot->ev[i].call,
+				slot->ev[i].cat, slot->ev[i].lat, slot->ev[i].lng,
+				slot->ev[i].trk, slot->ev[i].spd, slot->ev[i].alt,
+				slot->ev[i].vert, slot->ev[i].fl);
+		passed += slot->passed;
+		doneChunk(&job, slot);
+	}
+
+	endJob(&job, threads, tid);
+	return passed;
+}
+
+int bulkDemodIQ(const char *filename, int threads, struct Demod *d,
+	DemodCallback cb, BulkProgress progress, void *arg)
+{
+	struct BulkJob job;
+	struct BulkChunk *slot;
+	pthread_t tid[MAXTHREADS];
+	int i;
+
+	job.data = mapFile(filename, &job.len);
+	if(job.data == NULL)
+		return -1;
+	job.demod = d;
+	job.decode = demodChunk;
+	job.nchunks = (long)((job.len / 2 + IQCHUNK - 1) / IQCHUNK);
+	threads = startJob(&job, threads, tid);
+	if(threads == 0)
+	{
+		unmapFile(job.data, job.len);
+		return -1;
+	}
+
+	//frames go out in sample order, chunk after chunk
+	while(job.applied < job.nchunks)
+	{
+		slot = nextChunk(&job);
+		for(i = 0;i < slot->frcnt;i++)
+			cb(&slot->fr[i], arg);
+		d->candidates += slot->candidates;
+		d->checked += slot->checked;
+		d->repaired += slot->repaired;
+		d->frames += (unsigned long)slot->frcnt;
+		d->noise = slot->noise;
+		d->threshold = slot->threshold;
+		d->pos = slot->last;
+		doneChunk(&job, slot);
+		if(progress != NULL && progress(arg))
+		{
+			stopJob(&job);
+			break;
+		}
+	}
+
+	endJob(&job, threads, tid);
+	return 0;
+}
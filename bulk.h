@@ -0,0 +1,64 @@
+#pragma once
+#include "logger.h"
+#include "demod.h"
+
+/*
+	BULK.H
+	This file contains the offline modes, used for going back over
+	archived captures as fast as the machine allows.
+
+	The live modes have to read one message at a time since the data
+	might not exist yet, but a capture file on disk is all there,
+	so it can be split up and decoded on every core at once.
+*/
+
+/*
+	bulkDecodeHex
+	Returns the amount of frames that passed the parity check.
+	Returns -1 if the file couldn't be opened or mapped, or no worker
+	thread could be started.
+
+	Decodes a whole file of "*<hex>;" lines (same format as -p)
+	into the plane buffer.
+
+	The file is mapped into memory and cut into chunks on line boundaries.
+	Worker threads take chunks in order, parse, parity check and decode them
+	into AdsbEvents, and the calling thread applies each chunk's events
+	with logPlane in file order.
+	The messages don't have timestamps, so the order they are in the
+	file is the only order there is, and since chunks are applied
+	strictly one after the other the result is the same as the -p loop.
+
+	Only a few chunks are in flight at once so memory use doesn't
+	depend on the file size.
+	threads <= 0 uses one thread per online core.
+*/
+int bulkDecodeHex(const char *filename, int threads,
+	struct Plane buf[], int bufsize);
+
+/*
+	bulkDemodIQ
+	Returns 0 on success, -1 if the file couldn't be opened or mapped
+	(a pipe or FIFO can't be, those need the streaming -b loop) or no
+	worker thread could be started.
+
+	Demodulates a whole I/Q capture file (same format as -b) and calls
+	cb for each frame in sample order, from the calling thread.
+
+	d has to be from initDemod, its kernel, rate, repair and snr are
+	used for every chunk, and the chunk counters are added into it.
+
+	The samples are cut into IQCHUNK chunks that overlap by a frame
+	length on both sides, and each chunk keeps only frames that start
+	in its own samples, so frames in the overlaps aren't doubled.
+	The noise floor starts over in each chunk, but a chunk is
+	many blocks long so it settles in the first one.
+
+	progress (if not NULL) is called with arg after each chunk's
+	frames are passed on, also from the calling thread. Returning
+	nonzero stops the job there, chunks the workers already started
+	are dropped.
+*/
+typedef int (*BulkProgress)(void *arg);
+int bulkDemodIQ(const char *filename, int threads, struct Demod *d,
+	DemodCallback cb, BulkProgress progress, void *arg);
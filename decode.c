@@ -5,6 +5,54 @@
 #define CRC_GEN 0x1FFF409u	//generator for CRC parity check 'u' means unsigned
 #define Nz 15.			//num latitude zones
 
+/*
+	nlTable
+	Latitudes where the number of longitude zones (NL) drops by one,
+	starting from the equator (NL = 59) up to 87 degrees (NL = 2).
+	Past the last entry NL is 1.
+
+	The values are the closed form of the NL equation solved for latitude:
+	acos(sqrt((1 - cos(pi/(2Nz))) / (1 - cos(2pi/NL)))) * 180/pi
+	which lets cprNL do a binary search instead of calling acos and cos
+	for every position message.
+*/
+static const double nlTable[58] =
+{
+	10.4704713000, 14.8281743687, 18.1862635707, 21.0293949260,
+	23.5450448656, 25.8292470706, 27.9389871012, 29.9113568573,
+	31.7720970768, 33.5399343630, 35.2289959780, 36.8502510759,
+	38.4124189241, 39.9225668433, 41.3865183226, 42.8091401224,
+	44.1945495142, 45.5462672266, 46.8673325250, 48.1603912810,
+	49.4277643926, 50.6715016555, 51.8934246917, 53.0951615280,
+	54.2781747227, 55.4437844450, 56.5931875621, 57.7274735387,
+	58.8476377615, 59.9545927669, 61.0491777425, 62.1321665921,
+	63.2042747938, 64.2661652257, 65.3184530968, 66.3617100838,
+	67.3964677408, 68.4232202208, 69.4424263114, 70.4545107499,
+	71.4598647303, 72.4588454473, 73.4517744167, 74.4389341573,
+	75.4205625665, 76.3968439079, 77.3678946133, 78.3337408292,
+	79.2942822546, 80.2492321328, 81.1980134927, 82.1395698051,
+	83.0719944472, 83.9917356298, 84.8916619070, 85.7554162094,
+	86.5353699751, 87.0000000000
+};
+
+int cprNL(double lat)
+{
+	int lo = 0, hi = 58, mid;
+	if(lat < 0.)
+		lat = -lat;
+	//first table entry at or above lat, a latitude right on a
+	//boundary still has the zones from below it, like the formula
+	while(lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if(lat <= nlTable[mid])
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return 59 - lo;
+}
+
 /*
 	cprDecode
 	Returns 0 upon success
@@ -38,23 +86,19 @@ static int cprDecode(const union AdsbFrame *frame, double rlat, double rlng,
 		rlng += 360.;
 
 	//lat-cpr and lon-cpr are going to now be lat and lng
-	*lat = (double)frame->me.ab.latcpr / 131072.;	//131072 = 2^17
-	*lng = (double)frame->me.ab.loncpr / 131072.;
+	*lat = (double)adsbAbLatCpr(frame) / 131072.;	//131072 = 2^17
+	*lng = (double)adsbAbLonCpr(frame) / 131072.;
 
-	dlat = (360. / (4.*Nz - (double)frame->me.ab.f)) / ((double)tf * 3. + 1.);
-	j = (int)(floor(rlat / dlat) + floor(fmod(rlat, dlat) /
+	dlat = (360. / (4.*Nz - (double)adsbAbF(frame))) /
+		((double)tf * 3. + 1.);
+	//fmod is negative south of the equator, the mod in the spec never is
+	j = (int)(floor(rlat / dlat) + floor((rlat - dlat * floor(rlat / dlat)) /
 		dlat - *lat + 0.5));
 	*lat = dlat * ((double)j + *lat);
 
-	if(*lat == 0.)		//edge cases
-		NL = 59;
-	else if(*lat > 87. || *lat < -87.)
-		NL = 1;
-	else			//replace function with lookup table eventually
-		NL = (int)floor(2.*M_PI / acos(1. - (1.-cos(M_PI/(2.*Nz))) /
-			pow(cos(*lat * M_PI/180), 2.)));
+	NL = cprNL(*lat);
 
-	dlng = (360. / fmax(1., (double)NL - (double)frame->me.ab.f)) /
+	dlng = (360. / fmax(1., (double)NL - (double)adsbAbF(frame))) /
 		((double)tf * 3. + 1.);
 	m = (int)(floor(rlng / dlng) + floor(fmod(rlng, dlng) /
 		dlng - *lng + 0.5));
@@ -65,128 +109,193 @@ static int cprDecode(const union AdsbFrame *frame, double rlat, double rlng,
 	return 0;
 }
 
+/*
+	crcTable and bitSynd
+	crcTable is the 24 bit CRC of each byte value, bitSynd is
+	the syndrome of a frame with only that bit set.
+	Both only depend on CRC_GEN, so they are filled once at startup.
+*/
+static uint32_t crcTable[256];
+static uint32_t bitSynd[112];
+
+static uint32_t crcBytes(const uint8_t *data, int len)
+{
+	uint32_t crc = 0;
+	int i;
+	for(i = 0;i < len;i++)
+		crc = ((crc << 8) ^ crcTable[((crc >> 16) ^ data[i]) & 0xFF]) &
+			0xFFFFFF;
+	return crc;
+}
+
+__attribute__((constructor)) static void initCrcTables(void)
+{
+	uint8_t data[11];
+	uint32_t crc;
+	int i, k;
+
+	for(i = 0;i < 256;i++)
+	{
+		crc = (uint32_t)i << 16;
+		for(k = 0;k < 8;k++)
+			crc = crc & 0x800000 ? (crc << 1) ^ CRC_GEN : crc << 1;
+		crcTable[i] = crc & 0xFFFFFF;
+	}
+	//flipping a data bit changes the CRC, a parity bit only itself
+	for(i = 0;i < 88;i++)
+	{
+		memset(data, 0, sizeof(data));
+		data[i >> 3] = (uint8_t)(0x80 >> (i & 7));
+		bitSynd[i] = crcBytes(data, 11);
+	}
+	for(i = 88;i < 112;i++)
+		bitSynd[i] = 1u << (111 - i);
+	return;
+}
+
+uint32_t computeCrc(const union AdsbFrame *frame)
+{
+	return crcBytes(frame->frame, 11);
+}
+
+uint32_t crcSyndrome(const union AdsbFrame *frame)
+{
+	return computeCrc(frame) ^ (uint32_t)adsbPi(frame);
+}
+
+uint32_t bitSyndrome(int bit)
+{
+	return bitSynd[bit];
+}
+
 int parityCheck(const union AdsbFrame *frame)
 {
 	uint8_t data[14];
+	uint32_t gen;
 	int i, b, o;
-	data[0] = 0;	//will be overwritten by parity code later
-	data[1] = 0;
-	data[2] = 0;
-	for(i = 0;i < 11;i++)	//lowest 24 bits of frame is parity code
-		data[i + 3] = frame->frame[i + 3];
-
-	i = 87;		//data bit from 0-87
-	b = 13;		//data[] block from 3-13
-	o = 7;		//offset bit from 0-7
-	do
+	memcpy(data, frame->frame, 11);
+	data[11] = 0;	//the last 24 bits of frame are the parity code
+	data[12] = 0;
+	data[13] = 0;
+
+	for(i = 0;i < 88;i++)	//data bit from 0-87
 	{
+		b = i / 8;	//data[] block from 0-10
+		o = 7 - i % 8;	//offset bit from 7-0
 		if(data[b] & (1 << o))	//checks if leftmost data bit is 1
-		{	//bit shifts are done after add/sub, but before bitwise AND
+		{
 			//25 greatest bits of data XOR CRC_GEN operation
-			//since the 25 bits are split between 3 uint8_ts,
-			//a little bit of math is done to align the CRC_GEN
-			//right shift CRC_GEN by 17-24 bits depending on o for data[b]
-			//last data block requires CRC_GEN left shift alignment
-			data[b] = data[b] ^ (uint8_t)((CRC_GEN >> 24 - o) & 0xFF);
-			data[b-1] = data[b-1] ^ (uint8_t)((CRC_GEN >> 16 - o) & 0xFF);
-			data[b-2] = data[b-2] ^ (uint8_t)((CRC_GEN >> 8 - o) & 0xFF);
-			data[b-3] = data[b-3] ^ (uint8_t)((CRC_GEN << o) & 0xFF);
+			//the 25 bits are split between 4 uint8_ts from data[b],
+			//so CRC_GEN is lined up with bit o of the first one
+			gen = CRC_GEN << o;
+			data[b] ^= (uint8_t)(gen >> 24);
+			data[b+1] ^= (uint8_t)(gen >> 16);
+			data[b+2] ^= (uint8_t)(gen >> 8);
+			data[b+3] ^= (uint8_t)gen;
 		}
 		//the XOR operation is guaranteed to make the leftmost bit 0
-		i--;
-		b = i / 8 + 3;
-		o = i % 8;
-	} while(i >= 0);
+	}
 
-	if(data[0] == frame->frame[0] && data[1] == frame->frame[1] &&
-		data[2] == frame->frame[2])
+	if(data[11] == frame->frame[11] && data[12] == frame->frame[12] &&
+		data[13] == frame->frame[13])
 		return 0;
 	return -1;
 }
 
-int getIdent(const union AdsbFrame *frame, char call[9], char type[8])
-{
-	int i;
+/*
+	callChars
+	Call sign chars by their 6 bit code. Letters are ASCII chars
+	with the 7th bit cut off, spaces and numbers are ASCII equivalent.
+	All other chars are unused, so as long as parity passes, is valid.
+*/
+static const char callChars[64] =
+	"@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_ !\"#$%&'()*+,-./0123456789:;<=>?";
 
-	if(frame->me.id.tc < 1 || frame->me.id.tc > 4)
+/*
+	typeNames
+	By tc * 8 + category, see getIdent. The gaps are reserved
+	or "no category information".
+*/
+static const char *const typeNames[050] = {
+	[021] = "SEV",		//Surface Emergency Vehicle
+	[023] = "SSV",		//Surface Service Vehicle
+	[024] = "GRDOBS",	//ground obstruction
+	[025] = "GRDOBS",
+	[026] = "GRDOBS",
+	[027] = "GRDOBS",
+	[031] = "GLIDER",
+	[032] = "LTA",		//Lighter Than Air (hot air balloon)
+	[033] = "SKYDIV",
+	[034] = "ULTLIT",	//ultralight, hang or para glider
+	[036] = "UAV",
+	[037] = "SPACE",
+	[041] = "LIGHT",	//sub 7000kg
+	[042] = "MED1",		//7000-34000kg
+	[043] = "MED2",		//34000-136000kg
+	[044] = "HVA",		//High Vortex Aircraft (disturbs nearby)
+	[045] = "HEAVY",	//greater 136000kg
+	[046] = "HIPERF",	//>400kts >5g pulls
+	[047] = "ROTOR",	//helicopters and stuff
+};
+
+int getIdent(const union AdsbFrame *frame, uint64_t *call, uint8_t *cat)
+{
+	if(adsbTc(frame) < 1 || adsbTc(frame) > 4)
 		return -1;
 
-	call[0] = (char)frame->me.id.c1;
-	call[1] = (char)frame->me.id.c2;
-	call[2] = (char)frame->me.id.c3;
-	call[3] = (char)frame->me.id.c4;
-	call[4] = (char)frame->me.id.c5;
-	call[5] = (char)frame->me.id.c6;
-	call[6] = (char)frame->me.id.c7;
-	call[7] = (char)frame->me.id.c8;
-	call[8] = 0;
+	*call = adsbIdCall(frame);
+	*cat = (uint8_t)(adsbTc(frame) * 010 + adsbIdCat(frame));
+	return 0;
+}
+
+int expandCall(uint64_t call, char text[9])
+{
+	int i, len = 0;
 
 	for(i = 0;i < 8;i++)
 	{
-		//callsign letters are ASCII chars with 7th bit cut off
-		//spaces and numbers are ASCII equivalent
-		//all other chars are unused, so as long as parity passes, is valid
-		if(call[i] < 27)
-			call[i] += 0x40;
+		text[i] = callChars[call >> (42 - 6 * i) & 077];
+		if(text[i] != ' ')
+			len = i + 1;
 	}
+	text[8] = 0;
+	return len;
+}
 
-	switch(frame->me.id.tc * 010 + frame->me.id.cat)
+int packCall(const char *text, uint64_t *call)
+{
+	int i, n = 0, c;
+
+	*call = 0;
+	for(i = 0;i < 8;i++)
 	{
-	case 021:
-		strcpy(type, "SEV");	//Surface Emergency Vehicle
-		break;
-	case 023:
-		strcpy(type, "SSV");	//Surface Service Vehicle
-		break;
-	case 024:
-	case 025:
-	case 026:
-	case 027:
-		strcpy(type, "GRDOBS");	//ground obstruction
-		break;
-	case 031:
-		strcpy(type, "GLIDER");
-		break;
-	case 032:
-		strcpy(type, "LTA");	//Lighter Than Air (hot air balloon)
-		break;
-	case 033:
-		strcpy(type, "SKYDIV");
-		break;
-	case 034:
-		strcpy(type, "ULTLIT");	//ultralight, hang or para glider
-		break;
-	case 036:
-		strcpy(type, "UAV");
-		break;
-	case 037:
-		strcpy(type, "SPACE");
-		break;
-	case 041:
-		strcpy(type, "LIGHT");	//sub 7000kg
-		break;
-	case 042:
-		strcpy(type, "MED1");	//7000-34000kg
-		break;
-	case 043:
-		strcpy(type, "MED2");	//34000-136000kg
-		break;
-	case 044:
-		strcpy(type, "HVA");	//High Vortex Aircraft (disturbs nearby)
-		break;
-	case 045:
-		strcpy(type, "HEAVY");	//greater 136000kg
-		break;
-	case 046:
-		strcpy(type, "HIPERF");	//>400kts >5g pulls
-		break;
-	case 047:
-		strcpy(type, "ROTOR");	//helicopters and stuff
-		break;
-	default:
-		strcpy(type, "UNOWEN");
+		c = text[n];
+		if(c == 0)
+			c = ' ';	//pad, without moving past the end
+		else if((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+			c == ' ')
+			n++;
+		else
+			return -1;
+		*call = *call << 6 | (c & 077);
 	}
+	return n;
+}
+
+const char *planeType(int cat)
+{
+	if(cat < 0 || cat >= 050 || typeNames[cat] == NULL)
+		return "UNOWEN";
+	return typeNames[cat];
+}
+
+int planeCategory(const char *type)
+{
+	int i;
 
+	for(i = 0;i < 050;i++)
+		if(typeNames[i] != NULL && strcmp(typeNames[i], type) == 0)
+			return i;
 	return 0;
 }
 
@@ -194,18 +303,18 @@ int getAirPos(const union AdsbFrame *frame, double rlat, double rlng, int *alt,
 	double *lat, double *lng)
 {
 	int x = 0;	//return value for odd circumstances
-	if(frame->me.ab.tc < 9 || frame->me.ab.tc > 22 || frame->me.ab.tc == 19)
+	int tc = (int)adsbTc(frame), code = (int)adsbAbAlt(frame);
+	if(tc < 9 || tc > 22 || tc == 19)
 		return -1;
 
-	if(frame->me.ab.alt == 0)
+	if(code == 0)
 		x = 1;	//no alt data
 	else
 	{
-		if(frame->me.ab.tc < 19)
+		if(tc < 19)
 		{
-			*alt = (int)(((frame->me.ab.alt & 0xFE0) >> 1) +
-				(frame->me.ab.alt & 0xF));
-			if(frame->me.ab.alt & 0x010)
+			*alt = ((code & 0xFE0) >> 1) + (code & 0xF);
+			if(code & 0x010)
 				*alt = *alt * 25 - 1000;
 			else
 			{
@@ -216,7 +325,7 @@ int getAirPos(const union AdsbFrame *frame, double rlat, double rlng, int *alt,
 		}
 		else
 		{		//round m to ft from GNSS height
-			*alt = (int)round((double)frame->me.ab.alt * 3.281);
+			*alt = (int)round((double)code * 3.281);
 		}
 	}
 
@@ -228,12 +337,12 @@ int getAirPos(const union AdsbFrame *frame, double rlat, double rlng, int *alt,
 int getSurfPos(const union AdsbFrame *frame, double rlat, double rlng,
 	double *trk, double *spd, double *lat, double *lng)
 {
-	int x = 0;
-	if(frame->me.sp.tc < 5 || frame->me.sp.tc > 8)
+	int x = 0, mov = (int)adsbSpMov(frame);
+	if(adsbTc(frame) < 5 || adsbTc(frame) > 8)
 		return -1;
 
-	if(frame->me.sp.s)	//actual track = TRK * 360 / 128
-		*trk = (double)frame->me.sp.trk * 2.8125;
+	if(adsbSpS(frame))	//actual track = TRK * 360 / 128
+		*trk = (double)adsbSpTrk(frame) * 2.8125;
 	else
 		x = 1;
 
@@ -241,22 +350,22 @@ int getSurfPos(const union AdsbFrame *frame, double rlat, double rlng,
 	//different knot increments, starting from increments of 0.125kt
 	//and ending at 5kt increments between MOV values
 	//MOV = 0, [125,127] are invalid values
-	if(frame->me.sp.mov != 0 && frame->me.sp.mov < 125)
+	if(mov != 0 && mov < 125)
 	{
-		if(frame->me.sp.mov == 1)
+		if(mov == 1)
 			*spd = 0.;
-		else if(frame->me.sp.mov < 9)
-			*spd = (double)frame->me.sp.mov * 0.125 - 0.125;
-		else if(frame->me.sp.mov < 13)
-			*spd = (double)frame->me.sp.mov * 0.25 - 1.25;
-		else if(frame->me.sp.mov < 39)
-			*spd = (double)frame->me.sp.mov * 0.5 - 4.5;
-		else if(frame->me.sp.mov < 94)
-			*spd = (double)frame->me.sp.mov - 24.;
-		else if(frame->me.sp.mov < 109)
-			*spd = (double)frame->me.sp.mov * 2 - 118.;
+		else if(mov < 9)
+			*spd = (double)mov * 0.125 - 0.125;
+		else if(mov < 13)
+			*spd = (double)mov * 0.25 - 1.25;
+		else if(mov < 39)
+			*spd = (double)mov * 0.5 - 4.5;
+		else if(mov < 94)
+			*spd = (double)mov - 24.;
+		else if(mov < 109)
+			*spd = (double)mov * 2 - 118.;
 		else
-			*spd = (double)frame->me.sp.mov * 5 - 445.;
+			*spd = (double)mov * 5 - 445.;
 	}
 	else
 		x += 2;
@@ -269,25 +378,25 @@ int getSurfPos(const union AdsbFrame *frame, double rlat, double rlng,
 int getAirVel(const union AdsbFrame *frame, double *trk, double *spd, int *vr)
 {
 	int x = 0;
-	int vew, vsn;
-	if(frame->me.avg.tc != 19)
+	int vew, vsn, st = (int)adsbAvSt(frame);
+	if(adsbTc(frame) != 19)
 		return -1;
 
-	if(frame->me.avg.st == 1 || frame->me.avg.st == 2)
+	if(st == 1 || st == 2)
 	{
-		if(frame->me.avg.vew == 0 || frame->me.avg.vns == 0)
+		if(adsbAvVew(frame) == 0 || adsbAvVns(frame) == 0)
 		{
 			x = 10;
 			goto INVALID_VEL;	//velocities invalid if 0
 		}
 
-		vew = (int)frame->me.avg.vew - 1;
-		if(frame->me.avg.dew)
+		vew = (int)adsbAvVew(frame) - 1;
+		if(adsbAvDew(frame))
 			vew *= -1;
-		vsn = (int)frame->me.avg.vns - 1;
-		if(frame->me.avg.dns)
+		vsn = (int)adsbAvVns(frame) - 1;
+		if(adsbAvDns(frame))
 			vsn *= -1;
-		if(frame->me.avg.st == 2)	//supersonic - very rare
+		if(st == 2)	//supersonic - very rare
 		{
 			vew *= 4;
 			vsn *= 4;
@@ -300,21 +409,21 @@ int getAirVel(const union AdsbFrame *frame, double *trk, double *spd, int *vr)
 		if(*trk < 0)
 			*trk += 360;	//atan2 returns val between -pi and pi
 	}
-	else if(frame->me.ava.st == 3 || frame->me.ava.st == 4)
+	else if(st == 3 || st == 4)
 	{
-		if(frame->me.ava.t)
+		if(adsbAvT(frame))
 			x = 2;		//TAS
 		else
 			x = 1;		//IAS
 
-		if(frame->me.ava.as == 0)
+		if(adsbAvAs(frame) == 0)
 			x += 10;
-		*spd = (double)frame->me.ava.as - 1.;
-		if(frame->me.ava.st == 4)	//supersonic
+		*spd = (double)adsbAvAs(frame) - 1.;
+		if(st == 4)	//supersonic
 			*spd *= 4.;
 
-		if(frame->me.ava.sh)
-			*trk = (double)frame->me.ava.hdg * (360. / 1024.);
+		if(adsbAvSh(frame))
+			*trk = (double)adsbAvHdg(frame) * (360. / 1024.);
 		else
 			x += 2;
 	}
@@ -323,10 +432,10 @@ int getAirVel(const union AdsbFrame *frame, double *trk, double *spd, int *vr)
 				//most likely corrupted frame
 	INVALID_VEL:
 
-	if(frame->me.avg.vr)
+	if(adsbAvVr(frame))
 	{
-		*vr = ((int)frame->me.avg.vr - 1) * 64;
-		if(frame->me.avg.svr)
+		*vr = ((int)adsbAvVr(frame) - 1) * 64;
+		if(adsbAvSvr(frame))
 			*vr = *vr * -1;
 	}
 	else
@@ -336,3 +445,160 @@ int getAirVel(const union AdsbFrame *frame, double *trk, double *spd, int *vr)
 
 	return x;
 }
+
+enum MessageKind messageKind(int tc)
+{
+	if(tc >= 1 && tc <= 4)
+		return KIND_IDENT;
+	if(tc >= 5 && tc <= 8)
+		return KIND_SURFACE;
+	if((tc >= 9 && tc <= 18) || (tc >= 20 && tc <= 22))
+		return KIND_AIRBORNE;
+	if(tc == 19)
+		return KIND_VELOCITY;
+	return KIND_OTHER;
+}
+
+int decodeEvent(const union AdsbFrame *frame, double rlat, double rlng,
+	struct AdsbEvent *ev)
+{
+	register enum PlaneFlags fl;
+	int df = (int)adsbDf(frame);
+
+	if((df != 17 && df != 18) ||	//ADS-B & TIS-B messages
+		crcSyndrome(frame) != 0)
+		return -1;
+
+	ev->icao = (int)adsbIcao(frame);
+	ev->tc = (int)adsbTc(frame);
+
+	switch(ev->tc)
+	{
+	case 1: case 2: case 3: case 4:
+		getIdent(frame, &ev->call, &ev->cat);
+		fl = ICAOFL | IDENTVALID;
+		break;
+
+	case 5: case 6: case 7: case 8:
+		fl = ICAOFL | POSVALID | TRKVALID | SPDVALID;
+		switch(getSurfPos(frame, rlat, rlng, &ev->trk, &ev->spd,
+			&ev->lat, &ev->lng))
+		{
+		case 3:
+			fl -= TRKVALID;
+		case 2:
+			fl -= SPDVALID;
+			break;
+		case 1:
+			fl -= TRKVALID;
+		}
+		break;
+
+	case 9: case 10: case 11: case 12: case 13: case 14:
+	case 15: case 16: case 17: case 18: case 20: case 21:
+	case 22:
+		fl = ICAOFL | POSVALID | ALTVALID;
+		switch(getAirPos(frame, rlat, rlng,
+			&ev->alt, &ev->lat, &ev->lng))
+		{
+		case 1:
+			fl -= ALTVALID;
+		}
+		break;
+
+	case 19:
+		fl = ICAOFL | TRKVALID | SPDVALID | VERTVALID;
+		switch(getAirVel(frame, &ev->trk, &ev->spd, &ev->vert))
+		{
+			case 0:
+				break;
+			case 10:
+				fl -= TRKVALID;
+				fl -= SPDVALID;
+				break;
+			case 14:
+			case 13:
+				fl -= TRKVALID;
+			case 12:
+			case 11:
+				fl |= ICAOFL;
+				fl -= SPDVALID;
+				break;
+			case 15:
+				fl = ICAOFL;
+				break;
+			case 9:
+			case 8:
+				fl -= TRKVALID;
+			case 7:
+			case 6:
+				fl |= ICAOFL;
+			case 5:
+				fl -= VERTVALID;
+				break;
+			case 19:
+			case 18:
+				fl -= TRKVALID;
+			case 17:
+			case 16:
+				fl -= SPDVALID;
+				fl -= VERTVALID;
+				fl |= IASFL;
+				break;
+			case 3:
+			case 4:
+				fl -= TRKVALID;
+			case 1:
+			case 2:
+				fl |= IASFL;
+			default:
+				fl = 0;
+				break;
+		}
+		break;
+
+	//TODO: possible future handling of aircraft status
+	default:
+		fl = 0;
+	}
+
+	ev->fl = fl;
+	return 0;
+}
+
+/*
+	hexTable
+	Value of each hex digit char plus 1, 0 for anything that isn't one.
+*/
+static const signed char hexTable[256] =
+{
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16
+};	//stored off by one so the rest of the table can be 0
+
+int parseHexFrame(const char *line, size_t len, union AdsbFrame *frame)
+{
+	size_t i = 0;
+	int b, hi, lo;
+
+	while(i < len && (line[i] == ' ' || line[i] == '\t' ||
+		line[i] == '\r' || line[i] == '\n'))
+		i++;
+	//'*' + 28 hex chars + ';'
+	if(len - i < 30 || line[i] != '*' || line[i + 29] != ';')
+		return -1;
+	i++;
+
+	for(b = 0;b < 14;b++)
+	{
+		hi = hexTable[(unsigned char)line[i++]];
+		lo = hexTable[(unsigned char)line[i++]];
+		if(hi == 0 || lo == 0)
+			return -1;
+		frame->frame[b] = (uint8_t)((hi - 1) << 4 | (lo - 1));
+	}
+
+	return (int)i + 1;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <stddef.h>
 #include "adsb.h"
 
 /*
@@ -15,6 +16,39 @@
 	for most functions, -1 indicates that the type code is not correct.
 */
 
+/*
+	enum PlaneFlags
+	I created this enum to make it very easy to log plane data.
+	I can call log and submit every local plane value, even if invalid.
+	The function will only update those with valid flags.
+
+	Then the function will make Plane.pflags |= flags.
+
+	When a new plane replaces and old one the pflags are wiped and
+	we don't need to wipe all the data values.
+	Only reason calloc is used in main is so I don't have to individually
+	wipe pflags at start.
+*/
+enum PlaneFlags {ICAOFL=1, IDENTVALID=2, POSVALID=4, TRKVALID=8,
+	SPDVALID=16, ALTVALID=32, VERTVALID=64, IASFL=128, BARFL=256};
+
+/*
+	AdsbEvent
+	Everything logPlane needs from one decoded frame.
+	Only the values with their flag set in fl are valid,
+	the rest are left untouched by decodeEvent.
+*/
+struct AdsbEvent
+{
+	int icao;
+	int tc;
+	uint64_t call;		//packed, see expandCall
+	uint8_t cat;		//see planeType
+	double lat, lng, trk, spd;
+	int alt, vert;
+	enum PlaneFlags fl;
+};
+
 /*
 	parityCheck
 	Returns a 0 if there are no problems with the ADS-B frame,
@@ -24,18 +58,83 @@
 	Keep in mind, the "parity" is a CRC remainder,
 	and this function is actually a CRC computation.
 
-	TODO: Possibly use SSE/AVX and AArch64 equivalent for computing
-	CRC faster. Or possibility of using lookup tables and other means
-	of computing CRC faster.
+	Goes bit by bit, it is kept as the reference crcSyndrome is
+	tested against. Decoding uses crcSyndrome.
 */
 int parityCheck(const union AdsbFrame *frame);
 
+/*
+	computeCrc
+	Returns the 24 bit CRC of the first 88 bits of the frame,
+	what the parity field (the last 24 bits) should be for DF 17/18.
+	Used to make frames, decoding only needs crcSyndrome.
+*/
+uint32_t computeCrc(const union AdsbFrame *frame);
+
+/*
+	crcSyndrome
+	Returns 0 if the frame passes the parity check, otherwise the
+	24 bit remainder of the CRC over the data XOR the parity field.
+	Table driven, one lookup per byte instead of a step per bit.
+
+	The CRC is linear, so flipping bit i of the frame (0 is the first
+	bit sent) XORs the syndrome with bitSyndrome(i). That lets a
+	failed frame be tested with some bits flipped without
+	recomputing the whole CRC.
+*/
+uint32_t crcSyndrome(const union AdsbFrame *frame);
+
+/*
+	bitSyndrome
+	Returns the syndrome change from flipping bit (0-111) of a frame.
+*/
+uint32_t bitSyndrome(int bit);
+
+/*
+	cprNL
+	Returns the number of longitude zones at a latitude (the NL function),
+	1 to 59. Same result as the trig formula in the CPR spec,
+	but from a table of the latitudes where it changes.
+*/
+int cprNL(double lat);
+
 /*
 	getIdent
 	Returns 0 if no errors
-	Gets call sign and aircraft type
+	Gets call sign, left packed as the frame has it (eight 6 bit
+	chars, the first in the top bits of 48), and aircraft category,
+	tc * 8 + category. Use expandCall and planeType to print them.
 */
-int getIdent(const union AdsbFrame *frame, char call[9], char type[8]);
+int getIdent(const union AdsbFrame *frame, uint64_t *call, uint8_t *cat);
+
+/*
+	expandCall
+	Returns the length of the call sign without its trailing spaces.
+	Writes the 8 chars of a packed call sign and a null to text.
+*/
+int expandCall(uint64_t call, char text[9]);
+
+/*
+	packCall
+	Returns how many chars of text were packed, or -1 if one of them
+	can't be in a call sign (only A-Z, 0-9 and space can).
+	Packs up to 8 chars of text, padded with spaces like a frame.
+*/
+int packCall(const char *text, uint64_t *call);
+
+/*
+	planeType
+	Returns the name of an aircraft category from getIdent,
+	"UNOWEN" if it is reserved or has none.
+*/
+const char *planeType(int cat);
+
+/*
+	planeCategory
+	Returns the first aircraft category named type by planeType,
+	0 if there is none.
+*/
+int planeCategory(const char *type);
 
 /*
 	getAirPos
@@ -108,3 +207,44 @@ int getSurfPos(const union AdsbFrame *frame, double rlat, double rlng,
 	Currently no altitude difference is reported.
 */
 int getAirVel(const union AdsbFrame *frame, double *trk, double *spd, int *vr);
+
+/*
+	decodeEvent
+	Returns 0 if the frame is an uncorrupted ADS-B or TIS-B frame (DF 17/18).
+	Returns -1 otherwise, and the event is not filled in.
+
+	Runs the parity check and the get* function for the type code,
+	and turns their return codes into PlaneFlags.
+	A frame that passes but has nothing loggable (status reports)
+	returns 0 with ev->fl == 0.
+
+	Doesn't touch any globals, so it is safe to call from several threads.
+*/
+int decodeEvent(const union AdsbFrame *frame, double rlat, double rlng,
+	struct AdsbEvent *ev);
+
+/*
+	messageKind
+	Returns what a message with type code tc carries, the kinds
+	libadsb and the plane stats sort messages into.
+*/
+enum MessageKind {KIND_IDENT, KIND_SURFACE, KIND_AIRBORNE, KIND_VELOCITY,
+	KIND_OTHER, KIND_COUNT};
+enum MessageKind messageKind(int tc);
+
+/*
+	parseHexFrame
+	Parses one "*<28 hex chars>;" message from a line of text.
+	len is the amount of chars available at line, which doesn't need
+	to be null terminated.
+	Leading whitespace is skipped.
+
+	Returns the amount of chars consumed (up to and including the ';')
+	if a 112 bit frame was read.
+	Returns -1 if the line isn't a long frame (short 56 bit frames,
+	garbage, or the line is cut off), nothing is consumed in that case.
+
+	This is what fscanf does in the -p loop, but with a lookup table
+	so it is fast enough for bulk decoding.
+*/
+int parseHexFrame(const char *line, size_t len, union AdsbFrame *frame);
@@ -0,0 +1,779 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL
+#endif
+
+#include "demod.h"
+#include "decode.h"
+
+#define DEFTHRESHOLD 40		//preamble level until the noise is known
+#define MINTHRESHOLD 16		//lowest the threshold goes with no noise
+#define DEFSNR 48		//threshold is 3x the noise floor
+#define NOISEBINS 1024		//histogram bins 4 magnitudes wide
+#define NOISESTEP 4		//samples skipped between histogram samples
+#define MAGPAD 32		//extra magnitudes so vector loads can overrun
+#define DEFREPAIR 16		//default repair budget, single flips only
+#define REPAIRBITS 16		//weakest bits considered for repair
+#define PHASES 5		//phases tried per sample above DEMOD_RATE
+
+/*
+	Scalar kernels
+	These are the reference, the vector kernels have to match them.
+*/
+static void computeMagScalar(const uint8_t *iq, uint16_t *m, size_t n)
+{
+	size_t j;
+	int x, y;
+	for(j = 0;j < n;j++)
+	{
+		x = 2 * iq[2*j] - 255;
+		y = 2 * iq[2*j + 1] - 255;
+		m[j] = (uint16_t)((x*x + y*y) >> 3);
+	}
+	return;
+}
+
+/*
+	isPreamble
+	Pulses at 0, 2, 7 and 9 have to be peaks compared to their
+	neighbours, and the gaps inside (4, 5) and after the preamble
+	(11-14) have to be under 2/3 of the pulse level.
+	Pulse level is the rounded average of the 4 pulses, done as
+	an average of averages so it is the same as the vector average ops.
+*/
+static inline int isPreamble(const uint16_t *m, uint16_t threshold)
+{
+	int mean;
+	if(!(m[0] > m[1] && m[2] > m[1] && m[2] > m[3] && m[0] > m[3] &&
+		m[0] > m[4] && m[0] > m[5] && m[0] > m[6] && m[7] > m[8] &&
+		m[9] > m[8] && m[9] > m[6]))
+		return 0;
+	mean = (((m[0] + m[2] + 1) >> 1) + ((m[7] + m[9] + 1) >> 1) + 1) >> 1;
+	return mean > threshold &&
+		mean > m[4] + (m[4] >> 1) && mean > m[5] + (m[5] >> 1) &&
+		mean > m[11] + (m[11] >> 1) && mean > m[12] + (m[12] >> 1) &&
+		mean > m[13] + (m[13] >> 1) && mean > m[14] + (m[14] >> 1);
+}
+
+static size_t findPreamblesScalar(const uint16_t *m, size_t start, size_t n,
+	uint16_t threshold, uint32_t *out)
+{
+	size_t j, cnt = 0;
+	for(j = start;j < n;j++)
+		if(isPreamble(m + j, threshold))
+			out[cnt++] = (uint32_t)j;
+	return cnt;
+}
+
+//data bits start after the preamble, a 1 is a high chip then a low one
+static void sliceBitsScalar(const uint16_t *m, uint8_t out[14])
+{
+	int i;
+	memset(out, 0, 14);
+	m += DEMOD_PREAMBLE;
+	for(i = 0;i < DEMOD_BITS;i++)
+		if(m[2*i] > m[2*i + 1])
+			out[i >> 3] |= (uint8_t)(0x80 >> (i & 7));
+	return;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/*
+	AVX2 kernels
+	Compiled with the target attribute so the rest of the program
+	doesn't need -mavx2, and only used if the CPU says it has AVX2.
+*/
+__attribute__((target("avx2")))
+static void computeMagAvx2(const uint8_t *iq, uint16_t *m, size_t n)
+{
+	size_t j;
+	__m256i raw, lo, hi, k255 = _mm256_set1_epi16(255);
+
+	for(j = 0;j + 16 <= n;j += 16)
+	{
+		//16 samples, 32 bytes
+		raw = _mm256_loadu_si256((const __m256i*)(iq + 2*j));
+		lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(raw));
+		hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(raw, 1));
+		lo = _mm256_sub_epi16(_mm256_add_epi16(lo, lo), k255);
+		hi = _mm256_sub_epi16(_mm256_add_epi16(hi, hi), k255);
+		//madd of I,Q pairs with themselves is I*I + Q*Q
+		lo = _mm256_srai_epi32(_mm256_madd_epi16(lo, lo), 3);
+		hi = _mm256_srai_epi32(_mm256_madd_epi16(hi, hi), 3);
+		//packs works inside 128 bit lanes, permute puts them in order
+		lo = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+		_mm256_storeu_si256((__m256i*)(m + j), lo);
+	}
+	computeMagScalar(iq + 2*j, m + j, n - j);
+	return;
+}
+
+__attribute__((target("avx2")))
+static size_t findPreamblesAvx2(const uint16_t *m, size_t n,
+	uint16_t threshold, uint32_t *out)
+{
+	size_t j, cnt = 0;
+	unsigned int mask;
+	__m256i m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, q, mean, ok;
+	//compared unsigned, a threshold over 32767 would be negative
+	__m256i thr = _mm256_set1_epi16((short)threshold);
+
+#define LOADM(k) _mm256_loadu_si256((const __m256i*)(m + j + (k)))
+#define GT(a, b) _mm256_cmpgt_epi16(a, b)
+#define QUIET(k) (q = LOADM(k), \
+	GT(mean, _mm256_add_epi16(q, _mm256_srli_epi16(q, 1))))
+
+	//lane i tests the preamble starting at m[j + i]
+	for(j = 0;j + 16 <= n;j += 16)
+	{
+		m0 = LOADM(0); m1 = LOADM(1); m2 = LOADM(2); m3 = LOADM(3);
+		m4 = LOADM(4); m5 = LOADM(5); m6 = LOADM(6); m7 = LOADM(7);
+		m8 = LOADM(8); m9 = LOADM(9);
+
+		ok = _mm256_and_si256(GT(m0, m1), GT(m2, m1));
+		ok = _mm256_and_si256(ok, _mm256_and_si256(GT(m2, m3), GT(m0, m3)));
+		ok = _mm256_and_si256(ok, _mm256_and_si256(GT(m0, m4), GT(m0, m5)));
+		ok = _mm256_and_si256(ok, _mm256_and_si256(GT(m0, m6), GT(m7, m8)));
+		ok = _mm256_and_si256(ok, _mm256_and_si256(GT(m9, m8), GT(m9, m6)));
+		//most positions fail the shape, skip the rest for them
+		if(_mm256_testz_si256(ok, ok))
+			continue;
+
+		mean = _mm256_avg_epu16(_mm256_avg_epu16(m0, m2),
+			_mm256_avg_epu16(m7, m9));
+		ok = _mm256_andnot_si256(_mm256_cmpeq_epi16(
+			_mm256_max_epu16(mean, thr), thr), ok);
+		ok = _mm256_and_si256(ok, QUIET(4));
+		ok = _mm256_and_si256(ok, QUIET(5));
+		ok = _mm256_and_si256(ok, QUIET(11));
+		ok = _mm256_and_si256(ok, QUIET(12));
+		ok = _mm256_and_si256(ok, QUIET(13));
+		ok = _mm256_and_si256(ok, QUIET(14));
+
+		//two mask bits per 16 bit lane
+		mask = (unsigned int)_mm256_movemask_epi8(ok) & 0x55555555u;
+		while(mask)
+		{
+			out[cnt++] = (uint32_t)(j + (__builtin_ctz(mask) >> 1));
+			mask &= mask - 1;
+		}
+	}
+#undef LOADM
+#undef GT
+#undef QUIET
+	return cnt + findPreamblesScalar(m, j, n, threshold, out + cnt);
+}
+
+/*
+	sliceBitsAvx2
+	Loading 16 magnitudes as 8 32 bit lanes puts each bit's
+	first chip in the low half and second chip in the high half,
+	so madd with (1, -1) gives first - second for 8 bits at once.
+*/
+__attribute__((target("avx2")))
+static void sliceBitsAvx2(const uint16_t *m, uint8_t out[14])
+{
+	__m256i v, ones = _mm256_set1_epi32(0xFFFF0001), zero = _mm256_setzero_si256();
+	unsigned int mask;
+	int b;
+
+	m += DEMOD_PREAMBLE;
+	for(b = 0;b < 14;b++)
+	{
+		v = _mm256_loadu_si256((const __m256i*)(m + 16*b));
+		v = _mm256_cmpgt_epi32(_mm256_madd_epi16(v, ones), zero);
+		mask = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(v));
+		//first bit is the lowest mask bit, but goes in the MSB
+		out[b] = (uint8_t)(((mask * 0x0202020202ull) & 0x010884422010ull)
+			% 1023);
+	}
+	return;
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+/*
+	NEON kernels
+	Same as the AVX2 ones but 8 lanes per vector,
+	the preamble search does 2 vectors (16 positions) per loop.
+*/
+static void computeMagNeon(const uint8_t *iq, uint16_t *m, size_t n)
+{
+	size_t j;
+	uint8x16x2_t raw;
+	int16x8_t ilo, ihi, qlo, qhi, k255 = vdupq_n_s16(255);
+	int32x4_t a, b, c, d;
+
+	for(j = 0;j + 16 <= n;j += 16)
+	{
+		raw = vld2q_u8(iq + 2*j);	//val[0] is I, val[1] is Q
+		ilo = vsubq_s16(vreinterpretq_s16_u16(
+			vshll_n_u8(vget_low_u8(raw.val[0]), 1)), k255);
+		ihi = vsubq_s16(vreinterpretq_s16_u16(
+			vshll_n_u8(vget_high_u8(raw.val[0]), 1)), k255);
+		qlo = vsubq_s16(vreinterpretq_s16_u16(
+			vshll_n_u8(vget_low_u8(raw.val[1]), 1)), k255);
+		qhi = vsubq_s16(vreinterpretq_s16_u16(
+			vshll_n_u8(vget_high_u8(raw.val[1]), 1)), k255);
+
+		a = vmlal_s16(vmull_s16(vget_low_s16(ilo), vget_low_s16(ilo)),
+			vget_low_s16(qlo), vget_low_s16(qlo));
+		b = vmlal_s16(vmull_s16(vget_high_s16(ilo), vget_high_s16(ilo)),
+			vget_high_s16(qlo), vget_high_s16(qlo));
+		c = vmlal_s16(vmull_s16(vget_low_s16(ihi), vget_low_s16(ihi)),
+			vget_low_s16(qhi), vget_low_s16(qhi));
+		d = vmlal_s16(vmull_s16(vget_high_s16(ihi), vget_high_s16(ihi)),
+			vget_high_s16(qhi), vget_high_s16(qhi));
+
+		vst1q_u16(m + j, vcombine_u16(
+			vmovn_u32(vreinterpretq_u32_s32(vshrq_n_s32(a, 3))),
+			vmovn_u32(vreinterpretq_u32_s32(vshrq_n_s32(b, 3)))));
+		vst1q_u16(m + j + 8, vcombine_u16(
+			vmovn_u32(vreinterpretq_u32_s32(vshrq_n_s32(c, 3))),
+			vmovn_u32(vreinterpretq_u32_s32(vshrq_n_s32(d, 3)))));
+	}
+	computeMagScalar(iq + 2*j, m + j, n - j);
+	return;
+}
+
+//8 lanes of the preamble test starting at m
+static inline uint16x8_t preambleNeon(const uint16_t *m, uint16x8_t thr)
+{
+	uint16x8_t m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, q, mean, ok;
+
+#define QUIET(k) (q = vld1q_u16(m + (k)), vcgtq_u16(mean, vsraq_n_u16(q, q, 1)))
+	m0 = vld1q_u16(m); m1 = vld1q_u16(m + 1); m2 = vld1q_u16(m + 2);
+	m3 = vld1q_u16(m + 3); m4 = vld1q_u16(m + 4); m5 = vld1q_u16(m + 5);
+	m6 = vld1q_u16(m + 6); m7 = vld1q_u16(m + 7); m8 = vld1q_u16(m + 8);
+	m9 = vld1q_u16(m + 9);
+
+	ok = vandq_u16(vcgtq_u16(m0, m1), vcgtq_u16(m2, m1));
+	ok = vandq_u16(ok, vandq_u16(vcgtq_u16(m2, m3), vcgtq_u16(m0, m3)));
+	ok = vandq_u16(ok, vandq_u16(vcgtq_u16(m0, m4), vcgtq_u16(m0, m5)));
+	ok = vandq_u16(ok, vandq_u16(vcgtq_u16(m0, m6), vcgtq_u16(m7, m8)));
+	ok = vandq_u16(ok, vandq_u16(vcgtq_u16(m9, m8), vcgtq_u16(m9, m6)));
+
+	//vrhadd is the same rounding average as _mm256_avg_epu16
+	mean = vrhaddq_u16(vrhaddq_u16(m0, m2), vrhaddq_u16(m7, m9));
+	ok = vandq_u16(ok, vcgtq_u16(mean, thr));
+	ok = vandq_u16(ok, QUIET(4));
+	ok = vandq_u16(ok, QUIET(5));
+	ok = vandq_u16(ok, QUIET(11));
+	ok = vandq_u16(ok, QUIET(12));
+	ok = vandq_u16(ok, QUIET(13));
+	ok = vandq_u16(ok, QUIET(14));
+#undef QUIET
+	return ok;
+}
+
+//8 lanes of all ones or zeros to 8 bits, weights decide the bit order
+static inline unsigned int laneBits(uint16x8_t v, uint8x8_t weights)
+{
+	uint8x8_t b = vand_u8(vmovn_u16(v), weights);
+	b = vpadd_u8(b, b);
+	b = vpadd_u8(b, b);
+	b = vpadd_u8(b, b);
+	return vget_lane_u8(b, 0);
+}
+
+static size_t findPreamblesNeon(const uint16_t *m, size_t n,
+	uint16_t threshold, uint32_t *out)
+{
+	static const uint8_t w[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+	uint8x8_t weights = vld1_u8(w);
+	uint16x8_t thr = vdupq_n_u16(threshold);
+	size_t j, cnt = 0;
+	unsigned int mask;
+
+	for(j = 0;j + 16 <= n;j += 16)
+	{
+		mask = laneBits(preambleNeon(m + j, thr), weights) |
+			laneBits(preambleNeon(m + j + 8, thr), weights) << 8;
+		while(mask)
+		{
+			out[cnt++] = (uint32_t)(j + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+	return cnt + findPreamblesScalar(m, j, n, threshold, out + cnt);
+}
+
+//vld2 splits each bit's first and second chips into two vectors
+static void sliceBitsNeon(const uint16_t *m, uint8_t out[14])
+{
+	static const uint8_t w[8] = {128, 64, 32, 16, 8, 4, 2, 1};
+	uint8x8_t weights = vld1_u8(w);
+	uint16x8x2_t v;
+	int b;
+
+	m += DEMOD_PREAMBLE;
+	for(b = 0;b < 14;b++)
+	{
+		v = vld2q_u16(m + 16*b);
+		out[b] = (uint8_t)laneBits(vcgtq_u16(v.val[0], v.val[1]), weights);
+	}
+	return;
+}
+#endif
+
+static inline void flipBit(union AdsbFrame *frame, int bit)
+{
+	frame->frame[bit >> 3] ^= (uint8_t)(0x80 >> (bit & 7));
+	return;
+}
+
+/*
+	chipConfidence
+	Confidence is only needed for frames that failed, so it isn't
+	worked out in the slicers but from the magnitudes afterwards.
+*/
+static void chipConfidence(const uint16_t *m, uint32_t conf[DEMOD_BITS])
+{
+	int i;
+	m += DEMOD_PREAMBLE;
+	for(i = 0;i < DEMOD_BITS;i++)
+		conf[i] = (uint32_t)abs((int)m[2*i] - (int)m[2*i + 1]);
+	return;
+}
+
+int repairFrame(const uint32_t conf[DEMOD_BITS], union AdsbFrame *frame,
+	int budget)
+{
+	uint32_t low[REPAIRBITS];
+	uint8_t weak[REPAIRBITS];
+	uint32_t synd = crcSyndrome(frame);
+	int i, k, n = 0, tries = 0;
+
+	//insertion sort keeps the weakest bits
+	for(i = 5;i < DEMOD_BITS;i++)
+	{
+		if(n == REPAIRBITS && conf[i] >= low[n - 1])
+			continue;
+		k = n < REPAIRBITS ? n++ : n - 1;
+		for(;k > 0 && low[k - 1] > conf[i];k--)
+		{
+			low[k] = low[k - 1];
+			weak[k] = weak[k - 1];
+		}
+		low[k] = conf[i];
+		weak[k] = (uint8_t)i;
+	}
+
+	//single flips weakest first, then pairs of the weakest bits
+	for(i = 0;i < n && tries < budget;i++, tries++)
+		if(bitSyndrome(weak[i]) == synd)
+		{
+			flipBit(frame, weak[i]);
+			return 1;
+		}
+	for(k = 1;k < n;k++)
+		for(i = 0;i < k && tries < budget;i++, tries++)
+			if((bitSyndrome(weak[i]) ^ bitSyndrome(weak[k])) == synd)
+			{
+				flipBit(frame, weak[i]);
+				flipBit(frame, weak[k]);
+				return 2;
+			}
+	return 0;
+}
+
+void computeMag(enum DemodKernel k, const uint8_t *iq, uint16_t *m, size_t n)
+{
+	switch(k)
+	{
+#ifdef HAVE_AVX2_KERNEL
+	case DEMOD_AVX2:
+		computeMagAvx2(iq, m, n);
+		return;
+#endif
+#ifdef HAVE_NEON_KERNEL
+	case DEMOD_NEON:
+		computeMagNeon(iq, m, n);
+		return;
+#endif
+	default:
+		computeMagScalar(iq, m, n);
+	}
+	return;
+}
+
+size_t findPreambles(enum DemodKernel k, const uint16_t *m, size_t n,
+	uint16_t threshold, uint32_t *out)
+{
+	switch(k)
+	{
+#ifdef HAVE_AVX2_KERNEL
+	case DEMOD_AVX2:
+		return findPreamblesAvx2(m, n, threshold, out);
+#endif
+#ifdef HAVE_NEON_KERNEL
+	case DEMOD_NEON:
+		return findPreamblesNeon(m, n, threshold, out);
+#endif
+	default:
+		return findPreamblesScalar(m, 0, n, threshold, out);
+	}
+}
+
+void sliceBits(enum DemodKernel k, const uint16_t *m, uint8_t out[14])
+{
+	switch(k)
+	{
+#ifdef HAVE_AVX2_KERNEL
+	case DEMOD_AVX2:
+		sliceBitsAvx2(m, out);
+		return;
+#endif
+#ifdef HAVE_NEON_KERNEL
+	case DEMOD_NEON:
+		sliceBitsNeon(m, out);
+		return;
+#endif
+	default:
+		sliceBitsScalar(m, out);
+	}
+	return;
+}
+
+int setDemodKernel(struct Demod *d, enum DemodKernel k)
+{
+	switch(k)
+	{
+	case DEMOD_SCALAR:
+		break;
+#ifdef HAVE_AVX2_KERNEL
+	case DEMOD_AVX2:
+		if(!__builtin_cpu_supports("avx2"))
+			return -1;
+		break;
+#endif
+#ifdef HAVE_NEON_KERNEL
+	case DEMOD_NEON:
+		break;
+#endif
+	default:
+		return -1;
+	}
+	d->kernel = k;
+	return 0;
+}
+
+int setDemodRate(struct Demod *d, unsigned int rate)
+{
+	if(rate < DEMOD_RATE || rate > DEMOD_MAXRATE)
+		return -1;
+	if(rate != DEMOD_RATE && d->sum == NULL)
+	{
+		d->sum = malloc(sizeof(uint64_t) *
+			(DEMOD_BLOCK + DEMOD_MAXFRAMELEN + 1));
+		if(d->sum == NULL)
+			return -1;
+	}
+	d->rate = rate;
+	d->chipLen = (uint32_t)((((uint64_t)rate << 16) + DEMOD_RATE / 2) /
+		DEMOD_RATE);
+	//room for the last phase and the partial samples at each end
+	d->framelen = rate == DEMOD_RATE ? DEMOD_FRAMELEN :
+		(size_t)(((uint64_t)d->chipLen * DEMOD_FRAMELEN) >> 16) + 3;
+	return 0;
+}
+
+int initDemod(struct Demod *d)
+{
+	memset(d, 0, sizeof(*d));
+	d->mag = malloc(sizeof(uint16_t) *
+		(DEMOD_BLOCK + DEMOD_MAXFRAMELEN + MAGPAD));
+	d->cand = malloc(sizeof(uint32_t) * (DEMOD_BLOCK + DEMOD_MAXFRAMELEN));
+	if(d->mag == NULL || d->cand == NULL)
+	{
+		freeDemod(d);
+		return -1;
+	}
+	//the padding is only read by vector loads past the end,
+	//zero it so those reads are at least defined
+	memset(d->mag, 0, sizeof(uint16_t) *
+		(DEMOD_BLOCK + DEMOD_MAXFRAMELEN + MAGPAD));
+	d->threshold = DEFTHRESHOLD;
+	d->snr = DEFSNR;
+	d->repair = DEFREPAIR;
+	setDemodRate(d, DEMOD_RATE);
+
+	//fastest kernel that works here
+	if(setDemodKernel(d, DEMOD_AVX2) && setDemodKernel(d, DEMOD_NEON))
+		d->kernel = DEMOD_SCALAR;
+	return 0;
+}
+
+/*
+	trackNoise
+	Frames are a small part of the samples even on a busy band,
+	so the median magnitude of a block is noise. For noise alone the
+	magnitudes are exponentially distributed, so the mean is
+	median / ln 2. Each block is averaged in with 1/8 weight, and
+	the preamble threshold is set from the result.
+*/
+static void trackNoise(struct Demod *d, const uint16_t *m, size_t n)
+{
+	uint32_t hist[NOISEBINS];
+	size_t j, cum, half;
+	unsigned int bin, level, t;
+
+	if(n < NOISEBINS * NOISESTEP)
+		return;
+	memset(hist, 0, sizeof(hist));
+	for(j = 0;j < n;j += NOISESTEP)
+		hist[m[j] >> 2 < NOISEBINS ? m[j] >> 2 : NOISEBINS - 1]++;
+	half = (n + NOISESTEP - 1) / NOISESTEP / 2;
+	for(bin = 0, cum = 0;bin < NOISEBINS - 1;bin++)
+	{
+		cum += hist[bin];
+		if(cum > half)
+			break;
+	}
+	//middle of the bin, times 1/ln 2 (185/128)
+	level = ((bin * 4 + 2) * 185) >> 7;
+
+	if(d->noise == 0)	//first block
+		d->noise = (uint16_t)level;
+	else
+		d->noise = (uint16_t)((int)d->noise + ((int)level - (int)d->noise) / 8);
+	t = (d->noise * (unsigned int)d->snr) >> 4;
+	d->threshold = (uint16_t)(t < MINTHRESHOLD ? MINTHRESHOLD :
+		t > 0xFFFF ? 0xFFFF : t);
+	return;
+}
+
+//mean magnitude of the high chip of each bit after a preamble at m
+static uint16_t pulseLevel(const uint16_t *m)
+{
+	uint32_t sum = 0;
+	int b;
+	m += DEMOD_PREAMBLE;
+	for(b = 0;b < DEMOD_BITS;b++)
+		sum += m[2*b] > m[2*b + 1] ? m[2*b] : m[2*b + 1];
+	return (uint16_t)(sum / DEMOD_BITS);
+}
+
+//one sample per chip, the SIMD kernels do most of the work
+static int demodNative(struct Demod *d, size_t limit, DemodCallback cb,
+	void *arg)
+{
+	struct DemodFrame f;
+	uint8_t bits[14];
+	uint32_t conf[DEMOD_BITS];
+	size_t cnt, i;
+	uint32_t j;
+	int df, found = 0;
+
+	cnt = findPreambles(d->kernel, d->mag, limit, d->threshold, d->cand);
+	d->candidates += cnt;
+
+	for(i = 0;i < cnt;i++)
+	{
+		j = d->cand[i];
+		//pulses inside a frame that was already found
+		if(d->pos + j < d->skip)
+			continue;
+		sliceBits(d->kernel, d->mag + j, bits);
+		//only ADS-B and TIS-B frames get decoded anyway,
+		//so skip the parity check for anything else
+		df = bits[0] >> 3;
+		if(df != 17 && df != 18)
+			continue;
+		d->checked++;
+		memcpy(f.frame.frame, bits, 14);
+		if(crcSyndrome(&f.frame))
+		{
+			chipConfidence(d->mag + j, conf);
+			if(!repairFrame(conf, &f.frame, d->repair))
+				continue;
+			d->repaired++;
+		}
+
+		f.sample = d->pos + j;
+		f.level = pulseLevel(d->mag + j);
+		d->skip = f.sample + d->framelen;
+		d->frames++;
+		found++;
+		cb(&f, arg);
+	}
+	return found;
+}
+
+//integral of the magnitudes from sample 0 to x, x in 1/65536 samples
+static inline uint64_t magArea(const struct Demod *d, uint64_t x)
+{
+	return (d->sum[x >> 16] << 16) + (x & 0xFFFF) * d->mag[x >> 16];
+}
+
+//energy of n chips starting at chip first of a message starting at x
+static void chipEnergy(const struct Demod *d, uint64_t x, int first, int n,
+	uint64_t *e)
+{
+	uint64_t a, b;
+	int c;
+	x += (uint64_t)first * d->chipLen;
+	a = magArea(d, x);
+	for(c = 0;c < n;c++)
+	{
+		x += d->chipLen;
+		b = magArea(d, x);
+		e[c] = b - a;
+		a = b;
+	}
+	return;
+}
+
+//the isPreamble test on chip energies, thr is scaled to one chip
+static int isPreambleChips(const uint64_t *e, uint64_t thr)
+{
+	uint64_t mean;
+	if(!(e[0] > e[1] && e[2] > e[1] && e[2] > e[3] && e[0] > e[3] &&
+		e[0] > e[4] && e[0] > e[5] && e[0] > e[6] && e[7] > e[8] &&
+		e[9] > e[8] && e[9] > e[6]))
+		return 0;
+	mean = (e[0] + e[2] + e[7] + e[9]) >> 2;
+	return mean > thr &&
+		mean > e[4] + (e[4] >> 1) && mean > e[5] + (e[5] >> 1) &&
+		mean > e[11] + (e[11] >> 1) && mean > e[12] + (e[12] >> 1) &&
+		mean > e[13] + (e[13] >> 1) && mean > e[14] + (e[14] >> 1);
+}
+
+/*
+	demodOversampled
+	Every sample is tried as a start with PHASES sub-sample phases.
+	The first two pulses (halfway between phases) have to be over the
+	noise based threshold, which rules out most samples whatever the
+	phase is. For the rest the preamble phase with the most energy in
+	the pulses compared to the gaps is used to slice the bits.
+*/
+static int demodOversampled(struct Demod *d, size_t total, size_t limit,
+	DemodCallback cb, void *arg)
+{
+	struct DemodFrame f;
+	uint64_t e[2 * DEMOD_BITS], x, bestx, level;
+	uint64_t thr = (uint64_t)d->threshold * d->chipLen;
+	uint32_t conf[DEMOD_BITS];
+	int64_t score, best;
+	size_t j;
+	int p, b, df, found = 0;
+
+	d->sum[0] = 0;
+	for(j = 0;j < total;j++)
+		d->sum[j + 1] = d->sum[j] + d->mag[j];
+
+	for(j = 0;j < limit;j++)
+	{
+		if(d->pos + j < d->skip)
+			continue;
+		chipEnergy(d, ((uint64_t)j << 16) + 0x8000, 0, 3, e);
+		if(e[0] + e[2] <= thr)
+			continue;
+
+		best = -1;
+		bestx = 0;
+		for(p = 0;p < PHASES;p++)
+		{
+			x = ((uint64_t)j << 16) + (uint64_t)p * 0x10000 / PHASES;
+			chipEnergy(d, x, 0, DEMOD_PREAMBLE, e);
+			if(!isPreambleChips(e, thr))
+				continue;
+			score = (int64_t)(e[0] + e[2] + e[7] + e[9]) -
+				(int64_t)(e[1] + e[3] + e[4] + e[5] + e[6] + e[8]);
+			if(score > best)
+			{
+				best = score;
+				bestx = x;
+			}
+		}
+		if(best < 0)
+			continue;
+		d->candidates++;
+
+		chipEnergy(d, bestx, DEMOD_PREAMBLE, 2 * DEMOD_BITS, e);
+		memset(f.frame.frame, 0, 14);
+		for(b = 0;b < DEMOD_BITS;b++)
+			if(e[2*b] > e[2*b + 1])
+				f.frame.frame[b >> 3] |= (uint8_t)(0x80 >> (b & 7));
+		df = (int)adsbDf(&f.frame);
+		if(df != 17 && df != 18)
+			continue;
+		d->checked++;
+		if(crcSyndrome(&f.frame))
+		{
+			for(b = 0;b < DEMOD_BITS;b++)
+				conf[b] = (uint32_t)((e[2*b] > e[2*b + 1] ?
+					e[2*b] - e[2*b + 1] : e[2*b + 1] - e[2*b]) >> 16);
+			if(!repairFrame(conf, &f.frame, d->repair))
+				continue;
+			d->repaired++;
+		}
+
+		//chip energies are in 1/65536 samples, chipLen of them
+		for(level = 0, b = 0;b < DEMOD_BITS;b++)
+			level += e[2*b] > e[2*b + 1] ? e[2*b] : e[2*b + 1];
+		f.level = (uint16_t)(level / DEMOD_BITS / d->chipLen);
+		f.sample = d->pos + j;
+		d->skip = f.sample + d->framelen;
+		d->frames++;
+		found++;
+		cb(&f, arg);
+	}
+	return found;
+}
+
+int demodBlock(struct Demod *d, const uint8_t *iq, size_t samples,
+	DemodCallback cb, void *arg)
+{
+	size_t total, limit;
+	int found;
+
+	if(samples > DEMOD_BLOCK)
+		samples = DEMOD_BLOCK;
+	computeMag(d->kernel, iq, d->mag + d->carry, samples);
+	trackNoise(d, d->mag + d->carry, samples);
+	total = d->carry + samples;
+	if(total < d->framelen)
+	{
+		d->carry = total;
+		return 0;
+	}
+
+	//every preamble before limit has its whole frame in the buffer
+	limit = total - d->framelen + 1;
+	if(d->rate == DEMOD_RATE)
+		found = demodNative(d, limit, cb, arg);
+	else
+		found = demodOversampled(d, total, limit, cb, arg);
+
+	//keep the tail for the next block
+	d->carry = total - limit;
+	memmove(d->mag, d->mag + limit, sizeof(uint16_t) * d->carry);
+	d->pos += limit;
+	return found;
+}
+
+void skipDemod(struct Demod *d, uint64_t samples)
+{
+	d->pos += d->carry + samples;
+	d->carry = 0;
+	return;
+}
+
+void freeDemod(struct Demod *d)
+{
+	free(d->mag);
+	free(d->cand);
+	free(d->sum);
+	d->mag = NULL;
+	d->cand = NULL;
+	d->sum = NULL;
+	return;
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "adsb.h"
+
+/*
+	DEMOD.H
+	This file contains the demodulator for the -b option, which turns
+	8 bit unsigned I/Q samples (what rtl_sdr writes) into ADS-B frames.
+
+	At 2 Msps every sample is one 0.5us chip. A Mode S message is
+	an 8us preamble (pulses at 0, 1, 3.5 and 4.5us) followed by
+	bits that are PPM encoded, a 1 is high then low, a 0 is low then high.
+
+	Faster rates (2.4 Msps is the usual one for RTL-SDRs) don't line
+	chips up with samples, so each message's phase is found from its
+	preamble, and each chip is the integral of the magnitudes over its
+	exact span, counting the samples at either edge fractionally.
+
+	The preamble search runs on every sample, which is most of the work,
+	so it has AVX2 and NEON versions that test 16 positions at a time.
+	Every kernel gives the same results as the scalar one, bit for bit.
+
+	The preamble threshold isn't fixed, it follows the noise floor,
+	which is estimated every block from the median magnitude. Gain or
+	interference changes then don't flood the parity check with noise
+	that looks like preambles, or hide weak planes.
+
+	Frames that fail the parity check get a second chance: the
+	difference between the two chips of a bit is how sure the slicer
+	was about it, so the least sure bits are flipped first (one at a
+	time, then in pairs) until the syndrome matches or the repair
+	budget runs out.
+*/
+
+#define DEMOD_PREAMBLE 16	//samples in the preamble
+#define DEMOD_BITS 112		//bits in a long frame
+#define DEMOD_FRAMELEN (DEMOD_PREAMBLE + 2 * DEMOD_BITS)
+#define DEMOD_BLOCK (1 << 18)	//max samples per demodBlock call
+#define DEMOD_RATE 2000000	//sample rate with one sample per chip
+#define DEMOD_MAXRATE 8000000
+#define DEMOD_MAXFRAMELEN (DEMOD_FRAMELEN * (DEMOD_MAXRATE / DEMOD_RATE) + 3)
+
+enum DemodKernel {DEMOD_SCALAR=0, DEMOD_AVX2=1, DEMOD_NEON=2};
+
+#define DEMOD_FULLSCALE 16256	//magnitude of the strongest 8 bit sample
+
+/*
+	DemodFrame
+	A frame that passed the parity check,
+	and the sample its preamble started at (counted from the first
+	sample ever given to demodBlock).
+	level is the mean magnitude of its pulses, the signal power.
+*/
+struct DemodFrame
+{
+	union AdsbFrame frame;
+	uint64_t sample;
+	uint16_t level;
+};
+
+typedef void (*DemodCallback)(const struct DemodFrame *f, void *arg);
+
+/*
+	Demod
+	State kept between blocks. The last DEMOD_FRAMELEN magnitudes of
+	each block are kept so frames across block edges aren't lost.
+*/
+struct Demod
+{
+	uint16_t *mag;		//magnitudes, carry + block
+	uint32_t *cand;		//preamble candidates for one block
+	uint64_t *sum;		//running sum of mag, only above DEMOD_RATE
+	size_t carry;		//magnitudes carried over from the last block
+	size_t framelen;	//samples in one frame
+	unsigned int rate;	//samples per second
+	uint32_t chipLen;	//samples per chip, in 1/65536 samples
+	uint64_t pos;		//sample number of mag[0]
+	uint64_t skip;		//no preambles before this (inside last frame)
+	uint16_t threshold;	//min preamble pulse level, follows noise
+	uint16_t noise;		//noise floor, mean magnitude without signals
+	uint16_t snr;		//threshold over noise, in 1/16ths
+	int repair;		//max bit flips tried per failed frame, 0 is off
+	enum DemodKernel kernel;
+
+	unsigned long candidates;	//preambles found
+	unsigned long checked;		//DF 17/18 candidates, parity checked
+	unsigned long frames;		//frames that passed parity
+	unsigned long repaired;		//of those, frames fixed by flipping bits
+};
+
+/*
+	initDemod
+	Returns 0 on success, -1 if out of memory.
+	Picks the fastest kernel the CPU supports.
+*/
+int initDemod(struct Demod *d);
+
+/*
+	setDemodKernel
+	Returns 0 if the kernel was set, -1 if this CPU or build can't run it.
+	Mostly for testing kernels against the scalar one.
+*/
+int setDemodKernel(struct Demod *d, enum DemodKernel k);
+
+/*
+	setDemodRate
+	Returns 0 if the rate was set, -1 if it isn't between
+	DEMOD_RATE and DEMOD_MAXRATE or out of memory.
+	Has to be called before the first block, the default is DEMOD_RATE.
+*/
+int setDemodRate(struct Demod *d, unsigned int rate);
+
+/*
+	demodBlock
+	Demodulates up to DEMOD_BLOCK samples (2 bytes each, I then Q)
+	and calls cb for each frame found, in sample order.
+	Returns the amount of frames found.
+*/
+int demodBlock(struct Demod *d, const uint8_t *iq, size_t samples,
+	DemodCallback cb, void *arg);
+
+/*
+	skipDemod
+	Tells the demodulator samples were lost before the next block.
+	The carried over samples don't join up with the next block anymore
+	so they are thrown away, and sample numbers skip the lost ones.
+*/
+void skipDemod(struct Demod *d, uint64_t samples);
+
+/*
+	repairFrame
+	Returns the amount of bits flipped (1 or 2) if frame was fixed,
+	0 if no flip within budget tries made the parity check pass.
+
+	conf is how sure the slicer was about each bit, the difference
+	between its two chips. The DF bits are never flipped.
+*/
+int repairFrame(const uint32_t conf[DEMOD_BITS], union AdsbFrame *frame,
+	int budget);
+
+/*
+	freeDemod
+	Frees the buffers from initDemod.
+*/
+void freeDemod(struct Demod *d);
+
+/*
+	Kernels
+	Exposed so the kernels can be tested against each other.
+
+	computeMag: m = ((2I-255)^2 + (2Q-255)^2) / 8, which is at most
+	16256 so sums and 1.5x of it still fit in signed 16 bits.
+
+	findPreambles: writes the offsets (0 to n-1) that look like a
+	preamble into out and returns how many there were.
+	m has to be readable up to m[n + DEMOD_PREAMBLE].
+
+	sliceBits: PPM decisions for the 112 bits after a preamble at m,
+	written MSB first into out.
+*/
+void computeMag(enum DemodKernel k, const uint8_t *iq, uint16_t *m, size_t n);
+size_t findPreambles(enum DemodKernel k, const uint16_t *m, size_t n,
+	uint16_t threshold, uint32_t *out);
+void sliceBits(enum DemodKernel k, const uint16_t *m, uint8_t out[14]);
@@ -0,0 +1,342 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "adsb.h"
+#include "decode.h"
+
+/*
+	GEN.C
+	Makes I/Q captures with known contents for testing and
+	benchmarking the -b demodulator.
+
+	Planes around O'Hare (main's default position) send identification,
+	airborne position and velocity messages with real parity.
+	Each message is PPM modulated as a continuous signal starting at
+	a random time, so chips don't line up with samples, then shifted by
+	the frequency offset, averaged over each sample and put in
+	Gaussian noise, like a dongle would see it.
+
+	Every frame sent is written to the list file in the -p/-o format,
+	"*<hex>;" followed by the sample its preamble starts at, so the
+	list can also be decoded with -o for the expected planes.
+*/
+
+#define PLANES 16
+#define NOISE 3.		//noise standard deviation in LSB, I and Q each
+#define MSGUS 120.		//long frame length in microseconds
+#define MINGAP 50.		//gaps between frames that don't overlap, us
+#define MAXGAP 1000.
+#define MAXACTIVE 8		//frames that can be on the air at once
+
+struct GenPlane
+{
+	int icao;
+	char call[9];
+	double lat, lng;
+	int alt, vew, vns, vr;
+	int next;	//next message type to send
+};
+
+struct GenFrame
+{
+	union AdsbFrame frame;
+	double start;		//in samples
+	double amp;
+	double phase;		//carrier phase at the start
+};
+
+//xorshift64*, the same stream for a seed on every platform
+static uint64_t seed = 1;
+
+static double uniform(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return (double)((seed * 0x2545F4914F6CDD1Dull) >> 11) / 9007199254740992.;
+}
+
+static double gaussian(void)
+{
+	double u = uniform();
+	if(u < 1e-300)
+		u = 1e-300;
+	return sqrt(-2. * log(u)) * cos(2. * M_PI * uniform());
+}
+
+static void cprEncode(double lat, double lng, int odd, uint32_t *latcpr,
+	uint32_t *loncpr)
+{
+	double dlat, dlng, rlat;
+	int nl;
+
+	dlat = 360. / (60. - odd);
+	*latcpr = (uint32_t)floor(131072. * fmod(lat + 360., dlat) / dlat + 0.5);
+	rlat = dlat * ((double)(*latcpr) / 131072. + floor(lat / dlat));
+	nl = cprNL(rlat) - odd;
+	dlng = 360. / (nl > 1 ? nl : 1);
+	*loncpr = (uint32_t)floor(131072. * fmod(lng + 360., dlng) / dlng + 0.5);
+	*latcpr &= 0x1FFFF;
+	*loncpr &= 0x1FFFF;
+	return;
+}
+
+//message from the next type the plane sends, with parity
+static void makeFrame(struct GenPlane *p, union AdsbFrame *f)
+{
+	uint32_t latcpr, loncpr;
+	uint64_t call;
+	int n;
+
+	memset(f, 0, sizeof(*f));
+	adsbSetDf(f, 17);
+	adsbSetCa(f, 5);
+	adsbSetIcao(f, (uint64_t)p->icao);
+
+	switch(p->next)
+	{
+	case 0:
+		adsbSetTc(f, 4);
+		adsbSetIdCat(f, 3);
+		packCall(p->call, &call);
+		adsbSetIdCall(f, call);
+		break;
+
+	case 1: case 2:
+		adsbSetTc(f, 11);
+		//25 ft steps, Q bit set
+		n = (p->alt + 1000) / 25;
+		adsbSetAbAlt(f, (uint64_t)(((n >> 4) << 5) | 0x10 | (n & 0xF)));
+		adsbSetAbF(f, (uint64_t)(p->next - 1));
+		cprEncode(p->lat, p->lng, p->next - 1, &latcpr, &loncpr);
+		adsbSetAbLatCpr(f, latcpr);
+		adsbSetAbLonCpr(f, loncpr);
+		break;
+
+	default:
+		adsbSetTc(f, 19);
+		adsbSetAvSt(f, 1);
+		adsbSetAvDew(f, p->vew < 0);
+		adsbSetAvVew(f, (uint64_t)(abs(p->vew) + 1));
+		adsbSetAvDns(f, p->vns < 0);
+		adsbSetAvVns(f, (uint64_t)(abs(p->vns) + 1));
+		adsbSetAvSvr(f, p->vr < 0);
+		adsbSetAvVr(f, (uint64_t)(abs(p->vr) / 64 + 1));
+	}
+	p->next = (p->next + 1) % 4;
+
+	adsbSetPi(f, computeCrc(f));
+	return;
+}
+
+//chip k (0-239) of a frame, preamble then PPM bits
+static int chipOn(const union AdsbFrame *f, int k)
+{
+	static const uint8_t pre[16] = {1,0,1,0,0,0,0,1,0,1,0,0,0,0,0,0};
+	int b;
+	if(k < 16)
+		return pre[k];
+	b = (k - 16) / 2;
+	return ((f->frame[b / 8] >> (7 - b % 8)) & 1) ^ (k & 1);
+}
+
+/*
+	frameLevel
+	Returns how much of sample n the frame's pulses cover, 0 to 1,
+	which is the sample's amplitude averaged over its length.
+*/
+static double frameLevel(const struct GenFrame *g, double chip, long n)
+{
+	double t, end, cover = 0.;
+	int k, last;
+
+	k = (int)floor(((double)n - g->start) / chip);
+	last = (int)floor(((double)n + 1. - g->start) / chip);
+	if(k < 0)
+		k = 0;
+	if(last > 239)
+		last = 239;
+	for(;k <= last;k++)
+	{
+		if(!chipOn(&g->frame, k))
+			continue;
+		t = fmax((double)n, g->start + chip * k);
+		end = fmin((double)n + 1., g->start + chip * (k + 1));
+		if(end > t)
+			cover += end - t;
+	}
+	return cover;
+}
+
+static uint8_t toSample(double v)
+{
+	v = floor(127.5 + v + 0.5);
+	return (uint8_t)(v < 0. ? 0. : v > 255. ? 255. : v);
+}
+
+static void usage(void)
+{
+	printf("gen [-f <rate>][-s <snr dB>][-o <offset Hz>][-v <overlap>]"
+		"[-n <frames>][-x <seed>] <iq file> <frame list>\n");
+	return;
+}
+
+/*
+	main
+	gen [-f <rate>][-s <snr>][-o <offset>][-v <overlap>][-n <frames>]
+		[-x <seed>] <iq file> <frame list>
+	Arguments:
+	-f <rate>: sample rate in samples per second (def: 2000000)
+	-s <snr>: pulse power over noise power in dB (def: 20)
+	-o <offset>: carrier offset from the tuned frequency in Hz (def: 0)
+	-v <overlap>: fraction of frames that start on top of the last
+		one, 0 to 1 (def: 0)
+	-n <frames>: frames to send (def: 1000)
+	-x <seed>: random seed (def: 1)
+	"-" as the iq file writes to stdout.
+*/
+int main(int argc, char *argv[])
+{
+	struct GenPlane planes[PLANES];
+	struct GenFrame active[MAXACTIVE];
+	struct GenPlane *p;
+	FILE *iqf, *list;
+	double rate = 2000000., snr = 20., offset = 0., overlap = 0.;
+	double amp, chip, next, level, ph, i, q;
+	long frames = 1000, sent = 0, n;
+	unsigned long long s;
+	int nactive = 0, k, opt;
+	uint8_t out[2];
+	static const char *airlines[] = {"KLM", "UAL", "AAL", "DAL", "SWA"};
+
+	while((opt = getopt(argc, argv, "fsovnx")) != -1)
+	{
+		switch(opt)
+		{
+		case 'f':
+			sscanf(argv[optind++], "%lf", &rate);
+			break;
+		case 's':
+			sscanf(argv[optind++], "%lf", &snr);
+			break;
+		case 'o':
+			sscanf(argv[optind++], "%lf", &offset);
+			break;
+		case 'v':
+			sscanf(argv[optind++], "%lf", &overlap);
+			break;
+		case 'n':
+			sscanf(argv[optind++], "%ld", &frames);
+			break;
+		case 'x':
+			sscanf(argv[optind++], "%llu", &s);
+			seed = s ? (uint64_t)s : 1;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+	if(argc - optind != 2)
+	{
+		usage();
+		return -1;
+	}
+	if(argv[optind][0] == '-' && argv[optind][1] == 0)
+		iqf = stdout;
+	else
+		iqf = fopen(argv[optind], "wb");
+	list = fopen(argv[optind + 1], "w");
+	if(iqf == NULL || list == NULL)
+	{
+		printf("could not open output files\n");
+		return -1;
+	}
+
+	//within 100nm of O'Hare so main decodes positions locally
+	for(k = 0;k < PLANES;k++)
+	{
+		p = &planes[k];
+		p->icao = 0xA00000 + (int)(uniform() * 0x100000);
+		snprintf(p->call, sizeof(p->call), "%s%-5d",
+			airlines[k % 5], 100 + (int)(uniform() * 9000));
+		p->lat = 41.978611 + (uniform() - 0.5) * 2.;
+		p->lng = -87.904722 + (uniform() - 0.5) * 2.5;
+		p->alt = 1000 + 100 * (int)(uniform() * 380);
+		p->vew = (int)((uniform() - 0.5) * 900);
+		p->vns = (int)((uniform() - 0.5) * 900);
+		p->vr = 64 * (int)((uniform() - 0.5) * 60);
+		p->next = (int)(uniform() * 4);
+	}
+
+	//SNR is pulse power over the noise power of I and Q together
+	amp = NOISE * sqrt(2.) * pow(10., snr / 20.);
+	chip = rate / 2000000.;
+	fprintf(list, "# rate %.0f, snr %.1f dB, offset %.0f Hz, overlap %.2f\n",
+		rate, snr, offset, overlap);
+
+	next = rate * MINGAP / 1e6;
+	for(n = 0;sent < frames || nactive;n++)
+	{
+		//frames that have finished go off the air
+		for(k = 0;k < nactive;)
+		{
+			if(active[k].start + chip * 240. < (double)n)
+				active[k] = active[--nactive];
+			else
+				k++;
+		}
+
+		//start the next frame once its time comes
+		if(sent < frames && (double)n + 1. > next && nactive < MAXACTIVE)
+		{
+			active[nactive].start = next;
+			active[nactive].amp = amp;
+			active[nactive].phase = 2. * M_PI * uniform();
+			makeFrame(&planes[(int)(uniform() * PLANES)],
+				&active[nactive].frame);
+			fprintf(list, "*%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X"
+				"%02X%02X%02X%02X; %ld\n",
+				active[nactive].frame.frame[0], active[nactive].frame.frame[1],
+				active[nactive].frame.frame[2], active[nactive].frame.frame[3],
+				active[nactive].frame.frame[4], active[nactive].frame.frame[5],
+				active[nactive].frame.frame[6], active[nactive].frame.frame[7],
+				active[nactive].frame.frame[8], active[nactive].frame.frame[9],
+				active[nactive].frame.frame[10], active[nactive].frame.frame[11],
+				active[nactive].frame.frame[12], active[nactive].frame.frame[13],
+				(long)floor(next));
+			nactive++;
+			sent++;
+
+			if(uniform() < overlap)	//somewhere inside this frame
+				next += uniform() * rate * MSGUS / 1e6;
+			else
+				next += rate * (MSGUS + MINGAP +
+					uniform() * (MAXGAP - MINGAP)) / 1e6;
+		}
+
+		i = NOISE * gaussian();
+		q = NOISE * gaussian();
+		for(k = 0;k < nactive;k++)
+		{
+			level = frameLevel(&active[k], chip, n);
+			if(level == 0.)
+				continue;
+			ph = active[k].phase + 2. * M_PI * offset *
+				((double)n + 0.5 - active[k].start) / rate;
+			i += active[k].amp * level * cos(ph);
+			q += active[k].amp * level * sin(ph);
+		}
+		out[0] = toSample(i);
+		out[1] = toSample(q);
+		fwrite(out, 1, 2, iqf);
+	}
+
+	fprintf(stderr, "%ld frames, %ld samples\n", sent, n);
+	if(iqf != stdout)
+		fclose(iqf);
+	fclose(list);
+	return 0;
+}
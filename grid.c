@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "grid.h"
+
+#define ROWS ((long)(180. / GRID_DEG))
+#define COLS ((long)(360. / GRID_DEG))
+#define EARTHNM 3440.065	//mean earth radius in nm
+#define RAD (M_PI / 180.)
+
+typedef void (*GridVisit)(const struct PlaneGrid *g, int slot, void *arg);
+
+//row * COLS + column, columns wrap around at the 180th meridian
+static long cellOf(double lat, double lng)
+{
+	long y, x;
+	y = (long)floor((lat + 90.) / GRID_DEG);
+	if(y < 0)
+		y = 0;
+	if(y >= ROWS)
+		y = ROWS - 1;
+	x = (long)floor((lng + 180.) / GRID_DEG) % COLS;
+	if(x < 0)
+		x += COLS;
+	return y * COLS + x;
+}
+
+static unsigned int bucketOf(const struct PlaneGrid *g, long cell)
+{
+	uint32_t h = (uint32_t)cell * 2654435761u;
+	return (h ^ h >> 16) & g->mask;
+}
+
+int initGrid(struct PlaneGrid *g, const struct Plane buf[], int bufsize)
+{
+	unsigned int buckets = 16, i;
+	int k;
+
+	while(buckets < (unsigned int)bufsize)
+		buckets <<= 1;
+	g->buf = buf;
+	g->bufsize = bufsize;
+	g->mask = buckets - 1;
+	g->head = malloc(sizeof(int) * buckets);
+	g->next = malloc(sizeof(int) * bufsize);
+	g->prev = malloc(sizeof(int) * bufsize);
+	g->cell = malloc(sizeof(long) * bufsize);
+	if(g->head == NULL || g->next == NULL || g->prev == NULL ||
+		g->cell == NULL)
+	{
+		freeGrid(g);
+		return -1;
+	}
+	for(i = 0;i < buckets;i++)
+		g->head[i] = -1;
+	for(k = 0;k < bufsize;k++)
+		g->cell[k] = -1;
+	for(k = 0;k < bufsize;k++)
+		updateGrid(g, k);
+	return 0;
+}
+
+void updateGrid(struct PlaneGrid *g, int slot)
+{
+	const struct Plane *p = &g->buf[slot];
+	unsigned int b;
+	long cell = -1;
+
+	if((p->pflags & (ICAOFL | POSVALID)) == (ICAOFL | POSVALID))
+		cell = cellOf(p->lat, p->lng);
+	if(cell == g->cell[slot])
+		return;
+
+	if(g->cell[slot] >= 0)
+	{
+		if(g->prev[slot] >= 0)
+			g->next[g->prev[slot]] = g->next[slot];
+		else
+			g->head[bucketOf(g, g->cell[slot])] = g->next[slot];
+		if(g->next[slot] >= 0)
+			g->prev[g->next[slot]] = g->prev[slot];
+	}
+	g->cell[slot] = cell;
+	if(cell < 0)
+		return;
+
+	b = bucketOf(g, cell);
+	g->prev[slot] = -1;
+	g->next[slot] = g->head[b];
+	if(g->head[b] >= 0)
+		g->prev[g->head[b]] = slot;
+	g->head[b] = slot;
+	return;
+}
+
+static int inBox(const struct Plane *p, double lat0, double lng0,
+	double lat1, double lng1)
+{
+	if(p->lat < lat0 || p->lat > lat1)
+		return 0;
+	if(lng0 <= lng1)
+		return p->lng >= lng0 && p->lng <= lng1;
+	return p->lng >= lng0 || p->lng <= lng1;
+}
+
+/*
+	visitBox
+	Calls fn for every plane in the box.
+	Walks the cells the box covers, checking each plane is in the cell
+	being walked since other cells can share its bucket. Once there
+	are more cells than buckets it is less work to walk the buckets.
+*/
+static void visitBox(const struct PlaneGrid *g, double lat0, double lng0,
+	double lat1, double lng1, GridVisit fn, void *arg)
+{
+	long y, y0, y1, x, x0, width, cell;
+	unsigned int b;
+	int k;
+
+	y0 = cellOf(lat0, 0.) / COLS;
+	y1 = cellOf(lat1, 0.) / COLS;
+	x0 = (long)floor((lng0 + 180.) / GRID_DEG);
+	width = (long)floor((lng1 + 180.) / GRID_DEG) - x0 + 1;
+	if(lng0 > lng1)
+		width += COLS;
+	if(width > COLS)
+		width = COLS;
+
+	if((y1 - y0 + 1) * width > (long)g->mask + 1)
+	{
+		for(b = 0;b <= g->mask;b++)
+			for(k = g->head[b];k >= 0;k = g->next[k])
+				if(inBox(&g->buf[k], lat0, lng0, lat1, lng1))
+					fn(g, k, arg);
+		return;
+	}
+
+	for(y = y0;y <= y1;y++)
+		for(x = x0;x < x0 + width;x++)
+		{
+			cell = y * COLS + (x % COLS + COLS) % COLS;
+			for(k = g->head[bucketOf(g, cell)];k >= 0;k = g->next[k])
+				if(g->cell[k] == cell &&
+					inBox(&g->buf[k], lat0, lng0, lat1, lng1))
+					fn(g, k, arg);
+		}
+	return;
+}
+
+/*
+	radiusBox
+	The smallest lat/lng box around a circle of nm.
+	Circles over a pole get every longitude.
+*/
+static void radiusBox(double lat, double lng, double nm, double box[4])
+{
+	double r = nm / EARTHNM, dlng;
+
+	box[0] = lat - r / RAD;
+	box[2] = lat + r / RAD;
+	box[1] = -180.;
+	box[3] = 180.;
+	if(box[0] <= -90. || box[2] >= 90. || sin(r) >= cos(lat * RAD))
+		return;
+	dlng = asin(sin(r) / cos(lat * RAD)) / RAD;
+	box[1] = lng - dlng < -180. ? lng - dlng + 360. : lng - dlng;
+	box[3] = lng + dlng > 180. ? lng + dlng - 360. : lng + dlng;
+	return;
+}
+
+double planeDistance(const struct Plane *p, double lat, double lng)
+{
+	double a, slat, slng;
+	slat = sin((p->lat - lat) * RAD / 2.);
+	slng = sin((p->lng - lng) * RAD / 2.);
+	a = slat * slat + cos(lat * RAD) * cos(p->lat * RAD) * slng * slng;
+	return 2. * EARTHNM * asin(sqrt(fmin(a, 1.)));
+}
+
+struct GridResult
+{
+	int *out;
+	int max, cnt;
+	double lat, lng, nm;
+};
+
+static void addBox(const struct PlaneGrid *g, int slot, void *arg)
+{
+	struct GridResult *r = arg;
+	(void)g;
+	if(r->cnt < r->max)
+		r->out[r->cnt] = slot;
+	r->cnt++;
+	return;
+}
+
+static void addRadius(const struct PlaneGrid *g, int slot, void *arg)
+{
+	struct GridResult *r = arg;
+	if(planeDistance(&g->buf[slot], r->lat, r->lng) <= r->nm)
+		addBox(g, slot, arg);
+	return;
+}
+
+//keeps out sorted by distance, dropping the farthest past max
+static void addNearest(const struct PlaneGrid *g, int slot, void *arg)
+{
+	struct GridResult *r = arg;
+	double d = planeDistance(&g->buf[slot], r->lat, r->lng);
+	int i;
+
+	if(d > r->nm || (r->cnt == r->max &&
+		d >= planeDistance(&g->buf[r->out[r->cnt - 1]], r->lat, r->lng)))
+		return;
+	i = r->cnt < r->max ? r->cnt++ : r->cnt - 1;
+	for(;i > 0 && planeDistance(&g->buf[r->out[i - 1]], r->lat, r->lng) > d;
+		i--)
+		r->out[i] = r->out[i - 1];
+	r->out[i] = slot;
+	return;
+}
+
+int gridBox(const struct PlaneGrid *g, double lat0, double lng0,
+	double lat1, double lng1, int out[], int max)
+{
+	struct GridResult r = {out, max, 0, 0., 0., 0.};
+	visitBox(g, lat0, lng0, lat1, lng1, addBox, &r);
+	return r.cnt < max ? r.cnt : max;
+}
+
+int gridRadius(const struct PlaneGrid *g, double lat, double lng, double nm,
+	int out[], int max)
+{
+	struct GridResult r = {out, max, 0, lat, lng, nm};
+	double box[4];
+	radiusBox(lat, lng, nm, box);
+	visitBox(g, box[0], box[1], box[2], box[3], addRadius, &r);
+	return r.cnt < max ? r.cnt : max;
+}
+
+int gridNearest(const struct PlaneGrid *g, double lat, double lng, int k,
+	int out[])
+{
+	struct GridResult r = {out, k, 0, lat, lng, GRID_DEG * 60.};
+	double box[4];
+
+	if(k <= 0)
+		return 0;
+	//every plane closer than the kth is inside the radius
+	for(;;r.nm *= 2.)
+	{
+		r.cnt = 0;
+		radiusBox(lat, lng, r.nm, box);
+		visitBox(g, box[0], box[1], box[2], box[3], addNearest, &r);
+		if(r.cnt == k || r.nm >= M_PI * EARTHNM)
+			return r.cnt;
+	}
+}
+
+void freeGrid(struct PlaneGrid *g)
+{
+	free(g->head);
+	free(g->next);
+	free(g->prev);
+	free(g->cell);
+	g->head = NULL;
+	g->next = NULL;
+	g->prev = NULL;
+	g->cell = NULL;
+	return;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "logger.h"
+
+/*
+	GRID.H
+	A spatial index over the plane cache, so asking which planes are
+	in an area doesn't scan every slot.
+
+	The world is cut into GRID_DEG by GRID_DEG cells of lat/lng.
+	Only cells with planes in them take memory, the cells are hashed
+	into a table of buckets sized to the cache, and each bucket is a
+	linked list of cache slots. logPlane moves a slot to its new cell
+	whenever its position changes, so the index never has to be
+	rebuilt.
+
+	Queries return cache slots (indexes into the Plane buffer).
+	They only look at the cells the area covers, or every bucket if
+	the area covers more cells than there are buckets, so the work is
+	about the amount of planes found, not the cache size.
+
+	Distances are in nautical miles, great circle.
+	None of this is thread safe, it belongs to whoever calls logPlane.
+*/
+
+#define GRID_DEG 0.5		//cell size in degrees, 30nm of latitude
+
+/*
+	PlaneGrid
+	cell is the cell each slot is in, -1 for slots without a position.
+	next and prev link the slots in the same bucket.
+*/
+struct PlaneGrid
+{
+	const struct Plane *buf;
+	int bufsize;
+	int *head;		//first slot in each bucket, -1 if empty
+	int *next, *prev;
+	long *cell;
+	unsigned int mask;	//buckets - 1
+};
+
+/*
+	initGrid
+	Returns 0 on success, -1 if out of memory.
+	Indexes every plane in buf that has a position.
+*/
+int initGrid(struct PlaneGrid *g, const struct Plane buf[], int bufsize);
+
+/*
+	updateGrid
+	Moves slot to the cell of its current position, or takes it out
+	of the index if it doesn't have one. logPlane calls this for the
+	attached grid, call it after changing a slot any other way.
+*/
+void updateGrid(struct PlaneGrid *g, int slot);
+
+/*
+	gridBox
+	Returns the amount of planes inside the box written to out,
+	at most max.
+	A box with lng0 > lng1 goes across the 180th meridian.
+*/
+int gridBox(const struct PlaneGrid *g, double lat0, double lng0,
+	double lat1, double lng1, int out[], int max);
+
+/*
+	gridRadius
+	Returns the amount of planes within nm nautical miles of lat/lng
+	written to out, at most max.
+*/
+int gridRadius(const struct PlaneGrid *g, double lat, double lng, double nm,
+	int out[], int max);
+
+/*
+	gridNearest
+	Returns the amount of planes written to out, k unless there are
+	fewer planes with a position. out is sorted nearest first.
+
+	Searches out from lat/lng, doubling the radius until k planes
+	are inside it.
+*/
+int gridNearest(const struct PlaneGrid *g, double lat, double lng, int k,
+	int out[]);
+
+/*
+	planeDistance
+	Returns the great circle distance in nm from lat/lng to a plane.
+*/
+double planeDistance(const struct Plane *p, double lat, double lng);
+
+/*
+	freeGrid
+	Frees the index, it has to be detached from logPlane first.
+*/
+void freeGrid(struct PlaneGrid *g);
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "json.h"
+#include "output.h"
+#include "stats.h"
+
+#define PLANEJSON 320	//more than the longest plane object can be
+#define HEADJSON 64	//"now", brackets and the end
+
+/*
+	Formatting helpers
+	Each one writes at p and returns the position after.
+	Nothing is null terminated until the end of formatJson.
+*/
+static char *putStr(char *p, const char *s)
+{
+	while(*s)
+		*p++ = *s++;
+	return p;
+}
+
+static char *putUInt(char *p, unsigned long long v)
+{
+	char tmp[20];
+	int n = 0;
+	do
+	{
+		tmp[n++] = (char)('0' + v % 10);
+		v /= 10;
+	} while(v);
+	while(n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+static char *putInt(char *p, long long v)
+{
+	if(v < 0)
+	{
+		*p++ = '-';
+		return putUInt(p, 0ull - (unsigned long long)v);
+	}
+	return putUInt(p, (unsigned long long)v);
+}
+
+/*
+	putFixed
+	Writes v rounded to dec decimal places (dec <= 6).
+	Values too big to mean anything are clamped so the
+	output always fits in PLANEJSON.
+*/
+static char *putFixed(char *p, double v, int dec)
+{
+	static const long long scale[7] = {1, 10, 100, 1000, 10000,
+		100000, 1000000};
+	unsigned long long x, frac;
+	int i;
+
+	if(v != v)	//NaN
+		v = 0.;
+	if(v < 0.)
+	{
+		*p++ = '-';
+		v = -v;
+	}
+	if(v > 1e9)
+		v = 1e9;
+	x = (unsigned long long)llround(v * scale[dec]);
+	p = putUInt(p, x / scale[dec]);
+	if(dec)
+	{
+		*p++ = '.';
+		frac = x % scale[dec];
+		for(i = dec - 1;i >= 0;i--)
+		{
+			p[i] = (char)('0' + frac % 10);
+			frac /= 10;
+		}
+		p += dec;
+	}
+	return p;
+}
+
+static char *putHex6(char *p, int v)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+	for(i = 5;i >= 0;i--)
+	{
+		p[i] = digits[v & 0xF];
+		v >>= 4;
+	}
+	return p + 6;
+}
+
+//strings from the plane are A-Z, 0-9 and spaces, trailing spaces are cut
+static char *putTrimmed(char *p, const char *s, int max)
+{
+	int n = 0, i;
+	while(n < max && s[n])
+		n++;
+	while(n && s[n - 1] == ' ')
+		n--;
+	for(i = 0;i < n;i++)
+		*p++ = s[i] == '"' || s[i] == '\\' ? ' ' : s[i];
+	return p;
+}
+
+static char *putStats(char *p, const struct PlaneStats *s, time_t now)
+{
+	p = putStr(p, ",\"messages\":");
+	p = putUInt(p, totalMessages(s));
+	p = putStr(p, ",\"msg_rate\":");
+	p = putFixed(p, messageRate(s, now), 1);
+	if(s->levels > 0)
+	{
+		p = putStr(p, ",\"rssi\":");
+		p = putFixed(p, levelDb((unsigned int)(s->levelSum / s->levels)),
+			1);
+	}
+	return p;
+}
+
+int initJson(struct JsonWriter *w, const char *filename, int planes,
+	int interval)
+{
+	size_t n = strlen(filename);
+
+	memset(w, 0, sizeof(*w));
+	w->bufsize = (size_t)planes * PLANEJSON + HEADJSON;
+	w->buf = malloc(w->bufsize);
+	w->filename = malloc(n + 1);
+	w->tmpname = malloc(n + 5);
+	if(w->buf == NULL || w->filename == NULL || w->tmpname == NULL)
+	{
+		freeJson(w);
+		return -1;
+	}
+	memcpy(w->filename, filename, n + 1);
+	memcpy(w->tmpname, filename, n);
+	memcpy(w->tmpname + n, ".tmp", 5);
+	w->interval = interval;
+	return 0;
+}
+
+size_t formatJson(struct JsonWriter *w, const struct Plane buf[], int bufsize,
+	time_t now)
+{
+	char *p = w->buf, call[9];
+	int i, first = 1;
+
+	p = putStr(p, "{\"now\":");
+	p = putInt(p, (long long)now);
+	p = putStr(p, ",\"aircraft\":[");
+	for(i = 0;i < bufsize;i++)
+	{
+		if((buf[i].pflags & ICAOFL) == 0)
+			break;
+		if(!first)
+			*p++ = ',';
+		first = 0;
+
+		p = putStr(p, "\n{\"hex\":\"");
+		p = putHex6(p, buf[i].icao);
+		*p++ = '"';
+		if(buf[i].pflags & IDENTVALID)
+		{
+			p = putStr(p, ",\"flight\":\"");
+			expandCall(buf[i].call, call);
+			p = putTrimmed(p, call, 8);
+			p = putStr(p, "\",\"type\":\"");
+			p = putStr(p, planeType(buf[i].cat));
+			*p++ = '"';
+		}
+		if(buf[i].pflags & POSVALID)
+		{
+			p = putStr(p, ",\"lat\":");
+			p = putFixed(p, buf[i].lat, 6);
+			p = putStr(p, ",\"lon\":");
+			p = putFixed(p, buf[i].lng, 6);
+		}
+		if(buf[i].pflags & TRKVALID)
+		{
+			p = putStr(p, ",\"track\":");
+			p = putFixed(p, buf[i].trk, 1);
+		}
+		if(buf[i].pflags & SPDVALID)
+		{
+			p = putStr(p, buf[i].pflags & IASFL ? ",\"ias\":" : ",\"gs\":");
+			p = putFixed(p, buf[i].spd, 1);
+		}
+		if(buf[i].pflags & ALTVALID)
+		{
+			p = putStr(p, ",\"alt_baro\":");
+			p = putInt(p, buf[i].alt);
+		}
+		if(buf[i].pflags & VERTVALID)
+		{
+			p = putStr(p, ",\"baro_rate\":");
+			p = putInt(p, buf[i].vert);
+		}
+		p = putStr(p, ",\"seen\":");
+		p = putInt(p, (long long)(now - buf[i].lstUpd));
+		if(w->stats != NULL && w->stats[i].icao == buf[i].icao)
+			p = putStats(p, &w->stats[i], now);
+		*p++ = '}';
+	}
+	p = putStr(p, "\n]}\n");
+	*p = 0;
+	return (size_t)(p - w->buf);
+}
+
+int writeJson(struct JsonWriter *w, const struct Plane buf[], int bufsize,
+	time_t now)
+{
+	size_t len;
+
+	if(now - w->lastWrite < w->interval)
+		return 0;
+	w->lastWrite = now;
+
+	len = formatJson(w, buf, bufsize, now);
+	return replaceFile(w->filename, w->tmpname, w->buf, len, NULL, 0) ?
+		-1 : 1;
+}
+
+void freeJson(struct JsonWriter *w)
+{
+	free(w->buf);
+	free(w->filename);
+	free(w->tmpname);
+	w->buf = NULL;
+	w->filename = NULL;
+	w->tmpname = NULL;
+	return;
+}
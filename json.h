@@ -0,0 +1,67 @@
+#pragma once
+#include <time.h>
+#include "logger.h"
+
+/*
+	JSON.H
+	Writes the plane cache as a JSON snapshot for web frontends,
+	about the same layout as the aircraft.json of other decoders:
+
+	{"now":<unix time>,"aircraft":[{"hex":"4840d6","flight":"KLM1023",
+	"type":"HEAVY","lat":52.257202,"lon":3.919373,"track":92.8,
+	"gs":17.0,"alt_baro":38000,"baro_rate":-832,"seen":3,
+	"messages":212,"msg_rate":4.2,"rssi":-18.3}, ...]}
+
+	Only fields with valid flags are written, and the reception
+	stats only if the writer has them (rssi only for -b frames).
+*/
+
+/*
+	JsonWriter
+	The buffer is allocated once for the cache size in initJson,
+	so writing a snapshot doesn't allocate or call printf.
+*/
+struct JsonWriter
+{
+	char *filename;
+	char *tmpname;
+	char *buf;
+	size_t bufsize;
+	int interval;		//seconds between snapshots
+	time_t lastWrite;
+	const struct PlaneStats *stats;	//one per slot (stats.h), or NULL
+};
+
+/*
+	initJson
+	Returns 0 on success, -1 if out of memory.
+	planes is the cache size the snapshots will be made from.
+*/
+int initJson(struct JsonWriter *w, const char *filename, int planes,
+	int interval);
+
+/*
+	formatJson
+	Returns the length of the JSON written into w->buf.
+	Formats by hand into the reused buffer, a few hundred ns per plane.
+*/
+size_t formatJson(struct JsonWriter *w, const struct Plane buf[], int bufsize,
+	time_t now);
+
+/*
+	writeJson
+	Returns 1 if a snapshot was written, 0 if it isn't time yet,
+	and -1 on a file error.
+
+	Rate limited to one snapshot per interval.
+	The snapshot is written to "<filename>.tmp" and renamed over
+	filename, so readers always see a whole file.
+*/
+int writeJson(struct JsonWriter *w, const struct Plane buf[], int bufsize,
+	time_t now);
+
+/*
+	freeJson
+	Frees everything from initJson.
+*/
+void freeJson(struct JsonWriter *w);
@@ -0,0 +1,156 @@
+#include <string.h>
+#include "libadsb.h"
+
+void initDecoder(struct AdsbDecoder *d, double rlat, double rlng)
+{
+	memset(d, 0, sizeof(*d));
+	d->rlat = rlat;
+	d->rlng = rlng;
+	return;
+}
+
+void setDecoderHandler(struct AdsbDecoder *d, AdsbHandler handler,
+	void *arg)
+{
+	d->handler = handler;
+	d->arg = arg;
+	return;
+}
+
+void setDecoderArray(struct AdsbDecoder *d, struct AdsbDecoded out[],
+	size_t size)
+{
+	d->handler = NULL;
+	d->out = out;
+	d->outsize = size;
+	d->outlen = 0;
+	return;
+}
+
+int setDecoderRate(struct AdsbDecoder *d, unsigned int rate)
+{
+	if(!d->demodReady)
+	{
+		if(initDemod(&d->demod))
+			return -1;
+		d->demodReady = 1;
+	}
+	return setDemodRate(&d->demod, rate);
+}
+
+/*
+	emit
+	Returns 1 if the frame passed and went to the handler or array,
+	0 if not. Decodes straight into the array when there is room.
+*/
+static int emit(struct AdsbDecoder *d, const union AdsbFrame *frame,
+	uint64_t sample)
+{
+	struct AdsbDecoded dec, *p = &dec;
+
+	d->frames++;
+	if(d->handler == NULL && d->outlen < d->outsize)
+		p = &d->out[d->outlen];
+	//decodeEvent only fills in what the frame has
+	memset(&p->ev, 0, sizeof(p->ev));
+	if(decodeEvent(frame, d->rlat, d->rlng, &p->ev) != 0)
+		return 0;
+	d->decoded++;
+	p->type = (enum AdsbDecodedType)messageKind(p->ev.tc);
+	p->frame = *frame;
+	p->sample = sample;
+
+	if(d->handler != NULL)
+		d->handler(p, d->arg);
+	else if(p == &dec)
+		d->lost++;
+	else
+		d->outlen++;
+	return 1;
+}
+
+int pushFrame(struct AdsbDecoder *d, const union AdsbFrame *frame)
+{
+	d->outlen = 0;
+	return emit(d, frame, 0);
+}
+
+static int hexLine(struct AdsbDecoder *d, const char *line, size_t len)
+{
+	union AdsbFrame f;
+	if(parseHexFrame(line, len, &f) < 0)
+		return 0;
+	return emit(d, &f, 0);
+}
+
+long pushHex(struct AdsbDecoder *d, const char *text, size_t len)
+{
+	const char *end = text + len, *nl;
+	size_t keep;
+	long n = 0;
+
+	d->outlen = 0;
+	while(text < end)
+	{
+		nl = memchr(text, '\n', (size_t)(end - text));
+		//whatever is too long to be a message doesn't need keeping
+		keep = (size_t)((nl != NULL ? nl : end) - text);
+		if(keep > ADSB_LINE - d->linelen)
+			keep = ADSB_LINE - d->linelen;
+		if(nl == NULL)
+		{
+			memcpy(d->line + d->linelen, text, keep);
+			d->linelen += keep;
+			break;
+		}
+		if(d->linelen > 0)
+		{
+			memcpy(d->line + d->linelen, text, keep);
+			n += hexLine(d, d->line, d->linelen + keep);
+			d->linelen = 0;
+		}
+		else
+			n += hexLine(d, text, (size_t)(nl - text));
+		text = nl + 1;
+	}
+	return n;
+}
+
+struct IQPush
+{
+	struct AdsbDecoder *d;
+	long n;
+};
+
+static void demodFound(const struct DemodFrame *f, void *arg)
+{
+	struct IQPush *p = arg;
+	p->n += emit(p->d, &f->frame, f->sample);
+	return;
+}
+
+long pushIQ(struct AdsbDecoder *d, const uint8_t *iq, size_t samples)
+{
+	struct IQPush p = {d, 0};
+	size_t n;
+
+	if(!d->demodReady && setDecoderRate(d, DEMOD_RATE))
+		return -1;
+	d->outlen = 0;
+	while(samples > 0)
+	{
+		n = samples < DEMOD_BLOCK ? samples : DEMOD_BLOCK;
+		demodBlock(&d->demod, iq, n, demodFound, &p);
+		iq += 2 * n;
+		samples -= n;
+	}
+	return p.n;
+}
+
+void freeDecoder(struct AdsbDecoder *d)
+{
+	if(d->demodReady)
+		freeDemod(&d->demod);
+	d->demodReady = 0;
+	return;
+}
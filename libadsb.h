@@ -0,0 +1,123 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "adsb.h"
+#include "decode.h"
+#include "demod.h"
+
+/*
+	LIBADSB.H
+	The decoder on its own, built into libadsb.a and libadsb.so by
+	make lib, for programs that want decoded messages without the
+	rest of this one. Link with -lm -pthread.
+
+	Everything a decoder needs is in its AdsbDecoder, there are no
+	globals, so one process can run as many decoders as it wants
+	(each used by one thread at a time).
+
+	Frames, "*<hex>;" text (what rtl_adsb and -p read) or 8 bit I/Q
+	samples (what -b reads) are pushed in as they arrive, in pieces
+	of any size. Every frame that passes the parity check comes out as
+	an AdsbDecoded, either to a callback as it is found or into an
+	array the caller hands over.
+*/
+
+//the same kinds as messageKind in decode.h
+enum AdsbDecodedType {ADSB_IDENT = KIND_IDENT, ADSB_SURFACE = KIND_SURFACE,
+	ADSB_AIRBORNE = KIND_AIRBORNE, ADSB_VELOCITY = KIND_VELOCITY,
+	ADSB_OTHER = KIND_OTHER};
+
+/*
+	AdsbDecoded
+	One decoded frame. ev is what decodeEvent made of it, ev.fl says
+	which values are valid (none for ADSB_OTHER, the status reports).
+	sample is where the preamble started for pushed samples (see
+	DemodFrame), 0 for frames and text.
+*/
+struct AdsbDecoded
+{
+	enum AdsbDecodedType type;
+	struct AdsbEvent ev;
+	union AdsbFrame frame;
+	uint64_t sample;
+};
+
+typedef void (*AdsbHandler)(const struct AdsbDecoded *dec, void *arg);
+
+#define ADSB_LINE 64	//longest text line kept between pushes
+
+/*
+	AdsbDecoder
+	rlat and rlng are where the receiver is, positions are decoded
+	relative to it (planes have to be within 180nm). They can be
+	changed between pushes.
+*/
+struct AdsbDecoder
+{
+	double rlat, rlng;
+
+	AdsbHandler handler;
+	void *arg;
+	struct AdsbDecoded *out;	//array mode, see setDecoderArray
+	size_t outsize, outlen;
+
+	char line[ADSB_LINE];	//text after the last newline pushed
+	size_t linelen;
+
+	struct Demod demod;
+	int demodReady;
+
+	unsigned long frames;	//frames pushed or found
+	unsigned long decoded;	//of those, passed the parity check
+	unsigned long lost;	//decoded, but the array was full
+};
+
+/*
+	initDecoder
+	Sets up a decoder for a receiver at rlat, rlng. Events are dropped
+	until setDecoderHandler or setDecoderArray says where they go.
+*/
+void initDecoder(struct AdsbDecoder *d, double rlat, double rlng);
+
+/*
+	setDecoderHandler
+	Calls handler for every event, from the pushing thread.
+*/
+void setDecoderHandler(struct AdsbDecoder *d, AdsbHandler handler,
+	void *arg);
+
+/*
+	setDecoderArray
+	Every push writes its events from out[0], and returns how many.
+	Events past size are counted in lost.
+*/
+void setDecoderArray(struct AdsbDecoder *d, struct AdsbDecoded out[],
+	size_t size);
+
+/*
+	setDecoderRate
+	Returns 0 if the rate was set, -1 if it isn't between DEMOD_RATE
+	and DEMOD_MAXRATE or out of memory.
+	The sample rate of pushIQ, DEMOD_RATE unless this is called
+	before the first samples.
+*/
+int setDecoderRate(struct AdsbDecoder *d, unsigned int rate);
+
+/*
+	pushFrame, pushHex, pushIQ
+	Return the amount of events, or -1 if out of memory (pushIQ).
+
+	pushHex takes text with one message per line, a line cut off at
+	the end is finished by the next push.
+	pushIQ takes samples (2 bytes each, I then Q) from an SDR,
+	the next push carries on where the last one stopped.
+*/
+int pushFrame(struct AdsbDecoder *d, const union AdsbFrame *frame);
+long pushHex(struct AdsbDecoder *d, const char *text, size_t len);
+long pushIQ(struct AdsbDecoder *d, const uint8_t *iq, size_t samples);
+
+/*
+	freeDecoder
+	Frees the demodulator, if pushIQ or setDecoderRate started it.
+*/
+void freeDecoder(struct AdsbDecoder *d);
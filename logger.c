@@ -4,27 +4,54 @@
 #include <string.h>
 
 #ifdef MAPPING
+#include <pthread.h>
 #include "gmt.h"
 #include "gmt_resources.h"
 #endif
 
 #include "logger.h"
+#include "grid.h"
+#include "output.h"
+#include "archive.h"
+#include "stats.h"
+#include "alloc.h"
 
-#define LINEWIDTH 78
+#define LINEWIDTH 90
+
+static struct PlaneGrid *planeGrid = NULL;
+static struct Archive *planeArchive = NULL;
+static const struct Plane *planeArchiveBuf = NULL;
+static const struct PlaneStats *planeStats = NULL;
 
 #ifdef MAPPING
 static void *API = NULL;
+
+//map worker state, everything but mapBufs[0] is guarded by mapLock
+//mapBufs[0]: filled by requestImage, [1]: pending, [2]: being drawn
+static pthread_t mapThread;
+static pthread_mutex_t mapLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mapCond = PTHREAD_COND_INITIALIZER;
+static struct Plane *mapBufs[3];
+static int mapSize = 0, mapPending = 0, mapStop = 0, mapRunning = 0;
+static unsigned long mapCoalesced = 0;
 #endif
 
-void logPlane(struct Plane buf[], int bufsize, int icao, char call[9],
-	char type[8], double lat, double lng, double trk, double spd,
+int logPlane(struct Plane buf[], int bufsize, int icao, uint64_t call,
+	int cat, double lat, double lng, double trk, double spd,
 	int alt, int vert, enum PlaneFlags fl)
+{
+	return logPlaneAt(buf, bufsize, icao, call, cat, lat, lng, trk, spd,
+		alt, vert, fl, time(NULL));
+}
+
+int logPlaneAt(struct Plane buf[], int bufsize, int icao, uint64_t call,
+	int cat, double lat, double lng, double trk, double spd,
+	int alt, int vert, enum PlaneFlags fl, time_t now)
 {
 	int i, oldest = 0;
-	time_t now;
+	unsigned int seq;
 	time_t diff, grtDiff = 0;
 
-	time(&now);
 	for(i = 0;i < bufsize;i++)
 	{
 		if(buf[i].pflags & ICAOFL)
@@ -48,6 +75,11 @@ void logPlane(struct Plane buf[], int bufsize, int icao, char call[9],
 		}
 	}
 
+	//odd while the slot is being changed, see readPlanes
+	seq = buf[oldest].seq;
+	__atomic_store_n(&buf[oldest].seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
 	if(buf[oldest].icao == icao)
 		buf[oldest].pflags |= fl;
 	else
@@ -61,8 +93,8 @@ void logPlane(struct Plane buf[], int bufsize, int icao, char call[9],
 
 	if(fl & IDENTVALID)
 	{
-		strcpy(buf[oldest].call, call);
-		strcpy(buf[oldest].type, type);
+		buf[oldest].call = call;
+		buf[oldest].cat = (uint8_t)cat;
 	}
 	if(fl & POSVALID)
 	{
@@ -86,25 +118,146 @@ void logPlane(struct Plane buf[], int bufsize, int icao, char call[9],
 	{
 		buf[oldest].vert = vert;
 	}
+	__atomic_store_n(&buf[oldest].seq, seq + 2, __ATOMIC_RELEASE);
+
+	//a replaced plane can lose its position as well as move
+	if(planeGrid != NULL && planeGrid->buf == buf)
+		updateGrid(planeGrid, oldest);
+	if(planeArchive != NULL && planeArchiveBuf == buf && (fl & POSVALID))
+		archivePlane(planeArchive, &buf[oldest], now);
+
+	return oldest;
+}
+
+int logEvent(struct Plane buf[], int bufsize, const struct AdsbEvent *ev,
+	time_t now)
+{
+	int i;
+
+	if(ev->fl)
+		return logPlaneAt(buf, bufsize, ev->icao, ev->call, ev->cat,
+			ev->lat, ev->lng, ev->trk, ev->spd, ev->alt, ev->vert,
+			ev->fl, now);
+	//slots fill from the front and are never emptied
+	for(i = 0;i < bufsize && (buf[i].pflags & ICAOFL);i++)
+		if(buf[i].icao == ev->icao)
+			return i;
+	return -1;
+}
+
+void readPlanes(const struct Plane buf[], struct Plane out[], int bufsize)
+{
+	unsigned int seq;
+	int i;
+
+	for(i = 0;i < bufsize;i++)
+	{
+		//copy again if logPlane was in the middle of it or got to it
+		do
+		{
+			seq = __atomic_load_n(&buf[i].seq, __ATOMIC_ACQUIRE);
+			memcpy(&out[i], &buf[i], sizeof(struct Plane));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		} while((seq & 1) ||
+			__atomic_load_n(&buf[i].seq, __ATOMIC_RELAXED) != seq);
+	}
+	return;
+}
+
+void storePlane(struct Plane buf[], int slot, const struct Plane *p)
+{
+	struct Plane *b = &buf[slot];
+	unsigned int seq;
+	int moved;
+
+	moved = (p->pflags & POSVALID) && (b->icao != p->icao ||
+		!(b->pflags & POSVALID) || b->lat != p->lat || b->lng != p->lng);
+
+	seq = b->seq;
+	__atomic_store_n(&b->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(b, p, offsetof(struct Plane, seq));
+	__atomic_store_n(&b->seq, seq + 2, __ATOMIC_RELEASE);
+
+	if(planeGrid != NULL && planeGrid->buf == buf)
+		updateGrid(planeGrid, slot);
+	if(planeArchive != NULL && planeArchiveBuf == buf && moved)
+		archivePlane(planeArchive, b, b->lstUpd);
+	return;
+}
+
+//localtime shares one result between threads, the map has its own
+static void localTime(const time_t *t, struct tm *out)
+{
+#ifndef UCRT
+	localtime_r(t, out);
+#else
+	localtime_s(out, t);
+#endif
+	return;
+}
+
+void attachGrid(struct PlaneGrid *g)
+{
+	planeGrid = g;
+	return;
+}
+
+void attachArchive(struct Archive *a, const struct Plane buf[])
+{
+	planeArchive = a;
+	planeArchiveBuf = a != NULL ? buf : NULL;
+	return;
+}
 
+void attachStats(const struct PlaneStats *s)
+{
+	planeStats = s;
+	return;
+}
+
+/*
+	formatReception
+	Writes the message rate and mean level of slot i into rate and
+	rssi, "-" for what isn't known.
+*/
+static void formatReception(const struct Plane *pl, int i, time_t now,
+	char rate[7], char rssi[7])
+{
+	const struct PlaneStats *s;
+
+	strcpy(rate, "-");
+	strcpy(rssi, "-");
+	if(planeStats == NULL || planeStats[i].icao != pl->icao)
+		return;
+	s = &planeStats[i];
+	snprintf(rate, 7, "%.1f", messageRate(s, now));
+	if(s->levels > 0)
+		snprintf(rssi, 7, "%.1f",
+			levelDb((unsigned int)(s->levelSum / s->levels)));
 	return;
 }
 
 /*
 	formatDisplay
 	helper function for updating display and logging to file
+	The text is taken from the thread's arena (alloc.h).
 */
 static char *formatDisplay(const struct Plane buf[], int bufsize)
 {
 	int i;
-	struct tm *ltime;
-	char *disp, temp[LINEWIDTH], icao[7], call[9], type[7], lat[9], lng[9],
-		trk[7], spd[7], alt[7], vert[7], timestr[9];
-	disp = (char*)malloc(sizeof(char) * (LINEWIDTH*(bufsize+1)+2));
-
-	sprintf(temp, "%6s %8s %6s %8s %8s %6s %6s %6s %6s %8s\n",
+	struct tm ltime;
+	char *disp, temp[LINEWIDTH + 1], icao[7], call[9], type[7], lat[9],
+		lng[9], trk[7], spd[7], alt[7], vert[7], timestr[9], rate[7],
+		rssi[7];
+	time_t now = time(NULL);
+	disp = arenaAlloc(threadArena(), LINEWIDTH*(bufsize+1)+2);
+	if(disp == NULL)
+		return NULL;
+
+	sprintf(temp, "%6s %8s %6s %8s %8s %6s %6s %6s %6s %8s %5s %5s\n",
 		"ICAO", "CALLSIGN", "TYPE", "LATITUDE", "LNGITUDE", "TRACK",
-		"SPEED", "ALT", "CLIMB", "TIME");
+		"SPEED", "ALT", "CLIMB", "TIME", "MSG/S", "RSSI");
 	memcpy((void*)disp, temp, LINEWIDTH);
 
 	for(i = 0;i < bufsize;i++)
@@ -117,9 +270,9 @@ static char *formatDisplay(const struct Plane buf[], int bufsize)
 			break;
 		if(buf[i].pflags & IDENTVALID)
 		{
-			//sprintf to remove trailing spaces in call
-			sscanf(buf[i].call, "%s", call);
-			strcpy(type, buf[i].type);
+			//without trailing spaces
+			call[expandCall(buf[i].call, call)] = 0;
+			strcpy(type, planeType(buf[i].cat));
 		}
 		else
 		{
@@ -161,16 +314,16 @@ static char *formatDisplay(const struct Plane buf[], int bufsize)
 		else
 			strcpy(vert, "UNOWEN");
 
-		//WARNING: MIGHT NEED TO USE LOCK AROUND localtime
-		//IF createImage IS RUNNING IN SEP THREAD
-		ltime = localtime(&buf[i].lstUpd);
+		localTime(&buf[i].lstUpd, &ltime);
 		sprintf(timestr, "%.2d:%.2d:%.2d",
-			ltime->tm_hour, ltime->tm_min, ltime->tm_sec);
+			ltime.tm_hour, ltime.tm_min, ltime.tm_sec);
 
-		//79 chars total per line
-		sprintf(temp, "%6s %8s %6s %8s %8s %6s %6s %6s %6s %8s\n",
-			icao, call, type, lat, lng, trk, spd, alt, vert,
-			timestr);
+		formatReception(&buf[i], i, now, rate, rssi);
+
+		//LINEWIDTH chars per line, with the newline
+		sprintf(temp, "%6s %8s %6s %8s %8s %6s %6s %6s %6s %8s %5.5s "
+			"%5.5s\n", icao, call, type, lat, lng, trk, spd, alt,
+			vert, timestr, rate, rssi);
 		memcpy((void*)disp + LINEWIDTH*(i+1), temp, LINEWIDTH);
 	}
 	disp[LINEWIDTH*(i+1)] = '\n';	//extra newline for easier reading
@@ -180,18 +333,78 @@ static char *formatDisplay(const struct Plane buf[], int bufsize)
 
 void updateDisplay(const struct Plane buf[], int bufsize)
 {
+	struct Arena *a = threadArena();
+	size_t mark = arenaMark(a);
 	char *disp;
+
 	disp = formatDisplay(buf, bufsize);
-	printf(disp);
-	free(disp);
+	if(disp != NULL)
+		fputs(disp, stdout);
+	arenaRelease(a, mark);
 	return;
 }
 
-void logToFile(const struct Plane buf[], int bufsize, FILE *save)
+//one line of the -s log for slot i, returns its length
+static int formatLogLine(char *p, const struct Plane *pl, int i, time_t now)
+{
+	const struct PlaneStats *s;
+
+	int n;
+
+	n = sprintf(p, "%.6X,", pl->icao);
+	if(pl->pflags & IDENTVALID)
+	{
+		//trailing spaces are left past n, and written over
+		n += expandCall(pl->call, p + n);
+		n += sprintf(p + n, ",%s,", planeType(pl->cat));
+	}
+	else
+		n += sprintf(p + n, ",,");
+	if(pl->pflags & POSVALID)
+		n += sprintf(p + n, "%f,%f,", pl->lat, pl->lng);
+	else
+		n += sprintf(p + n, ",,");
+	if(pl->pflags & TRKVALID)
+		n += sprintf(p + n, "%f,", pl->trk);
+	else
+		p[n++] = ',';
+	if(pl->pflags & SPDVALID)
+		n += sprintf(p + n, "%f,", pl->spd);
+	else
+		p[n++] = ',';
+	if(pl->pflags & ALTVALID)
+		n += sprintf(p + n, "%d,", pl->alt);
+	else
+		p[n++] = ',';
+	if(pl->pflags & VERTVALID)
+		n += sprintf(p + n, "%d,", pl->vert);
+	else
+		p[n++] = ',';
+	n += sprintf(p + n, "%zd", pl->lstUpd);
+	//messages, messages a second and mean dBFS, after the rest so
+	//the columns before don't move
+	if(planeStats != NULL)
+	{
+		s = &planeStats[i];
+		if(s->icao == pl->icao)
+			n += sprintf(p + n, ",%lu,%.1f,", totalMessages(s),
+				messageRate(s, now));
+		else
+			n += sprintf(p + n, ",,,");
+		if(s->icao == pl->icao && s->levels > 0)
+			n += sprintf(p + n, "%.1f", levelDb((unsigned int)
+				(s->levelSum / s->levels)));
+	}
+	p[n++] = '\n';
+	return n;
+}
+
+void logToFile(const struct Plane buf[], int bufsize,
+	struct OutputWriter *save)
 {
 	int i;
-	char call[9];	//temp buffer
 	static time_t lastLog = 0;
+	time_t now = time(NULL);
 	if(save == NULL)
 		return;
 	//log in the file plane data
@@ -201,63 +414,26 @@ void logToFile(const struct Plane buf[], int bufsize, FILE *save)
 		//since the last time it's been logged
 		if(buf[i].lstUpd < lastLog)
 			continue;
-
-		if(buf[i].pflags & ICAOFL)
-			fprintf(save, "%.6X,", buf[i].icao);
-		else
+		if((buf[i].pflags & ICAOFL) == 0)
 			break;
-		if(buf[i].pflags & IDENTVALID)
-		{
-			sscanf(buf[i].call, "%s", call);
-			fprintf(save, "%s,%s,", call, buf[i].type);
-		}
-		else
-			fprintf(save, ",,");
-		if(buf[i].pflags & POSVALID)
-		{
-			fprintf(save, "%f,%f,", buf[i].lat, buf[i].lng);
-		}
-		else
-			fprintf(save, ",,");
-		if(buf[i].pflags & TRKVALID)
-		{
-			fprintf(save, "%f,", buf[i].trk);
-		}
-		else
-			fputc(',', save);
-		if(buf[i].pflags & SPDVALID)
-		{
-			fprintf(save, "%f,", buf[i].spd);
-		}
-		else
-			fputc(',', save);
-		if(buf[i].pflags & ALTVALID)
-		{
-			fprintf(save, "%d,", buf[i].alt);
-		}
-		else
-			fputc(',', save);
-		if(buf[i].pflags & VERTVALID)
-		{
-			fprintf(save, "%d,", buf[i].vert);
-		}
-		else
-			fputc(',', save);
-		fprintf(save, "%zd\n", buf[i].lstUpd);
+		commitOutput(save, formatLogLine(reserveOutput(save), &buf[i], i,
+			now));
 	}
-	time(&lastLog);
+	lastLog = now;
 	return;
 }
 
 int readLog(FILE *log, struct Plane **planes)
 {
-	struct Plane *buf;
-	int i, j;
+	struct Plane *buf, *grown;
+	char call[9], type[7];
+	int i, j = 0, cap = 100;
 	if(log == NULL)
 		return 0;
-	buf = malloc(sizeof(struct Plane) * 100);
+	//zeroed so the flags and seq start clear
+	buf = calloc(cap, sizeof(struct Plane));
 	i = 0;
-	while(1)
+	while(buf != NULL)
 	{
 		for(j = 0;j < 100;j++)
 		{
@@ -265,15 +441,19 @@ int readLog(FILE *log, struct Plane **planes)
 				goto EXIT_READLOG;
 			buf[i*100+j].pflags |= ICAOFL;
 
-			if(fscanf(log, "%8[A-Z0-9],%6[A-Z],",
-				buf[i*100+j].call, buf[i*100+j].type))
+			type[0] = 0;
+			if(fscanf(log, "%8[A-Z0-9],%6[A-Z0-9],", call, type))
+			{
+				packCall(call, &buf[i*100+j].call);
+				buf[i*100+j].cat = (uint8_t)planeCategory(type);
 				buf[i*100+j].pflags |= IDENTVALID;
+			}
 			else
 			{	//get rid of spare commas
 				getc(log);
 				getc(log);
 			}
-			if(fscanf(log, "%f,%f,",
+			if(fscanf(log, "%lf,%lf,",
 				&buf[i*100+j].lat, &buf[i*100+j].lng))
 				buf[i*100+j].pflags |= POSVALID;
 			else
@@ -281,11 +461,11 @@ int readLog(FILE *log, struct Plane **planes)
 				getc(log);
 				getc(log);
 			}
-			if(fscanf(log, "%f,", &buf[i*100+j].trk))
+			if(fscanf(log, "%lf,", &buf[i*100+j].trk))
 				buf[i*100+j].pflags |= TRKVALID;
 			else
 				getc(log);
-			if(fscanf(log, "%f,", &buf[i*100+j].spd))
+			if(fscanf(log, "%lf,", &buf[i*100+j].spd))
 				buf[i*100+j].pflags |= SPDVALID;
 			else
 				getc(log);
@@ -298,9 +478,23 @@ int readLog(FILE *log, struct Plane **planes)
 			else
 				getc(log);
 			fscanf(log, "%zd", &buf[i*100+j].lstUpd);
+			//reception stats, if the log has them
+			fscanf(log, "%*[^\n]");
 		}
 		i++;
-		buf = realloc(buf, sizeof(struct Plane) * (i+1) * 100);
+		//doubled so a long log isn't copied every 100 planes
+		if((i+1) * 100 > cap)
+		{
+			grown = realloc(buf, sizeof(struct Plane) * cap * 2);
+			if(grown == NULL)
+			{
+				j = 0;	//what is read so far is all there is
+				break;
+			}
+			buf = grown;
+			memset(buf + cap, 0, sizeof(struct Plane) * cap);
+			cap *= 2;
+		}
 	}
 	EXIT_READLOG:
 	*planes = buf;
@@ -321,63 +515,135 @@ MAP_FRAME_TYPE inside PS_CONVERT A,Dmaps"
 #define SYMBOLSETTINGS "-W -Sd1i -V"
 #define LINESETTINGS "-Wthinnest"
 #define TEXTSETTINGS ""
+#define CPTFILE "GMT_PlanePlot.cpt"
+#define BASEMAPFILE "GMT_PlanePlot_base.ps"
+//projection for the map, centered on rlng rlat
+#define PROJECTION "-R-30/30/-30/30+un -JL%f/%f/33/45/6i"
+
+//cached basemap layer, and what it was drawn for
+static char *basemap = NULL;
+static size_t basemapLen = 0;
+static double basemapLat, basemapLng;
+static char mapProj[100];
+
+/*
+	drawBasemap
+	Returns 0 if the cached basemap can be used.
+
+	The coast, map scale and colorbar never change unless rlat, rlng,
+	or the projection do, so they are drawn once into an open
+	(-K) PostScript layer and kept in memory.
+	Every frame starts as a copy of it and only the planes get drawn
+	on top, which skips pscoast (the slow part) completely.
+*/
+static int drawBasemap(void)
+{
+	char proj[100];
+	char coastOpts[300];
+	FILE *f;
+	long len;
+
+	sprintf(proj, PROJECTION, rlng, rlat);
+	if(basemap != NULL && basemapLat == rlat && basemapLng == rlng &&
+		strcmp(proj, mapProj) == 0)
+		return 0;
+
+	strcpy(mapProj, proj);
+	basemapLat = rlat;
+	basemapLng = rlng;
+	free(basemap);
+	basemap = NULL;
+
+	//draw coast and map scale
+	sprintf(coastOpts, "%s "
+		"-Gtomato -Sdeepskyblue -Ia/deepskyblue "
+		"-Ln.9/.1+w5n+c%f/%f+f+l\"nm\" "
+		"-Bpa5mf1mg5m -Bsa15mf5mg15m -BWeSn -K ->" BASEMAPFILE,
+		mapProj, rlng, rlat);
+	GMT_Call_Module(API, "pscoast", 0, (void*)coastOpts);
+	//must set frame to plain for colorbar to print correctly
+	//only for this module so gmt.conf stays the same between frames
+	sprintf(coastOpts, "%s -C" CPTFILE " -DjMR+w3i -Bxa -By+l\"ft\" "
+		"--MAP_FRAME_TYPE=plain --FONT_ANNOT_PRIMARY=8p "
+		"-O -K ->>" BASEMAPFILE, mapProj);
+	GMT_Call_Module(API, "psscale", 0, (void*)coastOpts);
+
+	f = fopen(BASEMAPFILE, "rb");
+	if(f == NULL)
+		return -1;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if(len > 0 && (basemap = malloc(len)) != NULL)
+		basemapLen = fread(basemap, 1, len, f);
+	fclose(f);
+	return basemap == NULL ? -1 : 0;
+}
 
 void createImage(const struct Plane buf[], int bufsize)
 {
 	//self explanatory options
-	static char coastOpts[200];
-	char beginOpts[50];
-	char symbolOpts[50];
-	char lineOpts[50];
-	char textOpts[50];
+	char frameName[50];
+	char symbolOpts[200];
+	char lineOpts[200];
+	char textOpts[200];
+	char convertOpts[100];
+	FILE *frame;
 	//plane dataset
 	struct GMT_DATASET *planeData;
 	//param list for plane dataset
-	uint64_t params[3];
+	uint64_t params[4];
 	//virtual file
 	char plane_vfile[GMT_VF_LEN];
 	//loop iterators and row/col amounts per segment
 	int i, j, icaoCnt = 0;
-	int icaoList[bufsize];
-	int icaoMent[bufsize];
+	//from the map thread's arena, not the stack, caches can be big
+	struct Arena *a = threadArena();
+	size_t mark = arenaMark(a);
+	int *icaoList, *icaoMent;
 	//used to make lines shorter, could be replaced with #define
 	register struct GMT_DATASEGMENT *S;
 	//gets the broken down time for each point
 	struct tm *pntTime;
 
+	icaoList = arenaAlloc(a, sizeof(int) * bufsize);
+	icaoMent = arenaAlloc(a, sizeof(int) * bufsize);
+	if(icaoList == NULL || icaoMent == NULL)
+		goto done;
 	for(i = 0;i < bufsize;i++)
 		icaoList[i] = 0;
 	//first run of create image creates API
-	//and sets coastOpts
+	//and does all the setup that is the same for every frame.
+	//The session is kept for every later frame.
 	if(API == NULL)
 	{
-		API = GMT_Create_Session("GMT_PlanePlot", 2, GMT_SESSION_RUNMODE, NULL);
-		//set map projection settings including centering on rlng rlat
-		sprintf(coastOpts, "-R-30/30/-30/30+un -JL%f/%f/33/45/6i "
-			"-Gtomato -Sdeepskyblue -Ia/deepskyblue "
-			"-Ln.9/.1+w5n+c%f/%f+f+l\"nm\" "
-			"-Bpa5mf1mg5m -Bsa15mf5mg15m -BWeSn",
-			rlng, rlat, rlng, rlat);
+		API = GMT_Create_Session("GMT_PlanePlot", 2, GMT_SESSION_NORMAL, NULL);
+		//classic mode (no begin/end) so layers can be overlaid with -K -O
+		//settings go in gmt.conf so every module picks them up
+		GMT_Call_Module(API, "gmtset", 0, (void*)GMTSETTINGS);
+		//CPT goes to a file so it is only made once
+		GMT_Call_Module(API, "makecpt", 0,
+			(void*)"-Cgeo -T0/50000 ->" CPTFILE);
 	}
 
-	//make sure file name is unique so files aren't overwritten
-	sprintf(beginOpts, "GMT_PlanePlot%zd", time(NULL));
-	GMT_Call_Module(API, "begin", 0, (void*)beginOpts);
-	GMT_Call_Module(API, "set", 0, (void*)GMTSETTINGS);
-
-	//make CPT
-	GMT_Call_Module(API, "makecpt", 0, (void*)"-Cgeo -T0/50000");
-
 	//for debugging gmt config settings
 	//GMT_Call_Module(API, "defaults", 0, NULL);
 
-	//draw coast, colorbar, and map scale
-	GMT_Call_Module(API, "coast", 0, (void*)coastOpts);
-	//must set frame to plain for colorbar to print correctly
-	GMT_Call_Module(API, "set", 0, (void*)"MAP_FRAME_TYPE plain "
-		"FONT_ANNOT_PRIMARY 8p");
-	GMT_Call_Module(API, "colorbar", 0,
-		(void*)"-DjMR+w3i -Bxa -By+l\"ft\"");
+	//coast, colorbar, and map scale are only redrawn if they changed
+	if(drawBasemap())
+	{
+		printf("could not draw basemap\n");
+		goto done;
+	}
+
+	//make sure file name is unique so files aren't overwritten
+	//frame starts as a copy of the basemap layer
+	sprintf(frameName, "GMT_PlanePlot%zd.ps", time(NULL));
+	frame = fopen(frameName, "wb");
+	if(frame == NULL)
+		goto done;
+	fwrite(basemap, 1, basemapLen, frame);
+	fclose(frame);
 
 	//Figure out amount of data segments
 	//(different airplane paths to be drawn)
@@ -449,8 +715,8 @@ void createImage(const struct Plane buf[], int bufsize)
 				else
 					S->data[2][icaoMent[j]] = 50000;
 				/*
-				//TODO: set up lock around localtime
-				//if createImage is in sep thread
+				//use localTime if this comes back,
+				//localtime isn't safe on the map thread
 				pntTime = localtime(&buf[i].lstUpd);
 				//string is length of icao code + timestamp + 1
 				S->text[j] = malloc(sizeof(char) * 16);
@@ -468,17 +734,24 @@ void createImage(const struct Plane buf[], int bufsize)
 		GMT_IN, planeData, plane_vfile);
 
 	//make sure vfile name is in options for plotting
-	sprintf(lineOpts, "%s " LINESETTINGS, plane_vfile);
-	sprintf(symbolOpts, "%s " SYMBOLSETTINGS, plane_vfile);
-	sprintf(textOpts, "%s " TEXTSETTINGS, plane_vfile);
-
-	//plot lines, then symbols, then text
-	GMT_Call_Module(API, "plot", 0, (void*)lineOpts);
-	//GMT_Call_Module(API, "plot", 0, (void*)symbolOpts);
-	//GMT_Call_Module(API, "plot", 0, (void*)textOpts);
-
-	//end module creates map
-	GMT_Call_Module(API, "end", 0, NULL);
+	//plane layer is appended on top of the basemap copy,
+	//the last layer drawn leaves out -K to close the PostScript
+	sprintf(lineOpts, "%s %s " LINESETTINGS " -O ->>%s",
+		plane_vfile, mapProj, frameName);
+	sprintf(symbolOpts, "%s %s " SYMBOLSETTINGS " -O -K ->>%s",
+		plane_vfile, mapProj, frameName);
+	sprintf(textOpts, "%s %s " TEXTSETTINGS " -O -K ->>%s",
+		plane_vfile, mapProj, frameName);
+
+	//plot symbols, then text, then lines
+	//GMT_Call_Module(API, "psxy", 0, (void*)symbolOpts);
+	//GMT_Call_Module(API, "pstext", 0, (void*)textOpts);
+	GMT_Call_Module(API, "psxy", 0, (void*)lineOpts);
+
+	//psconvert creates map, same as PS_CONVERT did in modern mode
+	sprintf(convertOpts, "%s -A -Tg -Dmaps", frameName);
+	GMT_Call_Module(API, "psconvert", 0, (void*)convertOpts);
+	remove(frameName);
 	//destroy data to prevent memory leak
 	//vfile must be closed before planeData destroyed
 	GMT_Close_VirtualFile(API, plane_vfile);
@@ -492,16 +765,107 @@ void createImage(const struct Plane buf[], int bufsize)
 	//destroy GMT allocated data
 	if(GMT_Destroy_Data(API, &planeData))
 		printf("error destroying planeData\n");
+done:
+	arenaRelease(a, mark);
+	return;
+}
+
+/*
+	mapWorker
+	Draws the newest pending snapshot until told to stop.
+	If requests come in faster than GMT can draw, the snapshots
+	in between are overwritten and never drawn.
+*/
+static void *mapWorker(void *arg)
+{
+	struct Plane *tmp;
+
+	pthread_mutex_lock(&mapLock);
+	while(1)
+	{
+		while(!mapPending && !mapStop)
+			pthread_cond_wait(&mapCond, &mapLock);
+		//draw whatever is left before stopping
+		if(!mapPending)
+			break;
+		tmp = mapBufs[2];
+		mapBufs[2] = mapBufs[1];
+		mapBufs[1] = tmp;
+		mapPending = 0;
+		pthread_mutex_unlock(&mapLock);
+
+		createImage(mapBufs[2], mapSize);
+
+		pthread_mutex_lock(&mapLock);
+	}
+	pthread_mutex_unlock(&mapLock);
+	freeArena(threadArena());
+	return NULL;
+}
+
+void requestImage(const struct Plane buf[], int bufsize)
+{
+	struct Plane *tmp;
+	int i;
+
+	if(!mapRunning)
+	{
+		mapSize = bufsize;
+		for(i = 0;i < 3;i++)
+			mapBufs[i] = calloc(bufsize, sizeof(struct Plane));
+		mapStop = 0;
+		if(pthread_create(&mapThread, NULL, mapWorker, NULL))
+		{
+			printf("could not start map worker\n");
+			return;
+		}
+		mapRunning = 1;
+	}
+	if(bufsize > mapSize)
+		bufsize = mapSize;
+
+	//copy outside the lock, the worker never touches mapBufs[0]
+	readPlanes(buf, mapBufs[0], bufsize);
+
+	pthread_mutex_lock(&mapLock);
+	tmp = mapBufs[1];
+	mapBufs[1] = mapBufs[0];
+	mapBufs[0] = tmp;
+	if(mapPending)
+		mapCoalesced++;
+	mapPending = 1;
+	pthread_cond_signal(&mapCond);
+	pthread_mutex_unlock(&mapLock);
 	return;
 }
 
 void endGMTSession()
 {
+	int i;
+
+	if(mapRunning)
+	{
+		pthread_mutex_lock(&mapLock);
+		mapStop = 1;
+		pthread_cond_signal(&mapCond);
+		pthread_mutex_unlock(&mapLock);
+		pthread_join(mapThread, NULL);
+		mapRunning = 0;
+		for(i = 0;i < 3;i++)
+			free(mapBufs[i]);
+		if(mapCoalesced)
+			printf("%lu map requests skipped while drawing\n",
+				mapCoalesced);
+	}
+
 	//TODO: free dataset
 	//destroying session might free it, but we should also free
 	//related plane list we will create.
 	if(API != NULL)
 		GMT_Destroy_Session(API);
+	API = NULL;
+	free(basemap);
+	basemap = NULL;
 	return;
 }
 #endif
@@ -1,5 +1,7 @@
 #pragma once
+#include <stdio.h>
 #include <time.h>
+#include "decode.h"
 
 /*
 	LOGGER.H
@@ -13,30 +15,18 @@
 
 /*
 	enum PlaneFlags
-	I created this enum to make it very easy to log plane data.
-	I can call log and submit every local plane value, even if invalid.
-	The function will only update those with valid flags.
-
-	Then the function will make Plane.pflags |= flags.
-
-	When a new plane replaces and old one the pflags are wiped and
-	we don't need to wipe all the data values.
-	Only reason calloc is used in main is so I don't have to individually
-	wipe pflags at start.
+	Lives in decode.h now since decoded events carry the same flags.
 */
 
 extern int changeTimeOnPosition;
 extern double rlat, rlng;
 
-enum PlaneFlags {ICAOFL=1, IDENTVALID=2, POSVALID=4, TRKVALID=8,
-	SPDVALID=16, ALTVALID=32, VERTVALID=64, IASFL=128, BARFL=256};
-
 struct Plane
 {
 	//identificaton info
 	int icao;
-	char call[9];
-	char type[8];
+	uint8_t cat;		//aircraft category, see planeType
+	uint64_t call;		//packed call sign, see expandCall
 
 	//positional data
 	double lat, lng, trk, spd;
@@ -48,6 +38,10 @@ struct Plane
 
 	//planeflags used for displaying data
 	enum PlaneFlags pflags;
+
+	//bumped before and after logPlane changes the plane,
+	//odd while it is being changed
+	unsigned int seq;
 };
 
 /*
@@ -58,11 +52,79 @@ struct Plane
 
 	This function also will automatically delete the oldest plane and
 	replace it with the newest plane if the buffer is full.
+
+	Returns the slot of buf the plane is in.
 */
-void logPlane(struct Plane buf[], int bufsize, int icao, char call[9],
-	char type[8], double lat, double lng, double trk, double spd,
+int logPlane(struct Plane buf[], int bufsize, int icao, uint64_t call,
+	int cat, double lat, double lng, double trk, double spd,
 	int alt, int vert, enum PlaneFlags fl);
 
+/*
+	logPlaneAt
+	logPlane for an update that happened at now, for replays.
+*/
+int logPlaneAt(struct Plane buf[], int bufsize, int icao, uint64_t call,
+	int cat, double lat, double lng, double trk, double spd,
+	int alt, int vert, enum PlaneFlags fl, time_t now);
+
+/*
+	logEvent
+	Returns the slot of the plane ev is from, -1 if it isn't in buf.
+	logPlaneAt for a decoded event. Status reports (ev->fl == 0) don't
+	change anything, they are only looked up.
+*/
+int logEvent(struct Plane buf[], int bufsize, const struct AdsbEvent *ev,
+	time_t now);
+
+/*
+	readPlanes
+	Copies bufsize planes from buf to out, each one as it was between
+	two logPlane calls, for reading the cache from another thread.
+
+	Lock free, logPlane never waits for readers. A plane that changes
+	while it is being copied is just copied again. Each plane is
+	consistent on its own, two planes can be from different updates.
+	The thread calling logPlane can read buf directly.
+*/
+void readPlanes(const struct Plane buf[], struct Plane out[], int bufsize);
+
+/*
+	storePlane
+	Copies p (all but its seq) into slot of buf, the way logPlane
+	changes a slot, so readers and the attached grid and archive see
+	it like any other update. The archive only gets it if the
+	position changed.
+	For caches filled from somewhere else, like the shards (shard.h).
+*/
+void storePlane(struct Plane buf[], int slot, const struct Plane *p);
+
+/*
+	attachGrid
+	Makes logPlane keep a spatial index (grid.h) up to date with
+	whatever it changes in the grid's buffer. NULL detaches it.
+*/
+struct PlaneGrid;
+void attachGrid(struct PlaneGrid *g);
+
+/*
+	attachArchive
+	Makes logPlane and storePlane add every position update in buf
+	to an archive (archive.h). Other buffers, like the ones the
+	shards log into, are left out, the archive has one writer.
+	NULL detaches it.
+*/
+struct Archive;
+void attachArchive(struct Archive *a, const struct Plane buf[]);
+
+/*
+	attachStats
+	Makes updateDisplay and logToFile show each plane's message rate
+	and signal level (stats.h), from an entry per slot of the buffer
+	they are given. NULL detaches it.
+*/
+struct PlaneStats;
+void attachStats(const struct PlaneStats *s);
+
 /*
 	updateDisplay
 	This function will print out all the planes being tracked.
@@ -74,10 +136,13 @@ void updateDisplay(const struct Plane buf[], int bufsize);
 
 /*
 	logToFile
-	Same thing as updateDisplay but to a file
-	They will probably run the same helper function.
+	Same thing as updateDisplay but to a file, as CSV lines.
+	Only formats into save's buffers, the writing is done on save's
+	own thread (see output.h).
 */
-void logToFile(const struct Plane buf[], int bufsize, FILE *save);
+struct OutputWriter;
+void logToFile(const struct Plane buf[], int bufsize,
+	struct OutputWriter *save);
 
 /*
 	readLog
@@ -103,15 +168,34 @@ int readLog(FILE *log, struct Plane **planes);
 	The Plane data can be the instantaneous data or a collection of
 	data from the past (although duplicates should be removed).
 
-	localtime may potentially be used at the same time as updateDisplay
-	if they are running on seperate threads. Keep this in mind if adding
-	multithreading.
+	The GMT session, CPT and settings are made on the first run
+	and reused after. The coast, scale and colorbar are drawn into a
+	cached basemap layer which is only redrawn when rlat/rlng or the
+	projection change, so each call only draws the planes on top.
+
+	Through requestImage this runs on the map thread,
+	drawing a copy of the planes made with readPlanes.
+
+	This blocks until GMT is done, use requestImage from the decode loop.
 */
 void createImage(const struct Plane buf[], const int bufsize);
 
+/*
+	requestImage
+	Copies the planes and hands the copy to a map worker thread,
+	which calls createImage on it. Starts the worker on first call.
+
+	Never waits on GMT. If the worker is still drawing the last map
+	only the newest request is kept, so it never falls further behind
+	than one map.
+	bufsize should be the same every call.
+*/
+void requestImage(const struct Plane buf[], int bufsize);
+
 /*
 	endGMTSession
-	print out plot in final output format(s) and exit
+	Waits for the map worker to draw its last request,
+	then print out plot in final output format(s) and exit
 */
 void endGMTSession();
 #endif
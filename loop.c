@@ -0,0 +1,140 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef UCRT
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#endif
+
+#include "loop.h"
+
+#ifndef UCRT
+static void stopSignals(sigset_t *set)
+{
+	sigemptyset(set);
+	sigaddset(set, SIGINT);
+	sigaddset(set, SIGTERM);
+	sigaddset(set, SIGHUP);
+	return;
+}
+
+int openLoop(struct EventLoop *l)
+{
+	struct itimerspec tick;
+	sigset_t set;
+
+	l->timer = l->signals = -1;
+	stopSignals(&set);
+	if(pthread_sigmask(SIG_BLOCK, &set, NULL))
+		return -1;
+	l->signals = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+	l->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	memset(&tick, 0, sizeof(tick));
+	tick.it_interval.tv_sec = tick.it_value.tv_sec = LOOP_TICK;
+	if(l->signals < 0 || l->timer < 0 ||
+		timerfd_settime(l->timer, 0, &tick, NULL))
+	{
+		closeLoop(l);
+		return -1;
+	}
+	return 0;
+}
+
+int waitLoop(struct EventLoop *l, int fd)
+{
+	struct pollfd fds[3];
+	struct signalfd_siginfo info;
+	uint64_t ticks;
+	int ev = 0;
+
+	fds[0].fd = fd;
+	fds[1].fd = l->timer;
+	fds[2].fd = l->signals;
+	fds[0].events = fds[1].events = fds[2].events = POLLIN;
+	while(poll(fds, 3, -1) < 0)
+		if(errno != EINTR)
+			return -1;
+
+	//a closed pipe or a hung up terminal reads as the end
+	if(fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+		ev |= LOOP_INPUT;
+	if((fds[1].revents & POLLIN) &&
+		read(l->timer, &ticks, sizeof(ticks)) == sizeof(ticks))
+		ev |= LOOP_TIMER;
+	if(fds[2].revents & POLLIN)
+		while(read(l->signals, &info, sizeof(info)) == sizeof(info))
+			ev |= LOOP_SIGNAL;
+	return ev;
+}
+
+void closeLoop(struct EventLoop *l)
+{
+	sigset_t set;
+
+	if(l->timer >= 0)
+		close(l->timer);
+	if(l->signals >= 0)
+		close(l->signals);
+	l->timer = l->signals = -1;
+	stopSignals(&set);
+	pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+	return;
+}
+#else
+//no timerfd or signalfd
+int openLoop(struct EventLoop *l)
+{
+	l->timer = l->signals = -1;
+	return -1;
+}
+
+int waitLoop(struct EventLoop *l, int fd)
+{
+	(void)l;
+	(void)fd;
+	return -1;
+}
+
+void closeLoop(struct EventLoop *l)
+{
+	(void)l;
+	return;
+}
+#endif
+
+long readLines(struct LineReader *r, int fd, LineFn fn, void *arg)
+{
+	char *p, *end, *nl;
+	long got;
+
+	do
+		got = (long)read(fd, r->buf + r->len, LOOP_READ);
+	while(got < 0 && errno == EINTR);
+	if(got < 0)
+		return -1;
+	if(got == 0)
+	{
+		if(r->len > 0)
+			fn(r->buf, r->len, arg);
+		r->len = 0;
+		return 0;
+	}
+
+	p = r->buf;
+	end = r->buf + r->len + got;
+	while((nl = memchr(p, '\n', (size_t)(end - p))) != NULL)
+	{
+		fn(p, (size_t)(nl - p), arg);
+		p = nl + 1;
+	}
+	//whatever is too long to be a message doesn't need keeping
+	r->len = (size_t)(end - p);
+	if(r->len > LOOP_LINE)
+		r->len = LOOP_LINE;
+	memmove(r->buf, p, r->len);
+	return got;
+}
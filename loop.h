@@ -0,0 +1,70 @@
+#pragma once
+#include <stddef.h>
+
+/*
+	LOOP.H
+	What the live -p loop waits on: the input, a timer that ticks
+	every LOOP_TICK seconds, and SIGINT, SIGTERM and SIGHUP, all in
+	one poll. Periodic output runs on the ticks whether messages are
+	pouring in or the input has gone quiet, and nothing on the way
+	from a line of input to logPlane has to look at the clock.
+
+	Built on timerfd and signalfd, so Linux only, UCRT builds get -1
+	from openLoop and keep reading with stdio.
+*/
+
+#define LOOP_TICK 1		//seconds between timer ticks
+#define LOOP_READ 65536		//bytes read from the input at once
+#define LOOP_LINE 128		//longest line kept between reads
+
+enum LoopEvent {LOOP_INPUT = 1, LOOP_TIMER = 2, LOOP_SIGNAL = 4};
+
+struct EventLoop
+{
+	int timer, signals;	//timerfd and signalfd, -1 if not open
+};
+
+/*
+	openLoop
+	Returns 0 on success, -1 if the timer or signal fds can't be made.
+	Blocks the signals for the whole process, so it has to be called
+	before any threads are started, they keep the mask they start with.
+*/
+int openLoop(struct EventLoop *l);
+
+/*
+	waitLoop
+	Returns the LoopEvents that happened, or -1 if poll failed.
+	Waits until input can be read from fd (or it is at its end),
+	the timer ticks, or a signal comes. Ticks and signals are
+	taken off their fds, several missed ticks count as one.
+*/
+int waitLoop(struct EventLoop *l, int fd);
+
+/*
+	closeLoop
+	Closes the fds and unblocks the signals.
+*/
+void closeLoop(struct EventLoop *l);
+
+/*
+	LineReader
+	Whatever of the last line hasn't come yet.
+*/
+struct LineReader
+{
+	char buf[LOOP_READ + LOOP_LINE];
+	size_t len;
+};
+
+/*
+	readLines
+	Returns the amount of bytes read, 0 at the end of the input, or
+	-1 on a read error.
+	Reads what fd has, at most LOOP_READ bytes, and calls fn for every
+	line it finished (without the newline). A line cut off by the
+	end of the input is passed at the end, lines longer than
+	LOOP_LINE are cut short.
+*/
+typedef void (*LineFn)(const char *line, size_t len, void *arg);
+long readLines(struct LineReader *r, int fd, LineFn fn, void *arg);
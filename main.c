@@ -5,25 +5,69 @@
 #include <signal.h>
 #include <unistd.h>
 #include <time.h>
+#include <limits.h>
 #include "adsb.h"
 #include "decode.h"
 #include "logger.h"
+#include "grid.h"
+#include "bulk.h"
+#include "render.h"
+#include "json.h"
+#include "demod.h"
+#include "source.h"
+#include "query.h"
+#include "output.h"
+#include "archive.h"
+#include "stats.h"
+#include "shard.h"
+#include "loop.h"
+#include "alloc.h"
+
+#ifdef DEBUGALLOC
+#include <assert.h>
+#endif
 
 //Global settings
 int changeTimeOnPosition = 0;
 double rlat = 41.978611, rlng = -87.904722;	//O'Hare is default pos
 
+//built in map size, in pixels and nm from center to edge
+#define MAPSIZE 640
+#define MAPRANGE 60.
+
 //files needed by multiple functions
 static FILE *logstream = NULL;
-static FILE *savestream = NULL;
+static struct OutputWriter *savestream = NULL;
 
 //variable used to terminate program
 static volatile sig_atomic_t terminating = 0;
 
+//what messages are logged at, moved on once a block of input
+//or timer tick rather than read for every message
+static time_t clockNow;
+
 //settings needed by multiple functions
 static struct Plane *planes = NULL;
+static struct PlaneStats *stats = NULL;		//one per slot of planes
+static struct PlaneGrid grid;			//where the planes are
 int cache = 10;					//cache size for planes
 static int debug = 0;
+static struct ShardSet shards;			//decode workers, if -k
+
+//outputs that are updated while reading
+static char mapname[20], jsonname[20];
+static struct MapRender render;
+static struct JsonWriter json;
+static char queryname[108];
+static struct QueryServer query;
+static char archivename[20];
+static struct Archive archive;
+#ifdef MAPPING
+static int createImages = 0;
+#endif
+
+//dongle or emulator, file scope so the sample callback can stop it
+static struct SampleSource source;
 
 /*
 	termination
@@ -65,159 +109,252 @@ static void term_handler(int sig)
 	return;
 }*/
 
-static void handleMessage(const union AdsbFrame *f1)
+/*
+	printEvent
+	Debug output for a decoded message.
+*/
+static void printEvent(const struct AdsbEvent *ev)
+{
+	char call[9];
+
+	switch(ev->tc)
+	{
+	case 1: case 2: case 3: case 4:
+		expandCall(ev->call, call);
+		printf("Identification Message\nICAO: %X, "
+			"Callsign: %s, Aircraft Type: %s\n\n",
+			ev->icao, call, planeType(ev->cat));
+		break;
+
+	case 5: case 6: case 7: case 8:
+		printf("Surface Position Message\nICAO: %X, "
+			"Track: %f, Speed: %f, Position: "
+			"%f, %f\n\n",
+			ev->icao, ev->trk, ev->spd, ev->lat, ev->lng);
+		break;
+
+	case 9: case 10: case 11: case 12: case 13: case 14:
+	case 15: case 16: case 17: case 18: case 20: case 21:
+	case 22:
+		printf("Aerial Position Message\nICAO: %X, "
+			"Altitude: %d, Position: %f, %f\n\n",
+			ev->icao, ev->alt, ev->lat, ev->lng);
+		break;
+
+	case 19:
+		printf("Aerial Velocity Message\nICAO: %X, "
+			"Track: %f, Speed: %f, Vertical Rate: "
+			"%d\n\n",
+			ev->icao, ev->trk, ev->spd, ev->vert);
+		break;
+
+	default:
+		printf("Status Report\nICAO: %X\n\n", ev->icao);
+	}
+	return;
+}
+
+/*
+	handleMessage
+	level is the signal level from the demodulator, 0 for messages
+	that come as text.
+*/
+static void handleMessage(const union AdsbFrame *f1, unsigned int level)
 {
-	char f1call[9], f1type[8];
-	double f1lat, f1lng, f1trk, f1spd;
-	int f1alt, f1vr;
-	register enum PlaneFlags f1fl;
+	struct AdsbEvent ev;
+	time_t now;
+	int slot;
 
-	if((f1->df == 17 || f1->df == 18) &&	//ADS-B & TIS-B messages
-		parityCheck(f1) == 0)
+	//the owner of its plane decodes it
+	if(shards.count > 0)
+	{
+		routeFrame(&shards, f1, level);
+		return;
+	}
+
+	if(decodeEvent(f1, rlat, rlng, &ev) == 0)
 	{
 		if(debug)
+		{
 			printf("Uncorrupt Message Recieved DF: %d, TC: %d\n"
 				"Raw Data: %.2X%.2X%.2X%.2X%.2X%.2X%.2X%.2X"
-				"%.2X%.2X%.2X%.2X%.2X%.2X\n", f1->df, f1->me.id.tc,
-				f1->frame[13], f1->frame[12], f1->frame[11],
-				f1->frame[10], f1->frame[9], f1->frame[8],
-				f1->frame[7], f1->frame[6], f1->frame[5], f1->frame[4],
-				f1->frame[3], f1->frame[2], f1->frame[1],
-				f1->frame[0]);
-
-		switch(f1->me.id.tc)
-		{
-		case 1: case 2: case 3: case 4:
-			getIdent(f1, f1call, f1type);
-			if(debug)
-				printf("Identification Message\nICAO: %X, "
-					"Callsign: %s, Aircraft Type: %s\n\n",
-					f1->icao, f1call, f1type);
-
-			logPlane(planes, cache, f1->icao, f1call,
-				f1type, f1lat, f1lng, f1trk, f1spd,
-				f1alt, f1vr, ICAOFL | IDENTVALID);
-			break;
+				"%.2X%.2X%.2X%.2X%.2X%.2X\n", (int)adsbDf(f1), ev.tc,
+				f1->frame[0], f1->frame[1], f1->frame[2],
+				f1->frame[3], f1->frame[4], f1->frame[5],
+				f1->frame[6], f1->frame[7], f1->frame[8], f1->frame[9],
+				f1->frame[10], f1->frame[11], f1->frame[12],
+				f1->frame[13]);
+			printEvent(&ev);
+		}
 
-		case 5: case 6: case 7: case 8:
-			f1fl = ICAOFL | POSVALID | TRKVALID | SPDVALID;
-			switch(getSurfPos(f1, rlat, rlng, &f1trk, &f1spd,
-				&f1lat, &f1lng))
-			{
-			case 3:
-				f1fl -= TRKVALID;
-			case 2:
-				f1fl -= SPDVALID;
-				break;
-			case 1:
-				f1fl -= TRKVALID;
-			}
-			if(debug)
-				printf("Surface Position Message\nICAO: %X, "
-					"Track: %f, Speed: %f, Position: "
-					"%f, %f\n\n",
-					f1->icao, f1trk, f1spd, f1lat, f1lng);
-
-			logPlane(planes, cache, f1->icao, f1call,
-				f1type, f1lat, f1lng, f1trk, f1spd,
-				f1alt, f1vr, f1fl);
-			break;
+		now = clockNow;
+		slot = logEvent(planes, cache, &ev, now);
+		if(slot >= 0)
+			countMessage(&stats[slot], ev.icao, ev.tc, level, now);
+	}
+	else if(debug)
+		printf("untranslated: %.2X%.2X%.2X%.2X%.2X%.2X%.2X"
+			"%.2X%.2X%.2X%.2X%.2X%.2X%.2X\n\n",
+			f1->frame[0], f1->frame[1], f1->frame[2],
+			f1->frame[3], f1->frame[4], f1->frame[5],
+			f1->frame[6], f1->frame[7], f1->frame[8], f1->frame[9],
+			f1->frame[10], f1->frame[11], f1->frame[12],
+			f1->frame[13]);
+	return;
+}
 
-		case 9: case 10: case 11: case 12: case 13: case 14:
-		case 15: case 16: case 17: case 18: case 20: case 21:
-		case 22:
-			f1fl = ICAOFL | POSVALID | ALTVALID;
-			switch(getAirPos(f1, rlat, rlng,
-				&f1alt, &f1lat, &f1lng))
-			{
-			case 1:
-				f1fl -= ALTVALID;
-			}
-			if(debug)
-				printf("Aerial Position Message\nICAO: %X, "
-					"Altitude: %d, Position: %f, %f\n\n",
-					f1->icao, f1alt, f1lat, f1lng);
-
-			logPlane(planes, cache, f1->icao, f1call,
-				f1type, f1lat, f1lng, f1trk, f1spd,
-				f1alt, f1vr, f1fl);
-			break;
+/*
+	periodicOutput
+	Called after every block of samples or timer tick with the time,
+	moves the clock on and redoes the outputs that are due.
+	Built in map and JSON are redone every second,
+	display, log file and GMT map every 5 seconds.
+*/
+static void periodicOutput(time_t now)
+{
+	static time_t lastLog = 0, lastSecond = 0;
+#ifdef DEBUGALLOC
+	static unsigned long steady = 0;
+#endif
 
-		case 19:
-			f1fl = ICAOFL | TRKVALID | SPDVALID | VERTVALID;
-			switch(getAirVel(f1, &f1trk, &f1spd, &f1vr))
-			{
-				case 0:
-					break;
-				case 10:
-					f1fl -= TRKVALID;
-					f1fl -= SPDVALID;
-					break;
-				case 14:
-				case 13:
-					f1fl -= TRKVALID;
-				case 12:
-				case 11:
-					f1fl |= ICAOFL;
-					f1fl -= SPDVALID;
-					break;
-				case 15:
-					f1fl = ICAOFL;
-					break;
-				case 9:
-				case 8:
-					f1fl -= TRKVALID;
-				case 7:
-				case 6:
-					f1fl |= ICAOFL;
-				case 5:
-					f1fl -= VERTVALID;
-					break;
-				case 19:
-				case 18:
-					f1fl -= TRKVALID;
-				case 17:
-				case 16:
-					f1fl -= SPDVALID;
-					f1fl -= VERTVALID;
-					f1fl |= IASFL;
-					break;
-				case 3:
-				case 4:
-					f1fl -= TRKVALID;
-				case 1:
-				case 2:
-					f1fl |= IASFL;
-				default:
-					f1fl = 0;
-					break;
-			}
-			if(debug)
-				printf("Aerial Velocity Message\nICAO: %X, "
-					"Track: %f, Speed: %f, Vertical Rate: "
-					"%d\n\n",
-					f1->icao, f1trk, f1spd, f1vr);
-
-			logPlane(planes, cache, f1->icao, f1call,
-				f1type, f1lat, f1lng, f1trk, f1spd,
-				f1alt, f1vr, f1fl);
-			break;
+	clockNow = now;
+	if(lastLog == 0)
+		lastLog = lastSecond = now;
 
-		//TODO: possible future handling of aircraft status
-		default:
-			if(debug)
-				printf("Status Report\nICAO: %X\n\n", f1->icao);
+	if(now != lastSecond)
+	{
+		lastSecond = now;
+		if(shards.count > 0)
+			mergeShards(&shards, planes, stats);
+		if(mapname[0])
+		{
+			renderPlanes(&render, planes, cache, rlat, rlng);
+			writeFrame(&render, mapname);
 		}
+		if(jsonname[0])
+			writeJson(&json, planes, cache, now);
+	}
 
+	//more efficient to do this in separate thread but whatever
+	if(difftime(now, lastLog) > 5.)
+	{
+		lastLog = now;
+		updateDisplay(planes, cache);
+		if(savestream)
+			logToFile(planes, cache, savestream);
+#ifdef MAPPING
+		//map is drawn on its own thread
+		if(createImages)
+			requestImage(planes, cache);
+#endif
+#ifdef DEBUGALLOC
+		//the first refresh sizes the arena, after that this thread
+		//shouldn't allocate anything
+		if(steady == 0)
+			steady = heapAllocations();
+		else
+			assert(heapAllocations() == steady);
+#endif
 	}
-	else if(debug)
-		printf("untranslated: %.2X%.2X%.2X%.2X%.2X%.2X%.2X"
-			"%.2X%.2X%.2X%.2X%.2X%.2X%.2X\n\n",
-			f1->frame[13], f1->frame[12], f1->frame[11],
-			f1->frame[10], f1->frame[9], f1->frame[8],
-			f1->frame[7], f1->frame[6], f1->frame[5], f1->frame[4],
-			f1->frame[3], f1->frame[2], f1->frame[1],
-			f1->frame[0], f1->frame[1], f1->frame[0]);
+	if(savestream)
+		flushOutput(savestream, now);
+	if(archivename[0])
+		flushArchive(&archive, now);
+	return;
+}
+
+//puts an archived update back into the cache
+static void replayUpdate(const struct ArchiveRecord *rec, void *arg)
+{
+	logPlaneAt(planes, cache, rec->icao, 0, 0, rec->lat, rec->lng,
+		rec->trk, rec->spd, rec->alt, 0, ICAOFL | rec->flags, rec->time);
+	return;
+}
+
+static void demodFrame(const struct DemodFrame *f, void *arg)
+{
+	handleMessage(&f->frame, f->level);
+	return;
+}
+
+//the outputs keep up with a mapped capture, and a signal stops it
+static int demodProgress(void *arg)
+{
+	(void)arg;
+	periodicOutput(time(NULL));
+	return terminating;
+}
+
+/*
+	startDemod
+	Returns 0 if the demodulator is ready, -1 if not (and says why).
+*/
+static int startDemod(struct Demod *d, unsigned int rate, int repair)
+{
+	if(initDemod(d))
+		return -1;
+	if(setDemodRate(d, rate))
+	{
+		printf("sample rate has to be %d to %d\n",
+			DEMOD_RATE, DEMOD_MAXRATE);
+		freeDemod(d);
+		return -1;
+	}
+	if(repair >= 0)
+		d->repair = repair;
+	return 0;
+}
+
+//called by the sample source for every buffer
+static void sourceBlock(const struct SampleBuf *buf, void *arg)
+{
+	struct Demod *d = arg;
+	if(buf->dropped)
+		skipDemod(d, buf->dropped);
+	demodBlock(d, buf->iq, buf->samples, demodFrame, NULL);
+	periodicOutput(time(NULL));
+	if(terminating)
+		stopSource(&source);
+	return;
+}
+
+static void hexLine(const char *line, size_t len, void *arg)
+{
+	union AdsbFrame f;
+	if(parseHexFrame(line, len, &f) > 0)
+		handleMessage(&f, 0);
+	return;
+}
+
+/*
+	hexLoop
+	The -p loop, reads fd until it ends or a signal comes, and does
+	the periodic output on the timer ticks in between (see loop.h).
+*/
+static void hexLoop(struct EventLoop *loop, int fd)
+{
+	static struct LineReader lines;
+	int ev;
+
+	for(;;)
+	{
+		ev = waitLoop(loop, fd);
+		if(ev < 0 || (ev & LOOP_SIGNAL))
+			break;
+		if(ev & LOOP_TIMER)
+			periodicOutput(time(NULL));
+		if((ev & LOOP_INPUT) && readLines(&lines, fd, hexLine, NULL) <= 0)
+			break;
+	}
+	return;
+}
+
+static void printDemodStats(const struct Demod *d)
+{
+	printf("%lu preambles, %lu checked, %lu frames (%lu repaired)\n"
+		"noise floor %u, preamble threshold %u\n",
+		d->candidates, d->checked, d->frames, d->repaired,
+		(unsigned int)d->noise, (unsigned int)d->threshold);
 	return;
 }
 
@@ -241,8 +378,26 @@ static void handleMessage(const union AdsbFrame *f1)
 	-c <size>: change airplane cache size (def: 10)
 	-p <filename>: piped hex messages from named pipe or log file
 	-b <filename>: piped binary stream to work with any SDR
-
-	by default the program should use the rtl-sdr drivers to read data
+	-u <filename> <speed>: play back a -b capture like a dongle would,
+		speed times real time (0 is as fast as it can be demodulated)
+	-f <rate>: sample rate for -b and -u (def: 2000000)
+	-e <tries>: repair budget for frames that fail parity (def: 16)
+	-o <filename>: offline bulk decode of a hex message file (not a pipe)
+	-t <threads>: worker threads for -o and -b files (def: one per core)
+	-m <filename>: draw a map every second with the built in renderer
+		(.png or .ppm), doesn't need GMT
+	-j <filename>: write a JSON snapshot of the planes every second
+	-q <path>: answer plane queries on a UNIX socket at path (see query.h)
+	-y <seconds>: fsync the -s file at most this often, 0 after every
+		write (def: left to the OS)
+	-a <filename>: archive every position update (see archive.h)
+	-w <filename> <from> <to>: replay the updates of an archive between
+		two unix times, 0 for either end is open
+	-k <shards>: decode -p, -b and -u input on this many threads, each
+		owning the planes whose ICAO hashes to it (see shard.h)
+
+	by default the program uses the rtl-sdr drivers to read data,
+	when it is built with RTLSDR=1
 	filename currently has a 20 char limit, open to change later
 
 	In order to accept input from stdin,
@@ -260,16 +415,30 @@ int main(int argc, char *argv[])
 	//stream to read from
 	//can be a text file or potentially a named pipe
 	char filename[20], savename[20];
+	static struct OutputWriter save;
+	int syncEvery = OUTPUT_NOSYNC;
 	filename[0] = 0;
 	savename[0] = 0;
 
 	int isBinary = -1;
 	int logReaderMode = 0;
-	int createImages = 0;
-	time_t lastLog;
+	int threads = 0;
+	int shardCount = 0;
+	int repair = -1;
+	unsigned int rate = DEMOD_RATE;
+	double speed = 1.;
+	long from = 0, to = 0;
+	struct ArchiveReader reader;
+	long replayed;
+	int passed, i;
+	struct EventLoop loop;
+	int looping = 0;
+	struct Demod demod;
+	uint8_t *iq;
+	size_t n;
 
 	int opt;
-	char *optstring = "rdcpbsilx";
+	char *optstring = "rdcpbsilxotmjefuqyawk";
 
 	//flag detection
 	while((opt = getopt(argc, argv, optstring)) != -1)
@@ -295,7 +464,7 @@ int main(int argc, char *argv[])
 				printf("can't specify multiple files\n");
 				return -1;
 			}
-			sscanf(argv[optind++], "%20s", filename);
+			sscanf(argv[optind++], "%19s", filename);
 			isBinary = 0;
 			printf("filename is %s\n", filename);
 			break;
@@ -305,20 +474,94 @@ int main(int argc, char *argv[])
 				printf("can't specify multiple input files\n");
 				return -1;
 			}
-			sscanf(argv[optind++], "%20s", filename);
+			sscanf(argv[optind++], "%19s", filename);
 			isBinary = 1;
 			printf("filename is %s\n", filename);
 			break;
+		case 'o':
+			if(isBinary != -1)
+			{
+				printf("can't specify multiple input files\n");
+				return -1;
+			}
+			sscanf(argv[optind++], "%19s", filename);
+			isBinary = 2;
+			printf("offline file is %s\n", filename);
+			break;
+		case 'u':
+			if(isBinary != -1)
+			{
+				printf("can't specify multiple input files\n");
+				return -1;
+			}
+			sscanf(argv[optind++], "%19s", filename);
+			sscanf(argv[optind++], "%lf", &speed);
+			isBinary = 3;
+			printf("emulating a dongle with %s at %gx speed\n",
+				filename, speed);
+			break;
+		case 'w':
+			if(isBinary != -1)
+			{
+				printf("can't specify multiple input files\n");
+				return -1;
+			}
+			sscanf(argv[optind++], "%19s", filename);
+			sscanf(argv[optind++], "%ld", &from);
+			sscanf(argv[optind++], "%ld", &to);
+			isBinary = 4;
+			printf("replaying %s from %ld to %ld\n", filename, from, to);
+			break;
+		case 't':
+			sscanf(argv[optind++], "%d", &threads);
+			printf("using %d threads\n", threads);
+			break;
+		case 'k':
+			sscanf(argv[optind++], "%d", &shardCount);
+			printf("decoding on %d shards\n", shardCount);
+			break;
+		case 'e':
+			sscanf(argv[optind++], "%d", &repair);
+			printf("repair budget set to %d\n", repair);
+			break;
+		case 'f':
+			sscanf(argv[optind++], "%u", &rate);
+			printf("sample rate set to %u\n", rate);
+			break;
+		case 'm':
+			sscanf(argv[optind++], "%19s", mapname);
+			printf("map file is %s\n", mapname);
+			break;
+		case 'j':
+			sscanf(argv[optind++], "%19s", jsonname);
+			printf("JSON file is %s\n", jsonname);
+			break;
+		case 'q':
+			sscanf(argv[optind++], "%107s", queryname);
+			printf("query socket is %s\n", queryname);
+			break;
 		case 's':
-			sscanf(argv[optind++], "%20s", savename);
+			sscanf(argv[optind++], "%19s", savename);
 			printf("save file is %s\n", savename);
 			break;
+		case 'a':
+			sscanf(argv[optind++], "%19s", archivename);
+			printf("archive is %s\n", archivename);
+			break;
+		case 'y':
+			sscanf(argv[optind++], "%d", &syncEvery);
+			printf("save file synced every %d seconds\n", syncEvery);
+			break;
 		case 'i':
+#ifdef MAPPING
 			createImages = 1;
 			printf("image creation mode on\n");
+#else
+			printf("image creation needs to be built with MAP=1\n");
+#endif
 			break;
 		case 'l':
-			sscanf(argv[optind++], "%20s", filename);
+			sscanf(argv[optind++], "%19s", filename);
 			logReaderMode = 1;
 			printf("LOGREADER MODE\nfilename: %s\n", filename);
 			break;
@@ -331,23 +574,114 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	//the signals have to be blocked before any thread starts
+	if(isBinary == 0 && !logReaderMode)
+		looping = openLoop(&loop) == 0;
+
+	//debug output is printed as frames are decoded, so not on the shards
+	if(shardCount > 0 && !debug && !logReaderMode && isBinary != 2 &&
+		isBinary != 4)
+	{
+		//an even part of the cache each, the merged cache is all of them
+		cache = (cache + shardCount - 1) / shardCount * shardCount;
+		if(startShards(&shards, shardCount, cache / shardCount, rlat,
+			rlng))
+			printf("could not start %d shards\n", shardCount);
+	}
+
 	planes = (struct Plane*)calloc(cache, sizeof(struct Plane));
+	stats = (struct PlaneStats*)calloc(cache, sizeof(struct PlaneStats));
+	if(planes == NULL || stats == NULL || initGrid(&grid, planes, cache))
+	{
+		printf("not enough memory for %d planes\n", cache);
+		return 1;
+	}
+	attachGrid(&grid);
+	attachStats(stats);
 
 	if(savename[0] != 0)
-		savestream = fopen(savename, "a");
+	{
+		if(openOutput(&save, savename,
+			syncEvery < 0 ? OUTPUT_NOSYNC : syncEvery))
+			printf("could not open %s\n", savename);
+		else
+			savestream = &save;
+	}
+	if(mapname[0] != 0 && initRender(&render, MAPSIZE, MAPSIZE, MAPRANGE))
+	{
+		printf("not enough memory for map\n");
+		mapname[0] = 0;
+	}
+	if(jsonname[0] != 0 && initJson(&json, jsonname, cache, 1))
+	{
+		printf("not enough memory for JSON\n");
+		jsonname[0] = 0;
+	}
+	else if(jsonname[0] != 0)
+		json.stats = stats;
+	//a replay would only archive the same updates again
+	if(archivename[0] != 0 && !logReaderMode && isBinary != 4)
+	{
+		if(openArchive(&archive, archivename))
+		{
+			printf("could not open archive %s\n", archivename);
+			archivename[0] = 0;
+		}
+		else
+			attachArchive(&archive, planes);
+	}
+	else
+		archivename[0] = 0;
+	if(queryname[0] != 0 && !logReaderMode &&
+		startQuery(&query, queryname, planes, cache))
+	{
+		printf("could not open query socket %s\n", queryname);
+		queryname[0] = 0;
+	}
 
+	clockNow = time(NULL);
 	if(logReaderMode)
 	{
 		if(savestream != NULL)
-			fclose(savestream);
+			closeOutput(savestream);
+		savestream = NULL;
+		attachGrid(NULL);
+		attachStats(NULL);
+		json.stats = NULL;
+		freeGrid(&grid);
 		free(planes);
 		logstream = fopen(filename, "r");
 		readLog(logstream, &planes);
 	}
-	else if(isBinary == -1)
+	else if(isBinary == -1 || isBinary == 3)
 	{
-		//TODO: directly read from rtl-sdr using library
-		printf("not implemented yet\n");
+		//a dongle, or a capture file played back like one
+		if(startDemod(&demod, rate, repair))
+			printf("could not start demodulator\n");
+		else if(isBinary == 3 ?
+			openEmulator(&source, filename, rate, speed) :
+			openRtlSdr(&source, 0, rate))
+		{
+			if(isBinary == 3)
+				printf("could not open %s\n", filename);
+			else
+				printf("could not open RTL-SDR, it needs a build with RTLSDR=1\n");
+			freeDemod(&demod);
+		}
+		else
+		{
+			signal(SIGINT, term_handler);
+			signal(SIGTERM, term_handler);
+#ifndef UCRT
+			signal(SIGHUP, term_handler);
+#endif
+			runSource(&source, sourceBlock, &demod);
+			printDemodStats(&demod);
+			printf("%lu buffers, %lu overruns, %lu samples dropped\n",
+				source.buffers, source.overruns, source.dropped);
+			closeSource(&source);
+			freeDemod(&demod);
+		}
 	}
 	else if(isBinary == 0)
 	{
@@ -357,52 +691,171 @@ int main(int argc, char *argv[])
 		else
 			logstream = fopen(filename, "r");
 
-		//maybe use sigaction in the future?
+		if(logstream == NULL)
+			printf("could not open %s\n", filename);
+		else if(looping)
+			hexLoop(&loop, fileno(logstream));
+		else
+		{
+			//UCRT has no timerfd, one message at a time with stdio
+			signal(SIGINT, term_handler);
+			signal(SIGTERM, term_handler);
+#ifndef UCRT
+			signal(SIGHUP, term_handler);
+#endif
+			//signal(SIGHUP, term_handler);
+
+			while(fscanf(logstream, " *%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx"
+				"%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx;", &f1.frame[0],
+				&f1.frame[1], &f1.frame[2], &f1.frame[3],
+				&f1.frame[4], &f1.frame[5], &f1.frame[6], &f1.frame[7],
+				&f1.frame[8], &f1.frame[9], &f1.frame[10], &f1.frame[11],
+				&f1.frame[12], &f1.frame[13]) != EOF)
+			{
+				handleMessage(&f1, 0);
+				periodicOutput(time(NULL));
+				if(terminating)
+					break;
+			}
+		}
+	}
+	else if(isBinary == 4)
+	{
+		if(openArchiveReader(&reader, filename))
+			printf("could not open %s\n", filename);
+		else
+		{
+			replayed = scanArchive(&reader, from, to > 0 ? to : LONG_MAX,
+				-1, replayUpdate, NULL);
+			if(replayed < 0)
+				printf("could not read %s\n", filename);
+			else
+				printf("%ld updates replayed\n", replayed);
+			closeArchiveReader(&reader);
+		}
+	}
+	else if(isBinary == 2)
+	{
+		//whole file at once, so display only once at the end
+		passed = bulkDecodeHex(filename, threads, planes, cache);
+		if(passed < 0)
+			printf("could not open %s\n", filename);
+		else
+			printf("%d messages decoded\n", passed);
+	}
+	else
+	{
+		//unsigned 8 bit I/Q at the -f rate, like rtl_sdr -s <rate> writes
+		if(filename[0] == '-' && filename[1] == 0)
+			logstream = stdin;
+		else
+			logstream = fopen(filename, "rb");
+		iq = malloc(DEMOD_BLOCK * 2);
+		if(logstream == NULL || iq == NULL ||
+			startDemod(&demod, rate, repair))
+		{
+			printf("could not start demodulator\n");
+			free(iq);
+			iq = NULL;
+		}
+
 		signal(SIGINT, term_handler);
 		signal(SIGTERM, term_handler);
 #ifndef UCRT
 		signal(SIGHUP, term_handler);
 #endif
-		//signal(SIGHUP, term_handler);
-
-		time(&lastLog);
 
-		while(fscanf(logstream, " *%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx"
-			"%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx;", &f1.frame[13],
-			&f1.frame[12], &f1.frame[11], &f1.frame[10],
-			&f1.frame[9], &f1.frame[8], &f1.frame[7], &f1.frame[6],
-			&f1.frame[5], &f1.frame[4], &f1.frame[3], &f1.frame[2],
-			&f1.frame[1], &f1.frame[0]) != EOF)
+		//a capture file can be mapped and split up between threads
+		if(iq != NULL && logstream != stdin &&
+			bulkDemodIQ(filename, threads, &demod, demodFrame,
+				demodProgress, NULL) == 0)
 		{
-			handleMessage(&f1);
+			free(iq);
+			iq = NULL;
+			printDemodStats(&demod);
+			freeDemod(&demod);
+		}
 
-			//more efficient to do this in separate thread but whatever
-			//displays data every 5 seconds and writes to log file
-			if(difftime(time(NULL), lastLog) > 5.)
-			{
-				time(&lastLog);
-				updateDisplay(planes, cache);
-				if(savestream)
-					logToFile(planes, cache, savestream);
-			}
+		while(iq != NULL && (n = fread(iq, 2, DEMOD_BLOCK, logstream)) > 0)
+		{
+			demodBlock(&demod, iq, n, demodFrame, NULL);
+			periodicOutput(time(NULL));
 			if(terminating)
 				break;
 		}
+		if(iq != NULL)
+		{
+			printDemodStats(&demod);
+			freeDemod(&demod);
+			free(iq);
+		}
 	}
-	else
+	if(shards.count > 0)
 	{
-		//TODO: piped input from rtl_sdr or other raw data stream
-		printf("not implemented yet\n");
+		stopShards(&shards);
+		mergeShards(&shards, planes, stats);
+		for(i = 0;i < shards.count;i++)
+			printf("shard %d: %lu messages, queue full %lu times\n", i,
+				shards.shards[i].frames, shards.shards[i].waits);
 	}
 	printf("Reading complete\n");
 	updateDisplay(planes, cache);
+	if(!logReaderMode && isBinary != 4 && isBinary != 2)
+		printStats(stdout, planes, stats, cache, time(NULL));
 	if(savestream)
 	{
 		logToFile(planes, cache, savestream);
-		fclose(savestream);
+		if(savestream->dropped)
+			printf("dropped %lu bytes of %s, the disk was behind\n",
+				savestream->dropped, savename);
+		if(closeOutput(savestream))
+			printf("could not write %s\n", savename);
+	}
+	if(mapname[0])
+	{
+		renderPlanes(&render, planes, cache, rlat, rlng);
+		if(writeFrame(&render, mapname))
+			printf("could not write %s\n", mapname);
+		freeRender(&render);
+	}
+	if(jsonname[0])
+	{
+		json.lastWrite = 0;	//always write the final snapshot
+		if(writeJson(&json, planes, cache, time(NULL)) < 0)
+			printf("could not write %s\n", jsonname);
+		freeJson(&json);
+	}
+	if(queryname[0])
+		stopQuery(&query);
+	if(archivename[0])
+	{
+		attachArchive(NULL, NULL);
+		if(archive.data.dropped)
+			printf("dropped %lu bytes of archive, the disk was behind\n",
+				archive.data.dropped);
+		if(closeArchive(&archive))
+			printf("could not write archive %s\n", archivename);
 	}
-	fclose(logstream);
+#ifdef MAPPING
+	if(createImages)
+	{
+		requestImage(planes, cache);
+		endGMTSession();
+	}
+#endif
+	if(logstream)
+		fclose(logstream);
+	attachGrid(NULL);
+	attachStats(NULL);
+	freeGrid(&grid);
 	free(planes);
+	free(stats);
+	if(shards.count > 0)
+		freeShards(&shards);
+	freeArena(threadArena());
+	//a signal during the cleanup is delivered now, and ends it
+	if(looping)
+		closeLoop(&loop);
 
 	return 0;
 }
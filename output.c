@@ -0,0 +1,275 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef UCRT
+#include <sys/uio.h>
+#else
+#include <io.h>
+#define fsync _commit
+#endif
+
+#include "output.h"
+
+/*
+	writeBufs
+	Writes n buffers from first, picking up after short writes.
+	A failed write drops what is left of them.
+*/
+static void writeBufs(struct OutputWriter *w, int first, int n)
+{
+#ifndef UCRT
+	struct iovec iov[OUTPUT_BUFS], *v = iov;
+	ssize_t done;
+	int i;
+
+	for(i = 0;i < n;i++)
+	{
+		iov[i].iov_base = w->bufs[(first + i) % OUTPUT_BUFS].data;
+		iov[i].iov_len = w->bufs[(first + i) % OUTPUT_BUFS].len;
+	}
+	while(n > 0)
+	{
+		done = writev(w->fd, v, n);
+		if(done < 0 && errno == EINTR)
+			continue;
+		if(done < 0)
+		{
+			w->failed = 1;
+			return;
+		}
+		while(n > 0 && (size_t)done >= v->iov_len)
+		{
+			done -= v->iov_len;
+			v++;
+			n--;
+		}
+		if(n > 0)
+		{
+			v->iov_base = (char*)v->iov_base + done;
+			v->iov_len -= done;
+		}
+	}
+#else
+	//no writev
+	const char *p;
+	size_t len;
+	int i, done;
+
+	for(i = 0;i < n;i++)
+	{
+		p = w->bufs[(first + i) % OUTPUT_BUFS].data;
+		len = w->bufs[(first + i) % OUTPUT_BUFS].len;
+		while(len > 0)
+		{
+			done = write(w->fd, p, (unsigned int)len);
+			if(done < 0 && errno == EINTR)
+				continue;
+			if(done < 0)
+			{
+				w->failed = 1;
+				return;
+			}
+			p += done;
+			len -= done;
+		}
+	}
+#endif
+	return;
+}
+
+static void *outputThread(void *arg)
+{
+	struct OutputWriter *w = arg;
+	struct timespec until;
+	time_t lastSync, now;
+	int n, stop, unsynced = 0;
+
+	lastSync = time(NULL);
+	for(;;)
+	{
+		pthread_mutex_lock(&w->lock);
+		//wakes up every second for the timed fsyncs
+		if(w->done == w->fill && !w->stopping)
+		{
+			clock_gettime(CLOCK_REALTIME, &until);
+			until.tv_sec++;
+			pthread_cond_timedwait(&w->wake, &w->lock, &until);
+		}
+		n = (w->fill - w->done + OUTPUT_BUFS) % OUTPUT_BUFS;
+		stop = w->stopping;
+		pthread_mutex_unlock(&w->lock);
+
+		if(n > 0)
+		{
+			writeBufs(w, w->done, n);
+			unsynced = 1;
+		}
+		now = time(NULL);
+		if(unsynced && w->sync != OUTPUT_NOSYNC &&
+			now - lastSync >= w->sync)
+		{
+			fsync(w->fd);
+			lastSync = now;
+			unsynced = 0;
+		}
+
+		pthread_mutex_lock(&w->lock);
+		w->done = (w->done + n) % OUTPUT_BUFS;
+		pthread_mutex_unlock(&w->lock);
+		if(stop && n == 0)
+			return NULL;
+	}
+}
+
+int openOutput(struct OutputWriter *w, const char *filename, int sync)
+{
+	int i;
+
+	memset(w, 0, sizeof(*w));
+	w->sync = sync;
+	for(i = 0;i < OUTPUT_BUFS;i++)
+	{
+		w->bufs[i].data = malloc(OUTPUT_BUFSIZE);
+		if(w->bufs[i].data == NULL)
+			goto fail;
+	}
+	w->fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if(w->fd < 0)
+		goto fail;
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->wake, NULL);
+	if(pthread_create(&w->thread, NULL, outputThread, w))
+	{
+		pthread_mutex_destroy(&w->lock);
+		pthread_cond_destroy(&w->wake);
+		close(w->fd);
+		goto fail;
+	}
+	return 0;
+
+fail:
+	for(i = 0;i < OUTPUT_BUFS;i++)
+		free(w->bufs[i].data);
+	return -1;
+}
+
+/*
+	handOver
+	Moves fill on to the next buffer and wakes up the writer.
+	If the next one is still waiting to be written, the disk is
+	behind and the records in fill are dropped.
+*/
+static void handOver(struct OutputWriter *w)
+{
+	int next = (w->fill + 1) % OUTPUT_BUFS;
+
+	pthread_mutex_lock(&w->lock);
+	if(next != w->done)
+	{
+		w->bufs[next].len = 0;
+		w->fill = next;
+		pthread_cond_signal(&w->wake);
+	}
+	else
+	{
+		w->dropped += w->bufs[w->fill].len;
+		w->bufs[w->fill].len = 0;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return;
+}
+
+char *reserveOutput(struct OutputWriter *w)
+{
+	//fill is handed over once it has OUTPUT_FLUSH, so this much is free
+	return w->bufs[w->fill].data + w->bufs[w->fill].len;
+}
+
+void commitOutput(struct OutputWriter *w, size_t len)
+{
+	struct OutputBuf *b = &w->bufs[w->fill];
+
+	if(b->len == 0)
+		w->started = time(NULL);
+	b->len += len;
+	if(b->len >= OUTPUT_FLUSH)
+		handOver(w);
+	return;
+}
+
+void flushOutput(struct OutputWriter *w, time_t now)
+{
+	if(w->bufs[w->fill].len > 0 && now - w->started >= OUTPUT_DELAY)
+		handOver(w);
+	return;
+}
+
+int closeOutput(struct OutputWriter *w)
+{
+	int i;
+
+	pthread_mutex_lock(&w->lock);
+	w->stopping = 1;
+	pthread_cond_signal(&w->wake);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	//the writer is gone, so the rest can't be dropped for being behind
+	if(w->bufs[w->fill].len > 0)
+		writeBufs(w, w->fill, 1);
+	if(w->sync != OUTPUT_NOSYNC)
+		fsync(w->fd);
+	close(w->fd);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->wake);
+	for(i = 0;i < OUTPUT_BUFS;i++)
+	{
+		free(w->bufs[i].data);
+		w->bufs[i].data = NULL;
+	}
+	return w->failed ? -1 : 0;
+}
+
+//write until all of it is written, -1 if a write fails
+static int writeAll(int fd, const char *p, size_t len)
+{
+	long done;
+
+	while(len > 0)
+	{
+		done = (long)write(fd, p, (unsigned int)len);
+		if(done < 0 && errno == EINTR)
+			continue;
+		if(done < 0)
+			return -1;
+		p += done;
+		len -= (size_t)done;
+	}
+	return 0;
+}
+
+int replaceFile(const char *filename, const char *tmpname,
+	const void *data, size_t len, const void *more, size_t morelen)
+{
+	int fd, ok;
+
+#ifndef UCRT
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#else
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+#endif
+	if(fd < 0)
+		return -1;
+	ok = writeAll(fd, data, len) == 0 &&
+		(more == NULL || writeAll(fd, more, morelen) == 0);
+	if(close(fd) != 0 || !ok)
+	{
+		remove(tmpname);
+		return -1;
+	}
+	return rename(tmpname, filename) ? -1 : 0;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+	OUTPUT.H
+	Append only file output written by a thread of its own, so the
+	decoder never waits on the disk. SD cards can stall for a second
+	or more in the middle of a write, stdio would stall decoding with
+	them.
+
+	Records are formatted straight into one of OUTPUT_BUFS buffers.
+	A buffer is handed to the writer thread once OUTPUT_FLUSH bytes
+	are in it or its first record is OUTPUT_DELAY seconds old, and the
+	writer writes every buffer waiting for it with one writev.
+	If the disk falls so far behind that every buffer is waiting,
+	the records in the newest one are dropped and counted instead.
+
+	Only one thread can write records to a writer.
+*/
+
+#define OUTPUT_BUFS 8
+#define OUTPUT_BUFSIZE (64 * 1024)
+#define OUTPUT_FLUSH (OUTPUT_BUFSIZE / 2)	//also the longest record
+#define OUTPUT_DELAY 1		//seconds a record can wait to be handed over
+#define OUTPUT_NOSYNC -1	//sync for openOutput, never fsync
+
+struct OutputBuf
+{
+	char *data;
+	size_t len;
+};
+
+/*
+	OutputWriter
+	Buffers from done up to fill are waiting for the writer thread,
+	fill is the one records go into. The lock is only held to move
+	fill and done, never while writing.
+*/
+struct OutputWriter
+{
+	int fd;
+	int sync;		//seconds between fsyncs, see openOutput
+	struct OutputBuf bufs[OUTPUT_BUFS];
+	int fill, done;
+	time_t started;		//when the fill buffer got its first record
+	unsigned long dropped;	//bytes dropped because the disk was behind
+	int failed;		//a write failed, what it had was dropped
+	int stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t thread;
+};
+
+/*
+	openOutput
+	Returns 0 on success, -1 if filename can't be opened or out of
+	memory.
+	Appends to filename, creating it if needed.
+	sync is OUTPUT_NOSYNC to leave it to the OS, 0 to fsync after
+	every write, or at most how many seconds apart the writes are
+	fsynced.
+*/
+int openOutput(struct OutputWriter *w, const char *filename, int sync);
+
+/*
+	reserveOutput
+	Returns where to format the next record, which can be up to
+	OUTPUT_FLUSH bytes. Never fails or waits.
+*/
+char *reserveOutput(struct OutputWriter *w);
+
+/*
+	commitOutput
+	Adds the len bytes formatted at reserveOutput, and hands the
+	buffer to the writer if it has OUTPUT_FLUSH bytes in it.
+*/
+void commitOutput(struct OutputWriter *w, size_t len);
+
+/*
+	flushOutput
+	Hands the buffer to the writer if its first record is OUTPUT_DELAY
+	seconds old. Cheap enough to call on every pass of the decoder.
+*/
+void flushOutput(struct OutputWriter *w, time_t now);
+
+/*
+	closeOutput
+	Returns 0 if everything was written, -1 if a write failed.
+	Waits for what is left to be written, fsyncs unless sync is
+	OUTPUT_NOSYNC, then closes the file and frees the buffers.
+	dropped is still set afterwards.
+*/
+int closeOutput(struct OutputWriter *w);
+
+/*
+	replaceFile
+	Returns 0 if filename was replaced, -1 if not.
+	Writes data and then more (NULL for nothing) to tmpname and renames
+	it over filename, so readers never see half a file. Plain write
+	calls, stdio would allocate a FILE every time.
+*/
+int replaceFile(const char *filename, const char *tmpname,
+	const void *data, size_t len, const void *more, size_t morelen);
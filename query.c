@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#ifndef UCRT
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "query.h"
+
+#define LINELEN 128	//longest request
+#define TEXTLEN 128	//longest text reply line
+
+#ifndef UCRT
+struct QueryClient
+{
+	int fd;
+	int binary;
+	int len;
+	char line[LINELEN];
+};
+
+static void freeSnapshot(struct QueryServer *q)
+{
+	if(q->planes != NULL)
+		freeGrid(&q->grid);
+	free(q->planes);
+	q->planes = NULL;
+	return;
+}
+
+//copies the live planes and moves the ones that moved in the grid
+static void takeSnapshot(struct QueryServer *q)
+{
+	int i;
+	readPlanes(q->live, q->planes, q->bufsize);
+	for(i = 0;i < q->bufsize;i++)
+		updateGrid(&q->grid, i);
+	q->time = time(NULL);
+	return;
+}
+
+static void putLE(uint8_t *p, uint64_t v, int bytes)
+{
+	int i;
+	for(i = 0;i < bytes;i++)
+		p[i] = (uint8_t)(v >> 8 * i);
+	return;
+}
+
+static size_t formatBinary(uint8_t *p, const struct Plane *pl, time_t now)
+{
+	struct QueryRecord r;
+	char call[9];
+
+	memset(&r, 0, sizeof(r));
+	r.icao = (uint32_t)pl->icao;
+	r.flags = (uint32_t)pl->pflags;
+	if(pl->pflags & POSVALID)
+	{
+		r.lat = (int32_t)(pl->lat * 1e6);
+		r.lng = (int32_t)(pl->lng * 1e6);
+	}
+	if(pl->pflags & ALTVALID)
+		r.alt = pl->alt;
+	if(pl->pflags & VERTVALID)
+		r.vert = pl->vert;
+	if(pl->pflags & TRKVALID)
+		r.trk = (uint16_t)(pl->trk * 100.);
+	if(pl->pflags & SPDVALID)
+		r.spd = (uint16_t)(pl->spd * 10.);
+	r.age = (uint32_t)(now - pl->lstUpd);
+	if(pl->pflags & IDENTVALID)
+	{
+		expandCall(pl->call, call);
+		memcpy(r.call, call, 8);
+		strncpy(r.type, planeType(pl->cat), 4);
+	}
+
+	putLE(p, r.icao, 4);
+	putLE(p + 4, r.flags, 4);
+	putLE(p + 8, (uint32_t)r.lat, 4);
+	putLE(p + 12, (uint32_t)r.lng, 4);
+	putLE(p + 16, (uint32_t)r.alt, 4);
+	putLE(p + 20, (uint32_t)r.vert, 4);
+	putLE(p + 24, r.trk, 2);
+	putLE(p + 26, r.spd, 2);
+	putLE(p + 28, r.age, 4);
+	memcpy(p + 32, r.call, 8);
+	memcpy(p + 40, r.type, 4);
+	return 44;
+}
+
+static size_t formatText(char *p, const struct Plane *pl, time_t now)
+{
+	char call[9] = "-", type[8] = "-", lat[16] = "-", lng[16] = "-",
+		trk[12] = "-", spd[12] = "-", alt[12] = "-", vert[12] = "-";
+	int n;
+
+	if(pl->pflags & IDENTVALID)
+	{
+		//no trailing spaces, and "-" if it is all spaces
+		n = expandCall(pl->call, call);
+		if(n > 0)
+			call[n] = 0;
+		else
+			strcpy(call, "-");
+		strcpy(type, planeType(pl->cat));
+	}
+	if(pl->pflags & POSVALID)
+	{
+		snprintf(lat, sizeof(lat), "%.6f", pl->lat);
+		snprintf(lng, sizeof(lng), "%.6f", pl->lng);
+	}
+	if(pl->pflags & TRKVALID)
+		snprintf(trk, sizeof(trk), "%.1f", pl->trk);
+	if(pl->pflags & SPDVALID)
+		snprintf(spd, sizeof(spd), "%.1f", pl->spd);
+	if(pl->pflags & ALTVALID)
+		snprintf(alt, sizeof(alt), "%d", pl->alt);
+	if(pl->pflags & VERTVALID)
+		snprintf(vert, sizeof(vert), "%d", pl->vert);
+	n = snprintf(p, TEXTLEN, "%.6X %s %s %s %s %s %s %s %s %ld\n",
+		pl->icao, call, type, lat, lng, trk, spd, alt, vert,
+		(long)(now - pl->lstUpd));
+	return n < TEXTLEN ? (size_t)n : TEXTLEN - 1;
+}
+
+static void sendAll(int fd, const char *p, size_t len)
+{
+	ssize_t n;
+	while(len > 0)
+	{
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if(n <= 0)
+			return;
+		p += n;
+		len -= (size_t)n;
+	}
+	return;
+}
+
+/*
+	findPlanes
+	Returns the amount of slots of s written to out, or -1 with
+	why in err if the request doesn't make sense.
+*/
+static int findPlanes(const struct QueryServer *q, const char *line,
+	int out[], const char **err)
+{
+	char cmd[8], arg[16];
+	double a, b, c, d;
+	uint64_t want, mask;
+	int i, n = 0, icao, k, len;
+
+	if(sscanf(line, "%7s", cmd) != 1)
+	{
+		*err = "empty request";
+		return -1;
+	}
+	if(strcmp(cmd, "icao") == 0)
+	{
+		if(sscanf(line, "%*s %x", &icao) != 1)
+		{
+			*err = "icao needs a hex address";
+			return -1;
+		}
+		for(i = 0;i < q->bufsize;i++)
+			if((q->planes[i].pflags & ICAOFL) && q->planes[i].icao == icao)
+				out[n++] = i;
+		return n;
+	}
+	if(strcmp(cmd, "call") == 0)
+	{
+		if(sscanf(line, "%*s %8s", arg) != 1)
+		{
+			*err = "call needs a callsign prefix";
+			return -1;
+		}
+		for(i = 0;arg[i];i++)
+			arg[i] = (char)toupper((unsigned char)arg[i]);
+		//no plane can match chars that aren't in call signs
+		len = packCall(arg, &want);
+		if(len < 0)
+			return 0;
+		//compare the first len 6 bit chars
+		mask = ~0ull << (48 - 6 * len) & 0xFFFFFFFFFFFFull;
+		for(i = 0;i < q->bufsize;i++)
+			if((q->planes[i].pflags & IDENTVALID) &&
+				(q->planes[i].call & mask) == (want & mask))
+				out[n++] = i;
+		return n;
+	}
+	if(strcmp(cmd, "box") == 0)
+	{
+		if(sscanf(line, "%*s %lf %lf %lf %lf", &a, &b, &c, &d) != 4)
+		{
+			*err = "box needs lat0 lng0 lat1 lng1";
+			return -1;
+		}
+		return gridBox(&q->grid, a, b, c, d, out, q->bufsize);
+	}
+	if(strcmp(cmd, "near") == 0)
+	{
+		if(sscanf(line, "%*s %lf %lf %d", &a, &b, &k) != 3 || k < 0)
+		{
+			*err = "near needs lat lng k";
+			return -1;
+		}
+		return gridNearest(&q->grid, a, b, k < q->bufsize ? k : q->bufsize,
+			out);
+	}
+	*err = "unknown request";
+	return -1;
+}
+
+static void answer(struct QueryServer *q, struct QueryClient *c,
+	const char *line)
+{
+	const char *err = NULL;
+	char *p = q->reply;
+	int i, n;
+
+	if(strncmp(line, "text", 4) == 0 && !isalnum((unsigned char)line[4]))
+	{
+		c->binary = 0;
+		return;
+	}
+	if(strncmp(line, "binary", 6) == 0 && !isalnum((unsigned char)line[6]))
+	{
+		c->binary = 1;
+		return;
+	}
+
+	takeSnapshot(q);
+	n = findPlanes(q, line, q->slots, &err);
+	if(n < 0)
+	{
+		n = snprintf(p, TEXTLEN, "error %s\n", err);
+		sendAll(c->fd, p, (size_t)n);
+		return;
+	}
+
+	if(c->binary)
+	{
+		memcpy(p, QUERY_MAGIC, 4);
+		putLE((uint8_t*)p + 4, (uint32_t)n, 4);
+		putLE((uint8_t*)p + 8, (uint64_t)q->time, 8);
+		p += 16;
+		for(i = 0;i < n;i++)
+			p += formatBinary((uint8_t*)p, &q->planes[q->slots[i]],
+				q->time);
+	}
+	else
+	{
+		for(i = 0;i < n;i++)
+			p += formatText(p, &q->planes[q->slots[i]], q->time);
+		*p++ = '\n';
+	}
+	sendAll(c->fd, q->reply, (size_t)(p - q->reply));
+	return;
+}
+
+//answers every whole line received, returns -1 once the client is gone
+static int readClient(struct QueryServer *q, struct QueryClient *c)
+{
+	char *nl;
+	ssize_t n;
+	int used;
+
+	n = recv(c->fd, c->line + c->len, LINELEN - 1 - c->len, 0);
+	if(n <= 0)
+		return -1;
+	c->len += (int)n;
+	c->line[c->len] = 0;
+	while((nl = memchr(c->line, '\n', c->len)) != NULL)
+	{
+		*nl = 0;
+		answer(q, c, c->line);
+		used = (int)(nl - c->line) + 1;
+		memmove(c->line, nl + 1, c->len - used);
+		c->len -= used;
+		c->line[c->len] = 0;
+	}
+	//a line that can't fit is not a request
+	if(c->len == LINELEN - 1)
+		return -1;
+	return 0;
+}
+
+static void *queryThread(void *arg)
+{
+	struct QueryServer *q = arg;
+	struct QueryClient clients[QUERY_CLIENTS];
+	struct pollfd fds[QUERY_CLIENTS + 1];
+	int i, n, fd;
+
+	for(i = 0;i < QUERY_CLIENTS;i++)
+		clients[i].fd = -1;
+
+	while(!q->stopping)
+	{
+		fds[0].fd = q->listenFd;
+		fds[0].events = POLLIN;
+		for(i = 0;i < QUERY_CLIENTS;i++)
+		{
+			fds[i + 1].fd = clients[i].fd;
+			fds[i + 1].events = POLLIN;
+			fds[i + 1].revents = 0;
+		}
+		//wakes up now and then to see if it should stop
+		n = poll(fds, QUERY_CLIENTS + 1, 200);
+		if(n <= 0)
+			continue;
+
+		for(i = 0;i < QUERY_CLIENTS;i++)
+			if(fds[i + 1].revents && readClient(q, &clients[i]))
+			{
+				close(clients[i].fd);
+				clients[i].fd = -1;
+			}
+
+		if(fds[0].revents & POLLIN)
+		{
+			fd = accept(q->listenFd, NULL, NULL);
+			for(i = 0;fd >= 0 && i < QUERY_CLIENTS;i++)
+				if(clients[i].fd < 0)
+				{
+					clients[i].fd = fd;
+					clients[i].binary = 1;
+					clients[i].len = 0;
+					break;
+				}
+			//full up
+			if(fd >= 0 && i == QUERY_CLIENTS)
+				close(fd);
+		}
+	}
+
+	for(i = 0;i < QUERY_CLIENTS;i++)
+		if(clients[i].fd >= 0)
+			close(clients[i].fd);
+	return NULL;
+}
+
+int startQuery(struct QueryServer *q, const char *path,
+	const struct Plane buf[], int bufsize)
+{
+	struct sockaddr_un addr;
+	size_t replySize;
+
+	memset(q, 0, sizeof(*q));
+	q->listenFd = -1;
+	if(strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+
+	q->live = buf;
+	q->bufsize = bufsize;
+	q->planes = calloc(bufsize, sizeof(struct Plane));
+	if(q->planes == NULL)
+		return -1;
+	if(initGrid(&q->grid, q->planes, bufsize))
+	{
+		free(q->planes);
+		q->planes = NULL;
+		return -1;
+	}
+	//every plane in the biggest of the two formats
+	replySize = (size_t)bufsize * (TEXTLEN > 44 ? TEXTLEN : 44) + TEXTLEN;
+	q->reply = malloc(replySize);
+	q->slots = malloc(sizeof(int) * bufsize);
+	q->path = malloc(strlen(path) + 1);
+	if(q->reply == NULL || q->slots == NULL || q->path == NULL)
+		goto fail;
+	strcpy(q->path, path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	q->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(q->listenFd < 0 ||
+		bind(q->listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+		listen(q->listenFd, QUERY_CLIENTS) < 0 ||
+		pthread_create(&q->thread, NULL, queryThread, q))
+		goto fail;
+	return 0;
+
+fail:
+	if(q->listenFd >= 0)
+	{
+		close(q->listenFd);
+		unlink(path);
+	}
+	q->listenFd = -1;
+	freeSnapshot(q);
+	free(q->reply);
+	free(q->slots);
+	free(q->path);
+	return -1;
+}
+
+void stopQuery(struct QueryServer *q)
+{
+	if(q->listenFd < 0)
+		return;
+	q->stopping = 1;
+	pthread_join(q->thread, NULL);
+	close(q->listenFd);
+	unlink(q->path);
+	q->listenFd = -1;
+	freeSnapshot(q);
+	free(q->reply);
+	free(q->slots);
+	free(q->path);
+	return;
+}
+#else
+//no UNIX sockets
+int startQuery(struct QueryServer *q, const char *path,
+	const struct Plane buf[], int bufsize)
+{
+	(void)path;
+	(void)buf;
+	(void)bufsize;
+	memset(q, 0, sizeof(*q));
+	q->listenFd = -1;
+	return -1;
+}
+
+void stopQuery(struct QueryServer *q)
+{
+	(void)q;
+	return;
+}
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "logger.h"
+#include "grid.h"
+
+/*
+	QUERY.H
+	A UNIX socket other programs can ask for planes on, instead of
+	tailing the log file.
+
+	Each request is a line of text:
+	icao <hex>			the plane with that ICAO address
+	call <prefix>			planes with a callsign starting with it
+	box <lat0> <lng0> <lat1> <lng1>	planes inside a box
+	near <lat> <lng> <k>		the k nearest planes
+	text / binary			switch reply format, binary is default,
+					no reply
+
+	Text replies are one line per plane:
+	<icao> <call> <type> <lat> <lng> <track> <speed> <alt> <climb> <age>
+	with - for anything unknown, then an empty line.
+	Binary replies are a QueryHeader then count QueryRecords,
+	all little endian. Bad requests get "error ..." in both formats.
+
+	Each request is answered from a snapshot the query thread takes of
+	the live cache with readPlanes, with its own grid over the copy.
+	The decoder doesn't do anything for it and never waits on it.
+*/
+
+#define QUERY_CLIENTS 8		//connections served at once
+#define QUERY_MAGIC "ADSQ"
+
+/*
+	QueryHeader and QueryRecord
+	The binary reply layout, 16 bytes then 44 per plane.
+	flags are the PlaneFlags, fields without their flag are 0.
+*/
+struct QueryHeader
+{
+	char magic[4];
+	uint32_t count;
+	int64_t time;		//unix time of the snapshot
+};
+
+struct QueryRecord
+{
+	uint32_t icao;
+	uint32_t flags;
+	int32_t lat, lng;	//millionths of a degree
+	int32_t alt;		//ft
+	int32_t vert;		//ft/min
+	uint16_t trk;		//hundredths of a degree
+	uint16_t spd;		//tenths of a knot
+	uint32_t age;		//seconds since the last update
+	char call[8];		//space padded like the frame has it
+	char type[4];		//first 4 chars of the type, 0 padded
+};
+
+/*
+	QueryServer
+	Everything but live and stopping belongs to the query thread.
+	The snapshot grid is kept between requests, so taking a snapshot
+	only moves the planes that moved.
+*/
+struct QueryServer
+{
+	char *path;
+	int listenFd;
+	const struct Plane *live;	//the cache logPlane writes
+	int bufsize;
+	struct Plane *planes;		//snapshot of live
+	struct PlaneGrid grid;		//over planes
+	time_t time;			//when the snapshot was taken
+	char *reply;
+	int *slots;			//query results
+	volatile int stopping;
+	pthread_t thread;
+};
+
+/*
+	startQuery
+	Returns 0 on success, -1 if the socket can't be made at path,
+	out of memory, or there are no UNIX sockets (UCRT builds).
+	Removes a stale socket file left at path.
+
+	Serves the planes in buf, which has to stay allocated until
+	stopQuery.
+*/
+int startQuery(struct QueryServer *q, const char *path,
+	const struct Plane buf[], int bufsize);
+
+/*
+	stopQuery
+	Closes every connection, stops the thread and removes the socket.
+*/
+void stopQuery(struct QueryServer *q);
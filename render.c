@@ -0,0 +1,443 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "render.h"
+#include "output.h"
+
+#define RINGCOLOR 60, 60, 60
+#define CROSSCOLOR 120, 120, 120
+#define PNGBLOCK 65535	//max size of a stored deflate block
+
+/*
+	altColors
+	Altitude color ramp, roughly the same as the geo CPT
+	used by the GMT maps. Colors are interpolated between stops.
+*/
+static const struct {int alt; uint8_t r, g, b;} altColors[] =
+{
+	{0, 0, 170, 0},
+	{5000, 120, 200, 0},
+	{10000, 230, 230, 0},
+	{20000, 255, 150, 0},
+	{30000, 255, 60, 0},
+	{40000, 220, 0, 80},
+	{50000, 180, 0, 220}
+};
+#define ALTSTOPS (int)(sizeof(altColors) / sizeof(altColors[0]))
+
+static uint32_t crcTable[256];
+
+static void altColor(int alt, uint8_t c[3])
+{
+	int i;
+	double t;
+
+	if(alt <= altColors[0].alt)
+		i = 0, t = 0.;
+	else if(alt >= altColors[ALTSTOPS - 1].alt)
+		i = ALTSTOPS - 2, t = 1.;
+	else
+	{
+		for(i = 0;alt >= altColors[i + 1].alt;i++);
+		t = (double)(alt - altColors[i].alt) /
+			(altColors[i + 1].alt - altColors[i].alt);
+	}
+	c[0] = (uint8_t)(altColors[i].r + t * (altColors[i + 1].r - altColors[i].r));
+	c[1] = (uint8_t)(altColors[i].g + t * (altColors[i + 1].g - altColors[i].g));
+	c[2] = (uint8_t)(altColors[i].b + t * (altColors[i + 1].b - altColors[i].b));
+	return;
+}
+
+static inline void putPixel(struct MapRender *r, int x, int y,
+	uint8_t cr, uint8_t cg, uint8_t cb)
+{
+	uint8_t *p;
+	if(x < 0 || y < 0 || x >= r->width || y >= r->height)
+		return;
+	p = r->rgb + ((size_t)y * r->width + x) * 3;
+	p[0] = cr;
+	p[1] = cg;
+	p[2] = cb;
+	return;
+}
+
+//Bresenham, clipped per pixel
+static void drawLine(struct MapRender *r, int x0, int y0, int x1, int y1,
+	uint8_t cr, uint8_t cg, uint8_t cb)
+{
+	int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+	int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy, e2;
+
+	while(1)
+	{
+		putPixel(r, x0, y0, cr, cg, cb);
+		if(x0 == x1 && y0 == y1)
+			break;
+		e2 = 2 * err;
+		if(e2 >= dy)
+		{
+			err += dy;
+			x0 += sx;
+		}
+		if(e2 <= dx)
+		{
+			err += dx;
+			y0 += sy;
+		}
+	}
+	return;
+}
+
+//midpoint circle
+static void drawCircle(struct MapRender *r, int cx, int cy, int rad,
+	uint8_t cr, uint8_t cg, uint8_t cb)
+{
+	int x = rad, y = 0, err = 1 - rad;
+
+	while(x >= y)
+	{
+		putPixel(r, cx + x, cy + y, cr, cg, cb);
+		putPixel(r, cx + y, cy + x, cr, cg, cb);
+		putPixel(r, cx - y, cy + x, cr, cg, cb);
+		putPixel(r, cx - x, cy + y, cr, cg, cb);
+		putPixel(r, cx - x, cy - y, cr, cg, cb);
+		putPixel(r, cx - y, cy - x, cr, cg, cb);
+		putPixel(r, cx + y, cy - x, cr, cg, cb);
+		putPixel(r, cx + x, cy - y, cr, cg, cb);
+		y++;
+		if(err < 0)
+			err += 2 * y + 1;
+		else
+		{
+			x--;
+			err += 2 * (y - x) + 1;
+		}
+	}
+	return;
+}
+
+static void project(const struct MapRender *r, double rlat, double rlng,
+	double lat, double lng, int *x, int *y)
+{
+	double dlng = lng - rlng;
+	if(dlng > 180.)
+		dlng -= 360.;
+	else if(dlng < -180.)
+		dlng += 360.;
+	*x = r->width / 2 + (int)lround(dlng * cos(rlat * M_PI / 180.) *
+		60. * r->pxPerNm);
+	*y = r->height / 2 - (int)lround((lat - rlat) * 60. * r->pxPerNm);
+	return;
+}
+
+int initRender(struct MapRender *r, int width, int height, double range)
+{
+	size_t raw;
+	uint32_t c;
+	int i, k;
+
+	memset(r, 0, sizeof(*r));
+	r->width = width;
+	r->height = height;
+	r->range = range;
+	r->pxPerNm = (width < height ? width : height) / 2. / range;
+
+	//PNG: signature, IHDR, IDAT header, zlib header, block headers,
+	//adler, IDAT crc, IEND. PPM header is smaller than that.
+	raw = (size_t)height * (1 + (size_t)width * 3);
+	r->outSize = 8 + 25 + 8 + 2 + (raw / PNGBLOCK + 1) * 5 + raw + 4 + 4 + 12;
+	r->rgb = malloc((size_t)width * height * 3);
+	r->out = malloc(r->outSize);
+	if(r->rgb == NULL || r->out == NULL)
+	{
+		freeRender(r);
+		return -1;
+	}
+
+	if(crcTable[1] == 0)
+	{
+		for(i = 0;i < 256;i++)
+		{
+			c = (uint32_t)i;
+			for(k = 0;k < 8;k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			crcTable[i] = c;
+		}
+	}
+	return 0;
+}
+
+/*
+	addTrackPoint
+	Finds the plane's track, or takes over the empty or stalest one.
+*/
+static void addTrackPoint(struct MapRender *r, const struct Plane *p)
+{
+	struct Track *t = NULL;
+	int i, last;
+
+	for(i = 0;i < TRACKS;i++)
+	{
+		if(r->tracks[i].len && r->tracks[i].icao == p->icao)
+		{
+			t = &r->tracks[i];
+			break;
+		}
+		if(t == NULL || r->tracks[i].len == 0 ||
+			(t->len && r->tracks[i].lstUpd < t->lstUpd))
+			t = &r->tracks[i];
+	}
+	if(t->len == 0 || t->icao != p->icao)
+	{
+		t->icao = p->icao;
+		t->len = 0;
+		t->head = 0;
+	}
+	t->lstUpd = p->lstUpd;
+
+	last = (t->head + TRACKLEN - 1) % TRACKLEN;
+	if(t->len && t->lat[last] == (float)p->lat && t->lng[last] == (float)p->lng)
+		return;
+	t->lat[t->head] = (float)p->lat;
+	t->lng[t->head] = (float)p->lng;
+	t->alt[t->head] = p->pflags & ALTVALID ? p->alt : -1;
+	t->head = (t->head + 1) % TRACKLEN;
+	if(t->len < TRACKLEN)
+		t->len++;
+	return;
+}
+
+static void drawTrack(struct MapRender *r, const struct Track *t,
+	double rlat, double rlng)
+{
+	int i, k, x0, y0, x1, y1;
+	uint8_t c[3];
+
+	k = (t->head + TRACKLEN - t->len) % TRACKLEN;
+	project(r, rlat, rlng, t->lat[k], t->lng[k], &x0, &y0);
+	for(i = 1;i < t->len;i++)
+	{
+		k = (k + 1) % TRACKLEN;
+		project(r, rlat, rlng, t->lat[k], t->lng[k], &x1, &y1);
+		if(t->alt[k] < 0)
+			c[0] = c[1] = c[2] = 150;
+		else
+		{
+			altColor(t->alt[k], c);
+			//tracks are dimmer than the markers
+			c[0] = c[0] * 2 / 3;
+			c[1] = c[1] * 2 / 3;
+			c[2] = c[2] * 2 / 3;
+		}
+		drawLine(r, x0, y0, x1, y1, c[0], c[1], c[2]);
+		x0 = x1;
+		y0 = y1;
+	}
+	return;
+}
+
+void renderPlanes(struct MapRender *r, const struct Plane buf[], int bufsize,
+	double rlat, double rlng)
+{
+	int i, x, y, dx, dy, ring, step;
+	uint8_t c[3];
+
+	memset(r->rgb, 0, (size_t)r->width * r->height * 3);
+
+	//range rings every 10nm, or 50nm for big ranges
+	step = r->range > 100. ? 50 : 10;
+	for(ring = step;ring <= (int)(r->range * 1.5);ring += step)
+		drawCircle(r, r->width / 2, r->height / 2,
+			(int)lround(ring * r->pxPerNm), RINGCOLOR);
+	drawLine(r, r->width / 2 - 5, r->height / 2,
+		r->width / 2 + 5, r->height / 2, CROSSCOLOR);
+	drawLine(r, r->width / 2, r->height / 2 - 5,
+		r->width / 2, r->height / 2 + 5, CROSSCOLOR);
+
+	for(i = 0;i < bufsize;i++)
+	{
+		if((buf[i].pflags & ICAOFL) == 0)
+			break;
+		if(buf[i].pflags & POSVALID)
+			addTrackPoint(r, &buf[i]);
+	}
+	for(i = 0;i < TRACKS;i++)
+		if(r->tracks[i].len > 1)
+			drawTrack(r, &r->tracks[i], rlat, rlng);
+
+	//markers go on top of every track
+	for(i = 0;i < bufsize;i++)
+	{
+		if((buf[i].pflags & ICAOFL) == 0)
+			break;
+		if((buf[i].pflags & POSVALID) == 0)
+			continue;
+		project(r, rlat, rlng, buf[i].lat, buf[i].lng, &x, &y);
+		if(buf[i].pflags & ALTVALID)
+			altColor(buf[i].alt, c);
+		else
+		{
+			c[0] = c[1] = c[2] = 230;
+		}
+
+		//diamond, same symbol as the GMT map
+		for(dy = -3;dy <= 3;dy++)
+			for(dx = -3 + abs(dy);dx <= 3 - abs(dy);dx++)
+				putPixel(r, x + dx, y + dy, c[0], c[1], c[2]);
+		if(buf[i].pflags & TRKVALID)
+			drawLine(r, x, y,
+				x + (int)lround(9. * sin(buf[i].trk * M_PI / 180.)),
+				y - (int)lround(9. * cos(buf[i].trk * M_PI / 180.)),
+				c[0], c[1], c[2]);
+	}
+	return;
+}
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while(len--)
+		crc = crcTable[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+	return p + 4;
+}
+
+/*
+	encodePng
+	Returns the amount of bytes written to r->out.
+
+	Uses stored (uncompressed) deflate blocks, so no zlib is needed.
+	The files are bigger, but it is just a copy with a checksum,
+	which is what the Pi can afford every second.
+*/
+static size_t encodePng(struct MapRender *r)
+{
+	static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	uint8_t *p = r->out, *chunk;
+	size_t rowLen = (size_t)r->width * 3 + 1;
+	size_t raw = rowLen * r->height, left, n, col, cnt, k;
+	const uint8_t *src;
+	uint32_t a = 1, b = 0;	//adler32
+	int y;
+
+	memcpy(p, sig, 8);
+	p += 8;
+
+	chunk = p;
+	p = put32(p, 13);
+	memcpy(p, "IHDR", 4);
+	p = put32(p + 4, (uint32_t)r->width);
+	p = put32(p, (uint32_t)r->height);
+	*p++ = 8;	//bit depth
+	*p++ = 2;	//truecolor
+	*p++ = 0;	//deflate
+	*p++ = 0;	//adaptive filters
+	*p++ = 0;	//no interlace
+	p = put32(p, crc32Update(0xFFFFFFFFu, chunk + 4, 17) ^ 0xFFFFFFFFu);
+
+	chunk = p;
+	p += 8;	//length and type filled in after
+	*p++ = 0x78;	//zlib header, no compression
+	*p++ = 0x01;
+	left = raw;
+	y = 0;
+	col = 0;
+	while(left)
+	{
+		n = left < PNGBLOCK ? left : PNGBLOCK;
+		left -= n;
+		*p++ = left ? 0 : 1;	//final block flag
+		*p++ = (uint8_t)n;
+		*p++ = (uint8_t)(n >> 8);
+		*p++ = (uint8_t)~n;
+		*p++ = (uint8_t)(~n >> 8);
+		//rows are a filter byte (0, none) then the pixels
+		while(n)
+		{
+			if(col == 0)
+			{
+				*p = 0;
+				b = (b + a) % 65521;
+				p++;
+				col = 1;
+				n--;
+				continue;
+			}
+			cnt = rowLen - col < n ? rowLen - col : n;
+			src = r->rgb + (size_t)y * (rowLen - 1) + col - 1;
+			memcpy(p, src, cnt);
+			for(k = 0;k < cnt;k++)
+			{
+				a += src[k];
+				b += a;
+				//5552 bytes is the most b can take before
+				//it could overflow 32 bits
+				if(k % 5552 == 5551)
+				{
+					a %= 65521;
+					b %= 65521;
+				}
+			}
+			a %= 65521;
+			b %= 65521;
+			p += cnt;
+			n -= cnt;
+			col += cnt;
+			if(col == rowLen)
+			{
+				col = 0;
+				y++;
+			}
+		}
+	}
+	p = put32(p, b << 16 | a);
+	put32(chunk, (uint32_t)(p - chunk - 8));
+	memcpy(chunk + 4, "IDAT", 4);
+	p = put32(p, crc32Update(0xFFFFFFFFu, chunk + 4,
+		(size_t)(p - chunk - 4)) ^ 0xFFFFFFFFu);
+
+	p = put32(p, 0);
+	memcpy(p, "IEND", 4);
+	p = put32(p + 4, crc32Update(0xFFFFFFFFu, p, 4) ^ 0xFFFFFFFFu);
+	return (size_t)(p - r->out);
+}
+
+int writeFrame(struct MapRender *r, const char *filename)
+{
+	char tmpname[300];
+	size_t len, n, pixels;
+	int png;
+
+	n = strlen(filename);
+	png = n >= 4 && strcmp(filename + n - 4, ".png") == 0;
+	pixels = (size_t)r->width * r->height * 3;
+	if(png)
+		len = encodePng(r);
+	else
+		len = (size_t)sprintf((char*)r->out, "P6\n%d %d\n255\n",
+			r->width, r->height);
+
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+	//PPM pixels go straight from the frame, no need to copy them
+	return replaceFile(filename, tmpname, r->out, len,
+		png ? NULL : r->rgb, pixels);
+}
+
+void freeRender(struct MapRender *r)
+{
+	free(r->rgb);
+	free(r->out);
+	r->rgb = NULL;
+	r->out = NULL;
+	return;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include "logger.h"
+
+/*
+	RENDER.H
+	This is a small map renderer that doesn't need GMT.
+	It draws the planes (the same data createImage uses) around
+	rlat/rlng into an RGB buffer and writes it out as a PPM or PNG.
+
+	It's nowhere near as nice as the GMT maps, no coastlines or text,
+	but it is fast enough to redraw every second on the Pi
+	and has no dependencies.
+*/
+
+#define TRACKS 64	//planes with a remembered track
+#define TRACKLEN 32	//positions remembered per plane
+
+/*
+	Track
+	Recent positions of one plane, oldest first once the ring wraps.
+	Positions are only added when they change.
+*/
+struct Track
+{
+	int icao;
+	int len, head;
+	time_t lstUpd;
+	float lat[TRACKLEN], lng[TRACKLEN];
+	int alt[TRACKLEN];
+};
+
+/*
+	MapRender
+	Everything is allocated once in initRender,
+	drawing and writing frames don't allocate.
+
+	Projection is a flat plane around the receiver:
+	x = (lng - rlng) * cos(rlat) * 60nm, y = (lat - rlat) * 60nm
+	which is close enough inside the ~200nm ADS-B range.
+*/
+struct MapRender
+{
+	int width, height;
+	double range;		//nm from center to the nearest edge
+	double pxPerNm;
+	uint8_t *rgb;		//width * height * 3
+	uint8_t *out;		//encoded file (PNG needs room for headers)
+	size_t outSize;
+	struct Track tracks[TRACKS];
+};
+
+/*
+	initRender
+	Returns 0 on success, -1 if the buffers couldn't be allocated.
+	range is how many nautical miles the edges are from rlat/rlng.
+*/
+int initRender(struct MapRender *r, int width, int height, double range);
+
+/*
+	renderPlanes
+	Clears the frame, draws range rings, then each plane's track and a
+	marker colored by altitude (white if altitude unknown) with a tick
+	in the direction of its track if that is known.
+
+	Also adds the current positions to the tracks, so calling this
+	about every second is what builds the track lines.
+*/
+void renderPlanes(struct MapRender *r, const struct Plane buf[], int bufsize,
+	double rlat, double rlng);
+
+/*
+	writeFrame
+	Returns 0 on success, -1 on any file error.
+	Writes a PNG if filename ends in ".png", otherwise a binary PPM.
+
+	The frame is written to "<filename>.tmp" then renamed over filename,
+	so something watching the file never reads half a frame.
+*/
+int writeFrame(struct MapRender *r, const char *filename);
+
+/*
+	freeRender
+	Frees the buffers from initRender.
+*/
+void freeRender(struct MapRender *r);
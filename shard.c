@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "shard.h"
+
+#define SHARD_MASK (SHARD_QUEUE - 1)
+#define SHARD_BATCH 256		//frames decoded between clock reads
+
+//ICAOs are handed out in blocks, so mix the bits before picking a shard
+static int shardOf(const struct ShardSet *set, int icao)
+{
+	return (int)((((uint32_t)icao * 2654435761u) >> 8) %
+		(uint32_t)set->count);
+}
+
+//decodes a frame and logs it into the worker's own planes
+static void shardFrame(struct PlaneShard *s, const union AdsbFrame *frame,
+	unsigned int level, time_t now)
+{
+	struct AdsbEvent ev;
+	unsigned int seq;
+	int slot;
+
+	if(decodeEvent(frame, s->rlat, s->rlng, &ev))
+		return;
+	s->frames++;
+	slot = logEvent(s->planes, s->size, &ev, now);
+	if(slot < 0)
+		return;
+
+	//odd while the stats are being changed, see copyStats
+	seq = s->statSeq[slot];
+	__atomic_store_n(&s->statSeq[slot], seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	countMessage(&s->stats[slot], ev.icao, ev.tc, level, now);
+	__atomic_store_n(&s->statSeq[slot], seq + 2, __ATOMIC_RELEASE);
+	return;
+}
+
+static void *shardThread(void *arg)
+{
+	struct PlaneShard *s = arg;
+	struct ShardCell *c;
+	struct timespec until;
+	time_t now = time(NULL);
+	int batch = 0;
+
+	for(;;)
+	{
+		c = &s->cells[s->head & SHARD_MASK];
+		if(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) == s->head + 1)
+		{
+			if(++batch == SHARD_BATCH)
+			{
+				now = time(NULL);
+				batch = 0;
+			}
+			shardFrame(s, &c->frame, c->level, now);
+			//free for the producers one lap later
+			__atomic_store_n(&c->seq, s->head + SHARD_QUEUE,
+				__ATOMIC_RELEASE);
+			s->head++;
+			continue;
+		}
+
+		//empty, sleep until a producer sees sleeping and wakes us
+		pthread_mutex_lock(&s->lock);
+		__atomic_store_n(&s->sleeping, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != s->head + 1)
+		{
+			if(s->stopping)
+			{
+				pthread_mutex_unlock(&s->lock);
+				return NULL;
+			}
+			clock_gettime(CLOCK_REALTIME, &until);
+			until.tv_sec++;
+			pthread_cond_timedwait(&s->wake, &s->lock, &until);
+		}
+		__atomic_store_n(&s->sleeping, 0, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&s->lock);
+		now = time(NULL);
+		batch = 0;
+	}
+}
+
+static void freeShard(struct PlaneShard *s)
+{
+	free(s->cells);
+	free(s->planes);
+	free(s->stats);
+	free(s->statSeq);
+	free(s->merged);
+	free(s->slot);
+	return;
+}
+
+int startShards(struct ShardSet *set, int count, int size, double rlat,
+	double rlng)
+{
+	struct PlaneShard *s;
+	unsigned int i;
+	int n;
+
+	memset(set, 0, sizeof(*set));
+	if(count < 1 || count > SHARD_MAX || size < 1)
+		return -1;
+	set->shards = calloc(count, sizeof(struct PlaneShard));
+	set->copy = calloc(size, sizeof(struct Plane));
+	if(set->shards == NULL || set->copy == NULL)
+		goto fail;
+	set->size = size;
+
+	for(n = 0;n < count;n++)
+	{
+		s = &set->shards[n];
+		s->cells = malloc(SHARD_QUEUE * sizeof(struct ShardCell));
+		s->planes = calloc(size, sizeof(struct Plane));
+		s->stats = calloc(size, sizeof(struct PlaneStats));
+		s->statSeq = calloc(size, sizeof(unsigned int));
+		s->merged = calloc(size, sizeof(unsigned int));
+		s->slot = malloc(size * sizeof(int));
+		if(s->cells == NULL || s->planes == NULL || s->stats == NULL ||
+			s->statSeq == NULL || s->merged == NULL || s->slot == NULL)
+		{
+			freeShard(s);
+			goto stop;
+		}
+		for(i = 0;i < SHARD_QUEUE;i++)
+			s->cells[i].seq = i;
+		for(i = 0;i < (unsigned int)size;i++)
+			s->slot[i] = -1;
+		s->size = size;
+		s->rlat = rlat;
+		s->rlng = rlng;
+		pthread_mutex_init(&s->lock, NULL);
+		pthread_cond_init(&s->wake, NULL);
+		if(pthread_create(&s->thread, NULL, shardThread, s))
+		{
+			pthread_mutex_destroy(&s->lock);
+			pthread_cond_destroy(&s->wake);
+			freeShard(s);
+			goto stop;
+		}
+		set->count = n + 1;
+	}
+	return 0;
+
+stop:
+	stopShards(set);
+	freeShards(set);
+	return -1;
+fail:
+	free(set->shards);
+	free(set->copy);
+	return -1;
+}
+
+int routeFrame(struct ShardSet *set, const union AdsbFrame *frame,
+	unsigned int level)
+{
+	struct PlaneShard *s;
+	struct ShardCell *c;
+	unsigned int pos, seq;
+
+	if(crcSyndrome(frame) != 0)
+		return -1;
+	s = &set->shards[shardOf(set, (int)adsbIcao(frame))];
+
+	pos = __atomic_load_n(&s->tail, __ATOMIC_RELAXED);
+	for(;;)
+	{
+		c = &s->cells[pos & SHARD_MASK];
+		seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+		if(seq == pos)
+		{
+			//on failure pos is reloaded with the new tail
+			if(__atomic_compare_exchange_n(&s->tail, &pos, pos + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if((int)(seq - pos) < 0)
+		{
+			//a lap behind, the worker hasn't taken it yet
+			__atomic_fetch_add(&s->waits, 1, __ATOMIC_RELAXED);
+			sched_yield();
+			pos = __atomic_load_n(&s->tail, __ATOMIC_RELAXED);
+		}
+		else
+			pos = __atomic_load_n(&s->tail, __ATOMIC_RELAXED);
+	}
+
+	c->frame = *frame;
+	c->level = (uint16_t)level;
+	__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+
+	//pairs with the fence in shardThread, one of the two sees the other
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&s->sleeping, __ATOMIC_RELAXED))
+	{
+		pthread_mutex_lock(&s->lock);
+		pthread_cond_signal(&s->wake);
+		pthread_mutex_unlock(&s->lock);
+	}
+	return 0;
+}
+
+//copies stats[i] as it was between two countMessage calls
+static void copyStats(const struct PlaneShard *s, int i,
+	struct PlaneStats *out)
+{
+	unsigned int seq;
+
+	do
+	{
+		seq = __atomic_load_n(&s->statSeq[i], __ATOMIC_ACQUIRE);
+		memcpy(out, &s->stats[i], sizeof(struct PlaneStats));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while((seq & 1) ||
+		__atomic_load_n(&s->statSeq[i], __ATOMIC_RELAXED) != seq);
+	return;
+}
+
+void mergeShards(struct ShardSet *set, struct Plane buf[],
+	struct PlaneStats stats[])
+{
+	struct PlaneShard *s;
+	int n, i, slot;
+
+	for(n = 0;n < set->count;n++)
+	{
+		s = &set->shards[n];
+		readPlanes(s->planes, set->copy, s->size);
+		for(i = 0;i < s->size && (set->copy[i].pflags & ICAOFL);i++)
+		{
+			if(s->slot[i] < 0)
+				s->slot[i] = set->merged++;
+			slot = s->slot[i];
+			if(set->copy[i].seq != s->merged[i])
+			{
+				storePlane(buf, slot, &set->copy[i]);
+				s->merged[i] = set->copy[i].seq;
+			}
+			copyStats(s, i, &stats[slot]);
+		}
+	}
+	return;
+}
+
+void stopShards(struct ShardSet *set)
+{
+	struct PlaneShard *s;
+	int n;
+
+	for(n = 0;n < set->count;n++)
+	{
+		s = &set->shards[n];
+		pthread_mutex_lock(&s->lock);
+		s->stopping = 1;
+		pthread_cond_signal(&s->wake);
+		pthread_mutex_unlock(&s->lock);
+	}
+	for(n = 0;n < set->count;n++)
+		pthread_join(set->shards[n].thread, NULL);
+	return;
+}
+
+void freeShards(struct ShardSet *set)
+{
+	struct PlaneShard *s;
+	int n;
+
+	for(n = 0;n < set->count;n++)
+	{
+		s = &set->shards[n];
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->wake);
+		freeShard(s);
+	}
+	free(set->shards);
+	free(set->copy);
+	set->shards = NULL;
+	set->copy = NULL;
+	set->count = 0;
+	return;
+}
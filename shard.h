@@ -0,0 +1,122 @@
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+#include "adsb.h"
+#include "logger.h"
+#include "stats.h"
+
+/*
+	SHARD.H
+	Decoding and logging spread over worker threads, for when one
+	thread calling logPlane can't keep up with the input.
+
+	The planes are split by a hash of their ICAO, each shard owns its
+	own Plane buffer and PlaneStats and is the only thread that ever
+	changes them, so nothing is locked. Any thread can route a frame
+	that passed the parity check to its owner's queue, a ring of
+	SHARD_QUEUE frames many threads can add to and the worker takes
+	from.
+
+	The shards' buffers are read with readPlanes like any other, and
+	mergeShards copies them into one cache the size of all of them
+	for the display and the outputs.
+*/
+
+#define SHARD_QUEUE 4096	//frames waiting per shard, a power of 2
+#define SHARD_MAX 64
+
+/*
+	ShardCell
+	seq is the position of the cell the producers wait for, then
+	position + 1 once the frame is in it, for the worker.
+*/
+struct ShardCell
+{
+	unsigned int seq;
+	uint16_t level;
+	union AdsbFrame frame;
+};
+
+/*
+	PlaneShard
+	tail is taken by producers with compare and swap, head is only
+	the worker's, they are a cache line apart so they don't bounce.
+*/
+struct PlaneShard
+{
+	unsigned int tail __attribute__((aligned(64)));
+	unsigned int head __attribute__((aligned(64)));
+	struct ShardCell *cells;
+
+	struct Plane *planes;
+	struct PlaneStats *stats;
+	unsigned int *statSeq;	//like Plane.seq, for stats
+	unsigned int *merged;	//seq of each plane last merged
+	int *slot;		//where each plane is merged to, -1 if not yet
+	int size;
+	double rlat, rlng;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int sleeping;		//worker is waiting for frames
+	int stopping;
+
+	unsigned long frames;	//decoded by the worker
+	unsigned long waits;	//times a producer found the queue full
+};
+
+/*
+	ShardSet
+	count shards of size planes each.
+	A shard's slot is given the next free slot of the merged cache
+	the first time it is merged and keeps it, so the merged cache
+	fills from the front like one logPlane fills.
+*/
+struct ShardSet
+{
+	struct PlaneShard *shards;
+	int count, size;
+	int merged;		//slots of the merged cache in use
+	struct Plane *copy;	//scratch for mergeShards
+};
+
+/*
+	startShards
+	Returns 0 if count workers are running, -1 if count is out of
+	range or out of memory (nothing is left running).
+	Positions are decoded relative to rlat, rlng.
+*/
+int startShards(struct ShardSet *set, int count, int size, double rlat,
+	double rlng);
+
+/*
+	routeFrame
+	Returns 0 if frame was queued for its shard, -1 if it failed the
+	parity check. Waits while the shard's queue is full.
+	Can be called from any amount of threads at once.
+*/
+int routeFrame(struct ShardSet *set, const union AdsbFrame *frame,
+	unsigned int level);
+
+/*
+	mergeShards
+	Copies every shard's planes into buf and their stats into stats,
+	both count*size long, with storePlane for the planes that changed
+	since the last merge. Call it from the thread that owns buf.
+*/
+void mergeShards(struct ShardSet *set, struct Plane buf[],
+	struct PlaneStats stats[]);
+
+/*
+	stopShards
+	Waits for the workers to finish what is queued and stop.
+	Nothing can be routed after this, the planes can still be merged.
+*/
+void stopShards(struct ShardSet *set);
+
+/*
+	freeShards
+	Frees the shards, after stopShards.
+*/
+void freeShards(struct ShardSet *set);
@@ -0,0 +1,290 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef RTLSDR
+#include <rtl-sdr.h>
+#endif
+
+#include "source.h"
+
+static int initSource(struct SampleSource *s, enum SourceType type,
+	unsigned int rate)
+{
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	s->type = type;
+	s->rate = rate;
+	//the extra buffer is where samples go when the ring is full
+	s->mem = malloc((size_t)(SOURCE_BUFS + 1) * SOURCE_BUFLEN);
+	if(s->mem == NULL)
+		return -1;
+	for(i = 0;i < SOURCE_BUFS;i++)
+		s->bufs[i].iq = s->mem + (size_t)i * SOURCE_BUFLEN;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	return 0;
+}
+
+/*
+	Ring helpers
+	All three are called with the lock held.
+	The buffer from freeBuf can be filled without the lock,
+	since the reader never looks past filled.
+*/
+static struct SampleBuf *freeBuf(struct SampleSource *s)
+{
+	if(s->filled == SOURCE_BUFS)
+		return NULL;
+	return &s->bufs[(s->head + s->filled) % SOURCE_BUFS];
+}
+
+static void pushBuf(struct SampleSource *s, struct SampleBuf *buf,
+	size_t samples)
+{
+	buf->samples = samples;
+	buf->dropped = s->pending;
+	s->pending = 0;
+	s->filled++;
+	pthread_cond_broadcast(&s->cond);
+	return;
+}
+
+static void dropSamples(struct SampleSource *s, size_t samples)
+{
+	s->overruns++;
+	s->dropped += samples;
+	s->pending += samples;
+	return;
+}
+
+//sleeps until sec seconds after start
+static void sleepUntil(const struct timespec *start, double sec)
+{
+	struct timespec now, wait;
+	double left;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	left = sec - (double)(now.tv_sec - start->tv_sec) -
+		(double)(now.tv_nsec - start->tv_nsec) / 1e9;
+	if(left <= 0.)
+		return;
+	wait.tv_sec = (time_t)left;
+	wait.tv_nsec = (long)((left - (double)wait.tv_sec) * 1e9);
+	nanosleep(&wait, NULL);
+	return;
+}
+
+/*
+	emulatorThread
+	A dongle hands over a buffer once it has been filled, so each
+	buffer is due when all of its samples would have been received.
+	At that time it either goes into a free buffer or, if the ring is
+	full, is read into the spare buffer and counted as dropped.
+*/
+static void *emulatorThread(void *arg)
+{
+	struct SampleSource *s = arg;
+	struct SampleBuf *buf;
+	struct timespec start;
+	uint64_t sent = 0;
+	size_t n;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_mutex_lock(&s->lock);
+	while(!s->stopping)
+	{
+		if(s->speed > 0.)
+		{
+			pthread_mutex_unlock(&s->lock);
+			sleepUntil(&start, (double)(sent + SOURCE_BUFLEN / 2) /
+				((double)s->rate * s->speed));
+			pthread_mutex_lock(&s->lock);
+			if(s->stopping)
+				break;
+		}
+		buf = freeBuf(s);
+		if(buf == NULL && s->speed <= 0.)
+		{
+			//not paced, so wait for the reader instead of dropping
+			pthread_cond_wait(&s->cond, &s->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&s->lock);
+
+		n = fread(buf ? buf->iq : s->mem + (size_t)SOURCE_BUFS *
+			SOURCE_BUFLEN, 2, SOURCE_BUFLEN / 2, s->file);
+		sent += n;
+
+		pthread_mutex_lock(&s->lock);
+		if(n == 0)
+			break;
+		if(buf)
+			pushBuf(s, buf, n);
+		else
+			dropSamples(s, n);
+	}
+	s->ended = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+int openEmulator(struct SampleSource *s, const char *filename,
+	unsigned int rate, double speed)
+{
+	if(initSource(s, SOURCE_EMULATOR, rate))
+		return -1;
+	s->speed = speed;
+	if(filename[0] == '-' && filename[1] == 0)
+		s->file = stdin;
+	else
+		s->file = fopen(filename, "rb");
+	if(s->file == NULL)
+	{
+		closeSource(s);
+		return -1;
+	}
+	return 0;
+}
+
+#ifdef RTLSDR
+/*
+	rtlCallback
+	librtlsdr reuses its buffer as soon as this returns,
+	so the samples are copied into the ring once, and that copy
+	is what the reader gets.
+*/
+static void rtlCallback(unsigned char *data, uint32_t len, void *ctx)
+{
+	struct SampleSource *s = ctx;
+	struct SampleBuf *buf;
+
+	if(len > SOURCE_BUFLEN)
+		len = SOURCE_BUFLEN;
+	pthread_mutex_lock(&s->lock);
+	buf = freeBuf(s);
+	pthread_mutex_unlock(&s->lock);
+	if(buf)
+		memcpy(buf->iq, data, len);
+
+	pthread_mutex_lock(&s->lock);
+	if(buf)
+		pushBuf(s, buf, len / 2);
+	else
+		dropSamples(s, len / 2);
+	pthread_mutex_unlock(&s->lock);
+	return;
+}
+
+//read_async only returns once cancelled or the device is gone
+static void *rtlThread(void *arg)
+{
+	struct SampleSource *s = arg;
+
+	rtlsdr_read_async(s->dev, rtlCallback, s, SOURCE_BUFS, SOURCE_BUFLEN);
+	pthread_mutex_lock(&s->lock);
+	s->ended = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+#endif
+
+int openRtlSdr(struct SampleSource *s, int index, unsigned int rate)
+{
+#ifdef RTLSDR
+	rtlsdr_dev_t *dev;
+
+	if(rtlsdr_open(&dev, (uint32_t)index) < 0)
+		return -1;
+	if(rtlsdr_set_sample_rate(dev, rate) < 0 ||
+		rtlsdr_set_center_freq(dev, SOURCE_FREQ) < 0 ||
+		rtlsdr_set_tuner_gain_mode(dev, 0) < 0 ||	//auto gain
+		rtlsdr_reset_buffer(dev) < 0 ||
+		initSource(s, SOURCE_RTLSDR, rate))
+	{
+		rtlsdr_close(dev);
+		return -1;
+	}
+	s->dev = dev;
+	return 0;
+#else
+	(void)s;
+	(void)index;
+	(void)rate;
+	return -1;
+#endif
+}
+
+int runSource(struct SampleSource *s, SourceCallback cb, void *arg)
+{
+	struct SampleBuf *buf;
+	void *(*thread)(void*) = emulatorThread;
+
+#ifdef RTLSDR
+	if(s->type == SOURCE_RTLSDR)
+		thread = rtlThread;
+#endif
+	if(pthread_create(&s->thread, NULL, thread, s))
+		return -1;
+
+	pthread_mutex_lock(&s->lock);
+	for(;;)
+	{
+		while(s->filled == 0 && !s->ended && !s->stopping)
+			pthread_cond_wait(&s->cond, &s->lock);
+		if(s->filled == 0 || s->stopping)
+			break;
+		buf = &s->bufs[s->head];
+		pthread_mutex_unlock(&s->lock);
+
+		cb(buf, arg);
+
+		pthread_mutex_lock(&s->lock);
+		s->head = (s->head + 1) % SOURCE_BUFS;
+		s->filled--;
+		s->buffers++;
+		pthread_cond_broadcast(&s->cond);
+	}
+	s->stopping = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+
+#ifdef RTLSDR
+	if(s->type == SOURCE_RTLSDR)
+		rtlsdr_cancel_async(s->dev);
+#endif
+	pthread_join(s->thread, NULL);
+	return 0;
+}
+
+void stopSource(struct SampleSource *s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->stopping = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	return;
+}
+
+void closeSource(struct SampleSource *s)
+{
+	if(s->file != NULL && s->file != stdin)
+		fclose(s->file);
+#ifdef RTLSDR
+	if(s->dev != NULL)
+		rtlsdr_close(s->dev);
+#endif
+	if(s->mem != NULL)
+	{
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+	}
+	free(s->mem);
+	s->file = NULL;
+	s->dev = NULL;
+	s->mem = NULL;
+	return;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+	SOURCE.H
+	This file contains the sample sources, the things that hand
+	8 bit I/Q samples to the demodulator as they arrive.
+
+	A source fills a ring of buffers that are all allocated when it is
+	opened. Filling happens on the source's own thread, and runSource
+	hands each filled buffer to a callback on the calling thread, in
+	place, then gives it back to be filled again.
+
+	If the callback falls behind and every buffer is full, new samples
+	are dropped, same as the dongle's USB buffers overflowing. The next
+	buffer says how many samples were lost before it.
+
+	Backends:
+	RTL-SDR, through librtlsdr, only built with RTLSDR defined.
+	Emulator, plays back a capture file at the speed a dongle would
+	deliver it, so the live path can be tested without hardware.
+*/
+
+#define SOURCE_BUFS 16			//buffers in the ring
+#define SOURCE_BUFLEN (16 * 16384)	//bytes per buffer, as librtlsdr wants
+#define SOURCE_FREQ 1090000000		//Mode S frequency in Hz
+
+enum SourceType {SOURCE_EMULATOR, SOURCE_RTLSDR};
+
+/*
+	SampleBuf
+	One filled buffer as the callback sees it.
+	dropped is the amount of samples lost right before this buffer.
+*/
+struct SampleBuf
+{
+	uint8_t *iq;
+	size_t samples;
+	unsigned long dropped;
+};
+
+typedef void (*SourceCallback)(const struct SampleBuf *buf, void *arg);
+
+/*
+	SampleSource
+	The ring is bufs[head] to bufs[head + filled - 1], everything
+	past that can be filled. All ring fields are under lock.
+*/
+struct SampleSource
+{
+	enum SourceType type;
+	unsigned int rate;		//samples per second
+	uint8_t *mem;			//every buffer, plus one to drop into
+	struct SampleBuf bufs[SOURCE_BUFS];
+	int head, filled;
+	int ended;			//no more samples are coming
+	int stopping;			//stopSource was called
+	unsigned long pending;		//dropped since the last filled buffer
+
+	unsigned long buffers;		//buffers delivered
+	unsigned long overruns;		//times the ring was full
+	unsigned long dropped;		//samples lost to overruns
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	//emulator
+	FILE *file;
+	double speed;			//times real time, 0 is no pacing
+
+	//RTL-SDR
+	void *dev;
+};
+
+/*
+	openEmulator
+	Returns 0 on success, -1 if the file can't be opened or out of memory.
+
+	Plays back filename ("-" is stdin) as rate samples per second
+	times speed. A speed of 0 reads as fast as the callback takes
+	buffers and never drops, anything else drops samples like a
+	dongle does when the callback can't keep up.
+*/
+int openEmulator(struct SampleSource *s, const char *filename,
+	unsigned int rate, double speed);
+
+/*
+	openRtlSdr
+	Returns 0 on success, -1 if there is no device at index,
+	it can't be set up, or the program was built without RTLSDR.
+
+	Tunes to SOURCE_FREQ at rate samples per second with auto gain.
+*/
+int openRtlSdr(struct SampleSource *s, int index, unsigned int rate);
+
+/*
+	runSource
+	Returns 0 when the source ended or stopSource was called,
+	-1 if the source thread couldn't be started.
+
+	Calls cb on the calling thread for every buffer in order.
+	The buffer belongs to the callback until it returns.
+*/
+int runSource(struct SampleSource *s, SourceCallback cb, void *arg);
+
+/*
+	stopSource
+	Makes runSource return after the current buffer.
+	Safe to call from the callback.
+*/
+void stopSource(struct SampleSource *s);
+
+/*
+	closeSource
+	Closes the device or file and frees the buffers.
+*/
+void closeSource(struct SampleSource *s);
@@ -0,0 +1,96 @@
+#include <string.h>
+#include <math.h>
+#include "stats.h"
+#include "demod.h"
+
+void countMessage(struct PlaneStats *s, int icao, int tc,
+	unsigned int level, time_t now)
+{
+	time_t t;
+
+	if(s->icao != icao || s->last == 0)
+	{
+		memset(s, 0, sizeof(*s));
+		s->icao = icao;
+		s->last = now;
+	}
+	//clear the seconds since the last message, at most all of them
+	for(t = s->last + 1;t <= now && t <= s->last + STATS_WINDOW;t++)
+		s->window[t % STATS_WINDOW] = 0;
+	if(now > s->last)
+		s->last = now;
+
+	s->msgs[messageKind(tc)]++;
+	if(s->window[s->last % STATS_WINDOW] < UINT16_MAX)
+		s->window[s->last % STATS_WINDOW]++;
+	if(level > 0)
+	{
+		if(s->levels == 0 || level < s->levelMin)
+			s->levelMin = (uint16_t)level;
+		if(level > s->levelMax)
+			s->levelMax = (uint16_t)level;
+		s->levels++;
+		s->levelSum += level;
+	}
+	return;
+}
+
+unsigned long totalMessages(const struct PlaneStats *s)
+{
+	unsigned long n = 0;
+	int k;
+	for(k = 0;k < STATS_KINDS;k++)
+		n += s->msgs[k];
+	return n;
+}
+
+double messageRate(const struct PlaneStats *s, time_t now)
+{
+	unsigned long n = 0;
+	time_t t;
+
+	//seconds after last are empty, and only the last STATS_WINDOW
+	//seconds up to last are kept
+	t = now - STATS_WINDOW + 1;
+	if(t < s->last - STATS_WINDOW + 1)
+		t = s->last - STATS_WINDOW + 1;
+	for(;t <= s->last;t++)
+		n += s->window[t % STATS_WINDOW];
+	return (double)n / STATS_WINDOW;
+}
+
+double levelDb(unsigned int level)
+{
+	if(level == 0)
+		return -99.;
+	return 10. * log10((double)level / DEMOD_FULLSCALE);
+}
+
+void printStats(FILE *out, const struct Plane buf[],
+	const struct PlaneStats stats[], int bufsize, time_t now)
+{
+	const struct PlaneStats *s;
+	int i;
+
+	fprintf(out, "%6s %7s %6s %6s %6s %6s %6s %6s %17s\n", "ICAO", "MSGS",
+		"IDENT", "SURF", "AIR", "VEL", "OTHER", "MSG/S",
+		"RSSI MIN/AVG/MAX");
+	for(i = 0;i < bufsize && (buf[i].pflags & ICAOFL);i++)
+	{
+		s = &stats[i];
+		if(s->icao != buf[i].icao)
+			continue;	//nothing counted since it came back
+		fprintf(out, "%.6X %7lu %6u %6u %6u %6u %6u %6.1f", s->icao,
+			totalMessages(s), s->msgs[STATS_IDENT],
+			s->msgs[STATS_SURFACE], s->msgs[STATS_AIRBORNE],
+			s->msgs[STATS_VELOCITY], s->msgs[STATS_OTHER],
+			messageRate(s, now));
+		if(s->levels > 0)
+			fprintf(out, " %5.1f/%5.1f/%5.1f\n", levelDb(s->levelMin),
+				levelDb((unsigned int)(s->levelSum / s->levels)),
+				levelDb(s->levelMax));
+		else
+			fprintf(out, " %17s\n", "-");
+	}
+	return;
+}
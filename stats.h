@@ -0,0 +1,78 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "logger.h"
+
+/*
+	STATS.H
+	How well each plane is being received: messages of each kind,
+	messages a second over the last STATS_WINDOW seconds, and for
+	frames from the -b demodulator, their signal level.
+
+	PlaneStats sit in an array next to the Plane buffer, stats[i] is
+	for buf[i], and logPlane returns the slot to count a message in.
+	They are only touched by the thread calling logPlane.
+
+	Levels are the mean magnitude of a frame's pulses from demod.h,
+	a power where DEMOD_FULLSCALE is the most 8 bit samples can show,
+	and are shown as dBFS.
+*/
+
+#define STATS_WINDOW 10		//seconds the message rate is averaged over
+
+//msgs[] is indexed by messageKind (decode.h)
+enum StatsKind {STATS_IDENT = KIND_IDENT, STATS_SURFACE = KIND_SURFACE,
+	STATS_AIRBORNE = KIND_AIRBORNE, STATS_VELOCITY = KIND_VELOCITY,
+	STATS_OTHER = KIND_OTHER, STATS_KINDS = KIND_COUNT};
+
+/*
+	PlaneStats
+	window[t % STATS_WINDOW] is the amount of messages in second t,
+	for the STATS_WINDOW seconds up to last.
+*/
+struct PlaneStats
+{
+	int icao;		//whose these are, a new plane starts over
+	uint32_t msgs[STATS_KINDS];
+	uint16_t window[STATS_WINDOW];
+	time_t last;		//second of the latest message
+	uint16_t levelMin, levelMax;
+	uint32_t levels;	//messages with a level
+	uint64_t levelSum;
+};
+
+/*
+	countMessage
+	Counts a message of type code tc from icao at now, with its
+	level, or 0 if it has none. Starts over if the slot had another
+	plane in it.
+*/
+void countMessage(struct PlaneStats *s, int icao, int tc,
+	unsigned int level, time_t now);
+
+/*
+	totalMessages
+	Returns the amount of messages of every kind.
+*/
+unsigned long totalMessages(const struct PlaneStats *s);
+
+/*
+	messageRate
+	Returns messages a second over the STATS_WINDOW seconds up to now.
+*/
+double messageRate(const struct PlaneStats *s, time_t now);
+
+/*
+	levelDb
+	Returns a level in dBFS, 0 at full scale, -99 for 0.
+*/
+double levelDb(unsigned int level);
+
+/*
+	printStats
+	Prints a line per plane in buf with its message counts, rate and
+	levels, for the end of a run.
+*/
+void printStats(FILE *out, const struct Plane buf[],
+	const struct PlaneStats stats[], int bufsize, time_t now);
@@ -1,200 +1,1948 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "adsb.h"
 #include "decode.h"
 #include "logger.h"
+#include "grid.h"
+#include "demod.h"
+#include "output.h"
+#include "archive.h"
+#include "stats.h"
+#include "shard.h"
+#include "libadsb.h"
+#include "loop.h"
+#include "query.h"
+#include "alloc.h"
+
+/*
+	TEST.C
+	Checks the decoder against known frames and the fast paths
+	against the plain versions they replaced.
+
+	Golden tests decode frames with published answers and compare
+	every value. Differential tests run the table driven and SIMD code
+	next to a reference on large random inputs, any difference fails,
+	and the time per call of both is printed.
+
+	Every test prints PASS or FAIL with how long it took.
+	Exits with 1 if anything failed, so make check can be used before
+	accepting a change to any of the fast paths.
+*/
+
+#define CORPUS (1 << 18)	//random inputs per differential test
 
 int changeTimeOnPosition;
 double rlat, rlng;
 
-int main()
+static int checks, failures;
+
+//prints the failed expression but keeps going, so one run shows everything
+#define CHECK(cond) check((cond), #cond, __LINE__)
+#define CHECKNEAR(a, b, tol) check(fabs((double)(a) - (double)(b)) <= (tol), \
+	#a " == " #b, __LINE__)
+
+static int check(int ok, const char *what, int line)
+{
+	checks++;
+	if(!ok)
+	{
+		failures++;
+		printf("\ttest.c:%d: %s\n", line, what);
+	}
+	return ok;
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+static void printRate(const char *what, double sec, long n)
+{
+	printf("\t%-24s %8.1f ns/call\n", what, sec * 1e9 / (double)n);
+	return;
+}
+
+//xorshift64*, so the corpora are the same on every run
+static uint64_t seed = 1;
+
+static uint64_t random64(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return seed * 0x2545F4914F6CDD1Dull;
+}
+
+static double uniform(void)
+{
+	return (double)(random64() >> 11) / 9007199254740992.;
+}
+
+//fills a frame from 28 hex chars without going through parseHexFrame
+static void setFrame(union AdsbFrame *f, const char *hex)
+{
+	unsigned int b;
+	int i;
+	for(i = 0;i < 14;i++)
+	{
+		sscanf(hex + 2 * i, "%2x", &b);
+		f->frame[i] = (uint8_t)b;
+	}
+	return;
+}
+
+static void randomFrame(union AdsbFrame *f)
+{
+	uint64_t r = random64();
+	int i;
+	for(i = 0;i < 8;i++)
+		f->frame[i] = (uint8_t)(r >> 8 * i);
+	r = random64();
+	for(i = 8;i < 14;i++)
+		f->frame[i] = (uint8_t)(r >> 8 * (i - 8));
+	return;
+}
+
+//chip k of a frame, the preamble then every bit as high-low or low-high
+static int frameChip(const union AdsbFrame *f, int k)
+{
+	static const uint8_t chips[DEMOD_PREAMBLE] = {1,0,1,0,0,0,0,1,0,1};
+	if(k < DEMOD_PREAMBLE)
+		return chips[k];
+	return ((f->frame[(k - DEMOD_PREAMBLE) / 16] >>
+		(7 - (k - DEMOD_PREAMBLE) / 2 % 8)) & 1) ^ (k & 1);
+}
+
+static void demodFound(const struct DemodFrame *f, void *arg)
+{
+	*(struct DemodFrame*)arg = *f;
+	return;
+}
+
+//0x8D4840D6202CC371C32CE0576098, identification KLM1023
+static void testIdent(void)
+{
+	union AdsbFrame f;
+	struct AdsbEvent ev;
+	char call[9];
+	uint64_t packed;
+	uint8_t cat;
+
+	setFrame(&f, "8D4840D6202CC371C32CE0576098");
+	CHECK(sizeof(union AdsbFrame) == 14);
+	CHECK(adsbDf(&f) == 17);
+	CHECK(adsbCa(&f) == 5);
+	CHECK(adsbIcao(&f) == 0x4840D6);
+	CHECK(adsbPi(&f) == 0x576098);
+	CHECK(adsbTc(&f) == 4);
+	CHECK(adsbIdCat(&f) == 0);
+	CHECK(parityCheck(&f) == 0);
+	CHECK(crcSyndrome(&f) == 0);
+	CHECK(computeCrc(&f) == 0x576098);
+
+	CHECK(getIdent(&f, &packed, &cat) == 0);
+	CHECK(expandCall(packed, call) == 7);
+	CHECK(strcmp(call, "KLM1023 ") == 0);
+	CHECK(cat == 040);
+	CHECK(strcmp(planeType(cat), "UNOWEN") == 0);
+	CHECK(strcmp(planeType(047), "ROTOR") == 0);
+	CHECK(planeCategory("ROTOR") == 047);
+	CHECK(planeCategory("UNOWEN") == 0);
+
+	//text packs back to what the frame had
+	CHECK(packCall("KLM1023", &ev.call) == 7 && ev.call == packed);
+	CHECK(packCall("KLM1023 X", &ev.call) == 8);
+	CHECK(packCall("klm", &ev.call) == -1);
+	CHECK(packCall("", &ev.call) == 0);
+	CHECK(expandCall(ev.call, call) == 0 && strcmp(call, "        ") == 0);
+
+	CHECK(decodeEvent(&f, 0., 0., &ev) == 0);
+	CHECK(ev.icao == 0x4840D6);
+	CHECK(ev.fl == (ICAOFL | IDENTVALID));
+	CHECK(ev.call == packed && ev.cat == 040);
+
+	//one flipped bit fails parity everywhere
+	f.frame[6] ^= 0x10;
+	CHECK(parityCheck(&f) != 0);
+	CHECK(crcSyndrome(&f) != 0);
+	CHECK(decodeEvent(&f, 0., 0., &ev) == -1);
+	return;
+}
+
+//bit k of a frame, 0 being the first one sent
+static int frameBit(const union AdsbFrame *f, int k)
+{
+	return f->frame[k / 8] >> (7 - k % 8) & 1;
+}
+
+/*
+	testFields
+	Every accessor from ADSB_FIELDS against reading the frame a bit
+	at a time, and setting a field leaves the bits around it alone.
+*/
+static void testFields(void)
+{
+	union AdsbFrame f, g;
+	uint64_t v, want;
+	int i, k;
+
+#define CHECK_FIELD(name, pos, bits) \
+	for(i = 0;i < 1000;i++) \
+	{ \
+		randomFrame(&f); \
+		for(want = 0, k = pos;k < pos + bits;k++) \
+			want = want << 1 | (uint64_t)frameBit(&f, k); \
+		if(!CHECK(adsb##name(&f) == want)) \
+			break; \
+		g = f; \
+		v = random64() & ((1ull << bits) - 1); \
+		adsbSet##name(&g, v); \
+		if(!CHECK(adsb##name(&g) == v)) \
+			break; \
+		for(k = 0;k < 112;k++) \
+			if(k < pos || k >= pos + bits) \
+				if(!CHECK(frameBit(&f, k) == frameBit(&g, k))) \
+					break; \
+		if(k < 112) \
+			break; \
+	}
+	ADSB_FIELDS(CHECK_FIELD)
+#undef CHECK_FIELD
+	return;
+}
+
+//0x8D40621D58C382D690C8AC2863A7, airborne position near Amsterdam
+static void testAirPos(void)
+{
+	union AdsbFrame f;
+	struct AdsbEvent ev;
+	double lat, lng;
+	int alt;
+
+	setFrame(&f, "8D40621D58C382D690C8AC2863A7");
+	CHECK(adsbIcao(&f) == 0x40621D);
+	CHECK(parityCheck(&f) == 0);
+	CHECK(getAirPos(&f, 52.258, 3.918, &alt, &lat, &lng) == 0);
+	CHECK(alt == 38000);
+	CHECKNEAR(lat, 52.257202, 1e-6);
+	CHECKNEAR(lng, 3.919373, 1e-6);
+
+	CHECK(decodeEvent(&f, 52.258, 3.918, &ev) == 0);
+	CHECK(ev.fl == (ICAOFL | POSVALID | ALTVALID));
+	CHECK(ev.alt == 38000);
+	CHECKNEAR(ev.lat, lat, 1e-12);
+	return;
+}
+
+//0x8C4841753A9A153237AEF0F275BE, surface position at Schiphol
+static void testSurfPos(void)
+{
+	union AdsbFrame f;
+	double trk, spd, lat, lng;
+
+	setFrame(&f, "8C4841753A9A153237AEF0F275BE");
+	CHECK(adsbCa(&f) == 4);
+	CHECK(adsbIcao(&f) == 0x484175);
+	CHECK(parityCheck(&f) == 0);
+	CHECK(getSurfPos(&f, 51.990, 4.375, &trk, &spd, &lat, &lng) == 0);
+	CHECKNEAR(trk, 92.8125, 1e-9);
+	CHECKNEAR(spd, 17., 1e-9);
+	CHECKNEAR(lat, 52.320561, 1e-6);
+	CHECKNEAR(lng, 4.735735, 1e-6);
+	return;
+}
+
+//0x8D485020994409940838175B284F ground speed,
+//0x8DA05F219B06B6AF189400CBC33F airspeed and heading
+static void testAirVel(void)
+{
+	union AdsbFrame f;
+	double trk, spd;
+	int vr;
+
+	setFrame(&f, "8D485020994409940838175B284F");
+	CHECK(adsbIcao(&f) == 0x485020);
+	CHECK(adsbAvSt(&f) == 1);
+	CHECK(getAirVel(&f, &trk, &spd, &vr) == 0);
+	CHECKNEAR(trk, 182.880378, 1e-6);
+	CHECKNEAR(spd, 159.201131, 1e-6);
+	CHECK(vr == -832);
+
+	setFrame(&f, "8DA05F219B06B6AF189400CBC33F");
+	CHECK(adsbIcao(&f) == 0xA05F21);
+	CHECK(adsbAvSt(&f) == 3);
+	CHECK(getAirVel(&f, &trk, &spd, &vr) == 2);
+	CHECKNEAR(trk, 243.984375, 1e-9);
+	CHECKNEAR(spd, 375., 1e-9);
+	CHECK(vr == -2304);
+	return;
+}
+
+//the NL formula from the CPR spec, what nlTable was made from
+static int refNL(double lat)
+{
+	double a;
+	lat = fabs(lat);
+	if(lat == 0.)
+		return 59;
+	if(lat >= 87.)
+		return lat > 87. ? 1 : 2;
+	a = 1. - (1. - cos(M_PI / 30.)) / pow(cos(M_PI / 180. * lat), 2.);
+	return (int)floor(2. * M_PI / acos(a));
+}
+
+static void testCprNL(void)
+{
+	double t, lat[1000];
+	long k;
+	int i, fast = 0, ref = 0;
+
+	CHECK(cprNL(0.) == 59);
+	CHECK(cprNL(10.47) == 59);
+	CHECK(cprNL(10.48) == 58);
+	CHECK(cprNL(41.978611) == 44);
+	CHECK(cprNL(-41.978611) == 44);
+	CHECK(cprNL(87.) == 2);
+	CHECK(cprNL(87.0001) == 1);
+	CHECK(cprNL(90.) == 1);
+
+	//every 0.0001 degree, none of them land on a zone edge but 87
+	for(k = -900000;k <= 900000;k++)
+		if(!CHECK(cprNL((double)k / 10000.) == refNL((double)k / 10000.)))
+		{
+			printf("\tlatitude %f\n", (double)k / 10000.);
+			break;
+		}
+
+	for(i = 0;i < 1000;i++)
+		lat[i] = uniform() * 180. - 90.;
+	t = seconds();
+	for(k = 0;k < CORPUS;k++)
+		ref += refNL(lat[k % 1000]);
+	printRate("NL formula", seconds() - t, CORPUS);
+	t = seconds();
+	for(k = 0;k < CORPUS;k++)
+		fast += cprNL(lat[k % 1000]);
+	printRate("NL table", seconds() - t, CORPUS);
+	CHECK(fast == ref);
+	return;
+}
+
+/*
+	testCprRoundTrip
+	Encodes random positions the way a transponder would and checks
+	getAirPos gets them back to within the CPR resolution, from a
+	reference point up to a quarter zone away.
+*/
+static void testCprRoundTrip(void)
+{
+	union AdsbFrame f;
+	double lat, lng, dlat, dlng, yz, olat, olng, reflat, reflng;
+	int i, odd, nl, alt;
+
+	setFrame(&f, "8D40621D58C382D690C8AC2863A7");
+	for(i = 0;i < 100000;i++)
+	{
+		lat = uniform() * 160. - 80.;
+		lng = uniform() * 360. - 180.;
+		odd = (int)(random64() & 1);
+
+		dlat = 360. / (60. - odd);
+		yz = floor(131072. * fmod(lat + 360., dlat) / dlat + 0.5);
+		nl = refNL(dlat * (yz / 131072. + floor(lat / dlat))) - odd;
+		dlng = 360. / (nl > 1 ? nl : 1);
+		adsbSetAbLatCpr(&f, (uint64_t)yz);
+		adsbSetAbLonCpr(&f, (uint64_t)floor(131072. *
+			fmod(lng + 360., dlng) / dlng + 0.5));
+		adsbSetAbF(&f, (uint64_t)odd);
+
+		reflat = lat + (uniform() - 0.5) * dlat / 2.;
+		reflng = lng + (uniform() - 0.5) * dlng / 2.;
+		if(reflng > 180.)
+			reflng -= 360.;
+		if(reflng < -180.)
+			reflng += 360.;
+		getAirPos(&f, reflat, reflng, &alt, &olat, &olng);
+		//longitude wraps at 180
+		olng = fmod(olng - lng + 540., 360.) - 180.;
+		if(!CHECK(fabs(olat - lat) <= dlat / 131072. &&
+			fabs(olng) <= dlng / 131072.))
+		{
+			printf("\t%f %f odd %d decoded %f %f\n", lat, lng, odd,
+				olat, olng + lng);
+			break;
+		}
+	}
+	return;
+}
+
+static void testCrc(void)
+{
+	static union AdsbFrame f[4096];
+	union AdsbFrame g;
+	double t;
+	long k;
+	int i, bit, fast = 0, ref = 0;
+
+	for(i = 0;i < 4096;i++)
+	{
+		randomFrame(&f[i]);
+		//half of them with the right parity
+		if(i & 1)
+		{
+			adsbSetPi(&f[i], computeCrc(&f[i]));
+		}
+	}
+
+	//the bitwise check is the reference for the table
+	for(k = 0;k < CORPUS;k++)
+	{
+		i = (int)(k % 4096);
+		if(!CHECK((parityCheck(&f[i]) == 0) == (crcSyndrome(&f[i]) == 0)))
+			break;
+	}
+
+	//flipping any bit changes the syndrome by bitSyndrome
+	for(k = 0;k < CORPUS;k++)
+	{
+		g = f[k % 4096];
+		bit = (int)(random64() % DEMOD_BITS);
+		g.frame[bit / 8] ^= (uint8_t)(0x80 >> bit % 8);
+		if(!CHECK((crcSyndrome(&g) ^ crcSyndrome(&f[k % 4096])) ==
+			bitSyndrome(bit)))
+			break;
+	}
+
+	t = seconds();
+	for(k = 0;k < CORPUS;k++)
+		ref += parityCheck(&f[k % 4096]) == 0;
+	printRate("CRC bitwise", seconds() - t, CORPUS);
+	t = seconds();
+	for(k = 0;k < CORPUS;k++)
+		fast += crcSyndrome(&f[k % 4096]) == 0;
+	printRate("CRC table", seconds() - t, CORPUS);
+	CHECK(fast == ref);
+	CHECK(fast == CORPUS / 2);
+	return;
+}
+
+/*
+	refParseHex
+	What the -p loop did before parseHexFrame, with sscanf.
+	Only spaces, tabs and newlines come before the '*' in the corpus,
+	since those are all parseHexFrame skips.
+*/
+static int refParseHex(const char *line, union AdsbFrame *f)
+{
+	char hex[29];
+	int n = -1, len = -1;
+
+	if(sscanf(line, " *%n%28[0-9A-Fa-f];%n", &n, hex, &len) < 1 ||
+		len < 0 || len - n != 29)
+		return -1;
+	setFrame(f, hex);
+	return len;
+}
+
+static void randomLine(char *line)
+{
+	static const char pre[] = " \t\r\n";
+	static const char digits[] = "0123456789ABCDEFabcdef";
+	static const char junk[] = "*;G g-x:";
+	int i = 0, n, k;
+
+	for(n = (int)(random64() % 3);n > 0;n--)
+		line[i++] = pre[random64() % 4];
+	line[i++] = random64() % 16 ? '*' : '#';
+	//mostly long frames, some short, some a char off
+	switch(random64() % 8)
+	{
+	case 0: n = 14; break;
+	case 1: n = 27 + (int)(random64() % 3); break;
+	default: n = 28;
+	}
+	for(k = 0;k < n;k++)
+		line[i++] = random64() % 64 ? digits[random64() % 22] :
+			junk[random64() % 8];
+	if(random64() % 16)
+		line[i++] = ';';
+	if(random64() % 2)
+		line[i++] = '\n';
+	line[i] = 0;
+	return;
+}
+
+static void testParseHex(void)
+{
+	static char lines[4096][40];
+	union AdsbFrame a, b;
+	double t;
+	long k;
+	int i, n, m, fast = 0, ref = 0;
+
+	for(i = 0;i < 4096;i++)
+		randomLine(lines[i]);
+
+	for(i = 0;i < 4096;i++)
+	{
+		n = parseHexFrame(lines[i], strlen(lines[i]), &a);
+		m = refParseHex(lines[i], &b);
+		if(!CHECK(n == m && (n < 0 || memcmp(&a, &b, sizeof(a)) == 0)))
+		{
+			printf("\t\"%s\" gave %d, sscanf %d\n", lines[i], n, m);
+			break;
+		}
+		ref += m > 0;
+	}
+	//the corpus has to have both kinds for this to mean anything
+	CHECK(ref > 1024 && ref < 3072);
+
+	//cut off lines never read past len
+	CHECK(parseHexFrame("*8D4840D6202CC371C32CE0576098;", 29, &a) == -1);
+	CHECK(parseHexFrame("*8D4840D6202CC371C32CE0576098;", 30, &a) == 30);
+
+	t = seconds();
+	for(k = 0;k < CORPUS;k++)
+		ref += refParseHex(lines[k % 4096], &b) > 0;
+	printRate("hex sscanf", seconds() - t, CORPUS);
+	t = seconds();
+	for(k = 0;k < CORPUS;k++)
+		fast += parseHexFrame(lines[k % 4096],
+			strlen(lines[k % 4096]), &a) > 0;
+	printRate("hex table", seconds() - t, CORPUS);
+	return;
+}
+
+struct LineCheck
+{
+	char lines[8][LOOP_LINE + LOOP_READ];
+	size_t len[8];
+	int count;
+};
+
+static void collectLine(const char *line, size_t len, void *arg)
+{
+	struct LineCheck *c = arg;
+	if(c->count < 8)
+	{
+		memcpy(c->lines[c->count], line, len);
+		c->len[c->count++] = len;
+	}
+	return;
+}
+
+static int sameLine(const struct LineCheck *c, int i, const char *text)
+{
+	return i < c->count && c->len[i] == strlen(text) &&
+		memcmp(c->lines[i], text, c->len[i]) == 0;
+}
+
+/*
+	testLines
+	readLines through a pipe: lines split across reads, a line
+	longer than LOOP_LINE in pieces, and a last line with no newline.
+*/
+static void testLines(void)
+{
+	static struct LineReader r;
+	static struct LineCheck c;
+	char longLine[LOOP_LINE * 2];
+	int fds[2];
+
+	if(!CHECK(pipe(fds) == 0))
+		return;
+	memset(&r, 0, sizeof(r));
+	memset(&c, 0, sizeof(c));
+
+	CHECK(write(fds[1], "*8D4840D6;\n*8D48", 16) == 16);
+	CHECK(readLines(&r, fds[0], collectLine, &c) == 16);
+	CHECK(c.count == 1 && sameLine(&c, 0, "*8D4840D6;"));
+	CHECK(write(fds[1], "40D7;\n\n", 7) == 7);
+	CHECK(readLines(&r, fds[0], collectLine, &c) == 7);
+	CHECK(c.count == 3 && sameLine(&c, 1, "*8D4840D7;"));
+	CHECK(sameLine(&c, 2, ""));
+
+	//only the start of a line that long is kept between reads
+	memset(longLine, 'A', sizeof(longLine));
+	CHECK(write(fds[1], longLine, sizeof(longLine)) ==
+		(long)sizeof(longLine));
+	CHECK(readLines(&r, fds[0], collectLine, &c) == (long)sizeof(longLine));
+	CHECK(c.count == 3 && r.len == LOOP_LINE);
+	CHECK(write(fds[1], "BB\n*8D4840D8;\n", 14) == 14);
+	CHECK(readLines(&r, fds[0], collectLine, &c) == 14);
+	CHECK(c.count == 5 && c.len[3] == LOOP_LINE + 2);
+	CHECK(memcmp(c.lines[3], longLine, LOOP_LINE) == 0 &&
+		memcmp(c.lines[3] + LOOP_LINE, "BB", 2) == 0);
+	CHECK(sameLine(&c, 4, "*8D4840D8;"));
+
+	//the end of the input finishes the last line
+	CHECK(write(fds[1], "*8D4840D9;", 10) == 10);
+	close(fds[1]);
+	CHECK(readLines(&r, fds[0], collectLine, &c) == 10);
+	CHECK(c.count == 5);
+	CHECK(readLines(&r, fds[0], collectLine, &c) == 0);
+	CHECK(c.count == 6 && sameLine(&c, 5, "*8D4840D9;"));
+	CHECK(readLines(&r, fds[0], collectLine, &c) == 0 && c.count == 6);
+	close(fds[0]);
+	return;
+}
+
+//F1 PPM modulated at 2 Msps, 50 samples of silence each side
+static void testDemod(void)
+{
+	static uint8_t iq[2 * (DEMOD_FRAMELEN + 100)];
+	union AdsbFrame f;
+	struct Demod demod;
+	struct DemodFrame found;
+	int k, chip;
+
+	setFrame(&f, "8D4840D6202CC371C32CE0576098");
+	memset(iq, 127, sizeof(iq));
+	for(k = 0;k < DEMOD_FRAMELEN;k++)
+		if(frameChip(&f, k))
+			iq[2 * (k + 50)] = 200;
+
+	initDemod(&demod);
+	found.sample = 0;
+	demodBlock(&demod, iq, DEMOD_FRAMELEN + 100, demodFound, &found);
+	CHECK(demod.frames == 1);
+	CHECK(found.sample == 50);
+	CHECK(adsbIcao(&found.frame) == 0x4840D6);
+	//pulses at 200 on I, (72.5^2 + 0.5^2) / 2
+	CHECK(found.level == 2628);
+	freeDemod(&demod);
+
+	//bit 40 sliced the wrong way, but only just
+	CHECK(bitSyndrome(40) == 0x91C77F);
+	k = 50 + DEMOD_PREAMBLE + 2 * 40;
+	chip = iq[2 * k] == 200;
+	iq[2 * k] = (uint8_t)(chip ? 150 : 155);
+	iq[2 * k + 2] = (uint8_t)(chip ? 155 : 150);
+	initDemod(&demod);
+	demod.repair = 0;
+	demodBlock(&demod, iq, DEMOD_FRAMELEN + 100, demodFound, &found);
+	CHECK(demod.frames == 0);
+	freeDemod(&demod);
+
+	initDemod(&demod);
+	demodBlock(&demod, iq, DEMOD_FRAMELEN + 100, demodFound, &found);
+	CHECK(demod.frames == 1);
+	CHECK(demod.repaired == 1);
+	CHECK(adsbIcao(&found.frame) == 0x4840D6);
+	freeDemod(&demod);
+	return;
+}
+
+//F1 at 2.4 Msps, starting 0.3 samples after sample 60
+//each sample is the average of the chips it overlaps
+static void testDemodOversampled(void)
+{
+	static uint8_t iq[2 * 400];
+	union AdsbFrame f;
+	struct Demod demod;
+	struct DemodFrame found;
+	double t, overlap;
+	int k;
+
+	setFrame(&f, "8D4840D6202CC371C32CE0576098");
+	memset(iq, 127, sizeof(iq));
+	for(k = 0;k < DEMOD_FRAMELEN;k++)
+		for(t = 60.3 + 1.2 * k;frameChip(&f, k) && t < 60.3 + 1.2 * (k + 1);)
+		{
+			overlap = fmin(60.3 + 1.2 * (k + 1), floor(t) + 1.) - t;
+			iq[2 * (int)t] = (uint8_t)(iq[2 * (int)t] + 73. * overlap);
+			t += overlap;
+		}
+
+	initDemod(&demod);
+	CHECK(setDemodRate(&demod, 2400000) == 0);
+	CHECK(setDemodRate(&demod, 1000000) == -1);
+	found.sample = 0;
+	demodBlock(&demod, iq, 400, demodFound, &found);
+	CHECK(demod.frames == 1);
+	CHECK(found.sample == 60);
+	CHECK(adsbIcao(&found.frame) == 0x4840D6);
+	freeDemod(&demod);
+	return;
+}
+
+//uniform noise of +-20 around the middle, the threshold should follow it
+static void testNoiseFloor(void)
+{
+	static uint8_t noise[2 * 8192];
+	struct Demod demod;
+	struct DemodFrame found;
+	unsigned int lcg = 1;
+	int k;
+
+	for(k = 0;k < 2 * 8192;k++)
+	{
+		lcg = lcg * 1103515245u + 12345u;
+		noise[k] = (uint8_t)(108 + (lcg >> 16) % 40);
+	}
+	initDemod(&demod);
+	demodBlock(&demod, noise, 8192, demodFound, &found);
+	CHECK(demod.noise == 182);
+	CHECK(demod.threshold == 546);
+	CHECK(demod.frames == 0);
+	freeDemod(&demod);
+	return;
+}
+
+/*
+	testKernels
+	Every kernel the CPU has against the scalar one, on random I/Q
+	for the magnitudes and on random pulses for the preamble search
+	and bit slicing, so there are plenty of preambles to find.
+*/
+static void testKernels(void)
+{
+	enum {N = 1 << 16};
+	static uint8_t iq[2 * N];
+	static uint16_t ref[N], mag[N + DEMOD_FRAMELEN], out16[N];
+	static uint32_t refOut[N], out[N];
+	struct Demod d;
+	uint8_t refBits[14], bits[14];
+	size_t refCnt, cnt;
+	uint16_t thr;
+	double t;
+	long k;
+	int i, kern, found;
+
+	for(i = 0;i < 2 * N;i++)
+		iq[i] = (uint8_t)random64();
+	computeMag(DEMOD_SCALAR, iq, ref, N);
+	//pulses of random height on a random floor
+	for(i = 0;i < N + DEMOD_FRAMELEN;i++)
+		mag[i] = (uint16_t)(random64() % 3 ? random64() % 400 :
+			1000 + random64() % 8000);
+
+	initDemod(&d);
+	for(kern = DEMOD_SCALAR;kern <= DEMOD_NEON;kern++)
+	{
+		if(setDemodKernel(&d, kern))
+			continue;
+		printf("\tkernel %d\n", kern);
+
+		computeMag(kern, iq, out16, N);
+		CHECK(memcmp(ref, out16, sizeof(ref)) == 0);
+
+		found = 0;
+		for(i = 0;i < 16;i++)
+		{
+			thr = (uint16_t)(100 + 400 * i);
+			refCnt = findPreambles(DEMOD_SCALAR, mag, N, thr, refOut);
+			cnt = findPreambles(kern, mag, N, thr, out);
+			CHECK(cnt == refCnt);
+			CHECK(memcmp(refOut, out, refCnt * sizeof(uint32_t)) == 0);
+			found += (int)refCnt;
+		}
+		CHECK(found > 0);
+		//thresholds over any magnitude, some read negative as int16
+		for(i = 0;i < 3;i++)
+		{
+			thr = (uint16_t)(DEMOD_FULLSCALE + 1 + 24000 * i);
+			CHECK(findPreambles(kern, mag, N, thr, out) == 0);
+		}
+
+		for(k = 0;k < 4096;k++)
+		{
+			i = (int)(random64() % N);
+			sliceBits(DEMOD_SCALAR, mag + i, refBits);
+			sliceBits(kern, mag + i, bits);
+			if(!CHECK(memcmp(refBits, bits, 14) == 0))
+				break;
+		}
+
+		t = seconds();
+		for(k = 0;k < 16;k++)
+			computeMag(kern, iq, out16, N);
+		printRate("magnitude per sample", seconds() - t, 16L * N);
+		t = seconds();
+		for(k = 0;k < 16;k++)
+			findPreambles(kern, mag, N, 2000, out);
+		printRate("preambles per sample", seconds() - t, 16L * N);
+		t = seconds();
+		for(k = 0;k < CORPUS;k++)
+			sliceBits(kern, mag + (k & (N - 1)), bits);
+		printRate("slicing per frame", seconds() - t, CORPUS);
+	}
+	freeDemod(&d);
+	return;
+}
+
+static int compareInt(const void *a, const void *b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+//every slot the grid should find, by scanning them all
+static int scanBox(const struct Plane buf[], int bufsize, double lat0,
+	double lng0, double lat1, double lng1, int out[])
+{
+	int i, n = 0;
+	for(i = 0;i < bufsize;i++)
+		if((buf[i].pflags & POSVALID) && buf[i].lat >= lat0 &&
+			buf[i].lat <= lat1 && (lng0 <= lng1 ?
+			buf[i].lng >= lng0 && buf[i].lng <= lng1 :
+			buf[i].lng >= lng0 || buf[i].lng <= lng1))
+			out[n++] = i;
+	return n;
+}
+
+static int scanRadius(const struct Plane buf[], int bufsize, double lat,
+	double lng, double nm, int out[])
+{
+	int i, n = 0;
+	for(i = 0;i < bufsize;i++)
+		if((buf[i].pflags & POSVALID) &&
+			planeDistance(&buf[i], lat, lng) <= nm)
+			out[n++] = i;
+	return n;
+}
+
+static int sameSlots(int a[], int na, int b[], int nb)
+{
+	qsort(a, na, sizeof(int), compareInt);
+	qsort(b, nb, sizeof(int), compareInt);
+	return na == nb && memcmp(a, b, sizeof(int) * na) == 0;
+}
+
+//a plane near O'Hare most of the time, anywhere the rest
+static void randomPosition(double *lat, double *lng)
+{
+	if(random64() % 4)
+	{
+		*lat = 41.978611 + (uniform() - 0.5) * 6.;
+		*lng = -87.904722 + (uniform() - 0.5) * 8.;
+	}
+	else
+	{
+		*lat = uniform() * 180. - 90.;
+		*lng = uniform() * 360. - 180.;
+	}
+	return;
+}
+
+struct Collected
+{
+	struct AdsbDecoded dec[8];
+	int n;
+};
+
+static void collectDecoded(const struct AdsbDecoded *dec, void *arg)
+{
+	struct Collected *into = arg;
+	if(into->n < 8)
+		into->dec[into->n++] = *dec;
+	return;
+}
+
+/*
+	testDecoder
+	The library API: two decoders at different receivers don't share
+	anything, text cut at every byte decodes like the whole thing,
+	and samples split mid frame still give the frame.
+*/
+static void testDecoder(void)
+{
+	static const char text[] =
+		"*8D4840D6202CC371C32CE0576098;\n"
+		"*8D40621D58C382D690C8AC2863A7;\r\n"
+		"garbage that is much too long to be a message, over 64 chars\n"
+		"*8D4840D6202CC3;\n"
+		"*8C4841753A9A153237AEF0F275BE;\n"
+		"*8D485020994409940838175B284F;\n"
+		"*8D4840D6202CC371C32CE0576099;\n";
+	static const enum AdsbDecodedType types[4] = {ADSB_IDENT,
+		ADSB_AIRBORNE, ADSB_SURFACE, ADSB_VELOCITY};
+	static uint8_t iq[2 * (DEMOD_FRAMELEN + 100)];
+	struct AdsbDecoded out[8], other[8];
+	struct Collected bytes;
+	struct AdsbDecoder a, b, c;
+	union AdsbFrame f;
+	char call[9];
+	size_t i;
+	int k;
+
+	initDecoder(&a, 52.258, 3.918);
+	setDecoderArray(&a, out, 8);
+	initDecoder(&b, -33.9, 151.2);
+	setDecoderArray(&b, other, 8);
+	CHECK(pushHex(&a, text, sizeof(text) - 1) == 4);
+	CHECK(pushHex(&b, text, sizeof(text) - 1) == 4);
+	CHECK(a.frames == 5 && a.decoded == 4 && a.lost == 0);
+	for(k = 0;k < 4;k++)
+		CHECK(out[k].type == types[k]);
+	CHECK(out[0].ev.icao == 0x4840D6);
+	CHECK(expandCall(out[0].ev.call, call) == 7);
+	CHECK(out[1].ev.alt == 38000);
+	CHECKNEAR(out[1].ev.lat, 52.257202, 1e-6);
+	CHECKNEAR(out[1].ev.lng, 3.919373, 1e-6);
+	CHECKNEAR(out[2].ev.spd, 17., 1e-9);
+	CHECK(out[3].ev.vert == -832);
+	//decoded around its own receiver, on the other side of the world
+	CHECK(fabs(other[1].ev.lat - out[1].ev.lat) > 1.);
+
+	//the same events when every byte is pushed on its own
+	initDecoder(&c, 52.258, 3.918);
+	bytes.n = 0;
+	setDecoderHandler(&c, collectDecoded, &bytes);
+	for(i = 0;i < sizeof(text) - 1;i++)
+		pushHex(&c, text + i, 1);
+	CHECK(bytes.n == 4);
+	for(k = 0;k < 4;k++)
+		CHECK(bytes.dec[k].type == out[k].type &&
+			memcmp(&bytes.dec[k].frame, &out[k].frame, 14) == 0 &&
+			bytes.dec[k].ev.lat == out[k].ev.lat &&
+			bytes.dec[k].ev.spd == out[k].ev.spd);
+
+	//a full array counts the rest as lost
+	setDecoderArray(&a, out, 3);
+	CHECK(pushHex(&a, text, sizeof(text) - 1) == 4);
+	CHECK(a.lost == 1);
+	setFrame(&f, "8D4840D6202CC371C32CE0576098");
+	CHECK(pushFrame(&a, &f) == 1 && out[0].type == ADSB_IDENT);
+
+	//a frame split between two pushes of samples
+	memset(iq, 127, sizeof(iq));
+	for(k = 0;k < DEMOD_FRAMELEN;k++)
+		if(frameChip(&f, k))
+			iq[2 * (k + 50)] = 200;
+	setDecoderArray(&a, out, 8);
+	CHECK(pushIQ(&a, iq, 150) == 0);
+	CHECK(pushIQ(&a, iq + 300, DEMOD_FRAMELEN - 50) == 1);
+	CHECK(out[0].sample == 50 && out[0].ev.icao == 0x4840D6);
+	freeDecoder(&a);
+	freeDecoder(&b);
+	freeDecoder(&c);
+	return;
+}
+
+/*
+	testGrid
+	Fills a cache through logPlane with the grid attached, moves and
+	replaces planes, then checks every query against a scan of the
+	whole cache. Boxes and circles go over the 180th meridian and
+	the poles as well.
+*/
+static void testGrid(void)
+{
+	enum {PLANES = 4096};
+	static struct Plane buf[PLANES];
+	static int a[PLANES], b[PLANES];
+	struct PlaneGrid g;
+	double lat, lng, lat1, lng1, nm, t, tscan = 0., tgrid = 0.;
+	int i, q, na, nb, k;
+
+	memset(buf, 0, sizeof(buf));
+	CHECK(initGrid(&g, buf, PLANES) == 0);
+	attachGrid(&g);
+	for(i = 0;i < PLANES * 2;i++)
+	{
+		randomPosition(&lat, &lng);
+		//some without a position, some of them moving or replaced
+		logPlane(buf, PLANES, (int)(random64() % (PLANES + PLANES / 8)),
+			0, 0, lat, lng, 0., 0., 1000, 0, random64() % 8 ?
+			ICAOFL | POSVALID | ALTVALID : ICAOFL | ALTVALID);
+	}
+
+	for(q = 0;q < 3000;q++)
+	{
+		randomPosition(&lat, &lng);
+		switch(q % 3)
+		{
+		case 0:
+			lat1 = fmin(lat + uniform() * 10., 90.);
+			lng1 = lng + uniform() * 20.;
+			if(lng1 > 180.)
+				lng1 -= 360.;
+			t = seconds();
+			na = gridBox(&g, lat, lng, lat1, lng1, a, PLANES);
+			tgrid += seconds() - t;
+			t = seconds();
+			nb = scanBox(buf, PLANES, lat, lng, lat1, lng1, b);
+			tscan += seconds() - t;
+			break;
+		case 1:
+			nm = uniform() * 600.;
+			t = seconds();
+			na = gridRadius(&g, lat, lng, nm, a, PLANES);
+			tgrid += seconds() - t;
+			t = seconds();
+			nb = scanRadius(buf, PLANES, lat, lng, nm, b);
+			tscan += seconds() - t;
+			break;
+		default:
+			k = 1 + (int)(random64() % 20);
+			t = seconds();
+			na = gridNearest(&g, lat, lng, k, a);
+			tgrid += seconds() - t;
+			nb = scanRadius(buf, PLANES, lat, lng, 20000., b);
+			CHECK(na == (nb < k ? nb : k));
+			//nothing left out can be closer than the farthest found
+			for(i = 1;i < na;i++)
+				CHECK(planeDistance(&buf[a[i - 1]], lat, lng) <=
+					planeDistance(&buf[a[i]], lat, lng));
+			nm = planeDistance(&buf[a[na - 1]], lat, lng);
+			nb = scanRadius(buf, PLANES, lat, lng, nm, b);
+			CHECK(nb >= na);
+			na = gridRadius(&g, lat, lng, nm, a, PLANES);
+		}
+		if(!CHECK(sameSlots(a, na, b, nb)))
+		{
+			printf("\tquery %d at %f %f found %d, scan %d\n", q, lat, lng,
+				na, nb);
+			break;
+		}
+	}
+	printRate("box/radius scan", tscan, 2000);
+	printRate("grid query", tgrid, 3000);
+
+	attachGrid(NULL);
+	freeGrid(&g);
+	return;
+}
+
+/*
+	testSeqlock
+	One thread keeps calling logPlane on a few slots while this one
+	copies them with readPlanes. Every field is made from the same
+	count, so a plane copied while it was half written shows up as
+	fields that don't agree.
+*/
+#define SEQPLANES 4
+
+//messages of each kind, the rate over the window, levels, replacement
+static void testStats(void)
+{
+	struct PlaneStats s;
+	time_t t0 = 1000000;
+	int k;
+
+	memset(&s, 0, sizeof(s));
+	countMessage(&s, 0x4840D6, 4, 0, t0);
+	countMessage(&s, 0x4840D6, 11, 1000, t0);
+	countMessage(&s, 0x4840D6, 19, 3000, t0);
+	countMessage(&s, 0x4840D6, 6, 2000, t0);
+	countMessage(&s, 0x4840D6, 29, 0, t0);
+	CHECK(s.msgs[STATS_IDENT] == 1 && s.msgs[STATS_AIRBORNE] == 1);
+	CHECK(s.msgs[STATS_VELOCITY] == 1 && s.msgs[STATS_SURFACE] == 1);
+	CHECK(s.msgs[STATS_OTHER] == 1);
+	CHECK(totalMessages(&s) == 5);
+	CHECK(s.levels == 3 && s.levelMin == 1000 && s.levelMax == 3000);
+	CHECK(s.levelSum / s.levels == 2000);
+	CHECKNEAR(messageRate(&s, t0), 0.5, 1e-9);
+
+	//2 a second for the next 20 seconds
+	for(k = 1;k <= 20;k++)
+	{
+		countMessage(&s, 0x4840D6, 11, 0, t0 + k);
+		countMessage(&s, 0x4840D6, 19, 0, t0 + k);
+		if(k == STATS_WINDOW - 1)
+			CHECKNEAR(messageRate(&s, t0 + k), 2.3, 1e-9);
+	}
+	CHECKNEAR(messageRate(&s, t0 + 20), 2., 1e-9);
+	//quiet seconds leave the window
+	CHECKNEAR(messageRate(&s, t0 + 25), 1., 1e-9);
+	CHECKNEAR(messageRate(&s, t0 + 20 + STATS_WINDOW), 0., 1e-9);
+	countMessage(&s, 0x4840D6, 11, 0, t0 + 100);
+	CHECKNEAR(messageRate(&s, t0 + 100), 0.1, 1e-9);
+	CHECK(totalMessages(&s) == 46);
+
+	//the slot goes to another plane
+	countMessage(&s, 0xABCDEF, 11, 500, t0 + 101);
+	CHECK(s.icao == 0xABCDEF && totalMessages(&s) == 1);
+	CHECK(s.levels == 1 && s.levelMin == 500 && s.levelMax == 500);
+
+	CHECKNEAR(levelDb(DEMOD_FULLSCALE), 0., 1e-9);
+	CHECKNEAR(levelDb(DEMOD_FULLSCALE / 10), -10., 0.01);
+	CHECK(levelDb(0) == -99.);
+	return;
+}
+
+static volatile int seqStop;
+
+static void *seqWriter(void *arg)
+{
+	struct Plane *buf = arg;
+	int v;
+
+	for(v = 0;!seqStop;v++)
+		logPlane(buf, SEQPLANES, 1 + v % SEQPLANES, 0, 0, v, -v,
+			v, v, v, -v, ICAOFL | POSVALID | TRKVALID | SPDVALID |
+			ALTVALID | VERTVALID);
+	return NULL;
+}
+
+static void testSeqlock(void)
+{
+	static struct Plane buf[SEQPLANES], out[SEQPLANES];
+	pthread_t writer;
+	double t;
+	long reads = 0;
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	seqStop = 0;
+	if(!CHECK(pthread_create(&writer, NULL, seqWriter, buf) == 0))
+		return;
+	t = seconds();
+	while(seconds() - t < 0.2)
+	{
+		readPlanes(buf, out, SEQPLANES);
+		reads++;
+		for(i = 0;i < SEQPLANES;i++)
+		{
+			if(out[i].pflags == 0)
+				continue;
+			if(!CHECK(out[i].lng == -out[i].lat && out[i].trk == out[i].lat &&
+				out[i].spd == out[i].lat && out[i].alt == (int)out[i].lat &&
+				out[i].vert == -out[i].alt &&
+				out[i].icao == 1 + out[i].alt % SEQPLANES &&
+				(out[i].seq & 1) == 0))
+			{
+				printf("\ttorn copy of slot %d after %ld reads\n", i, reads);
+				seqStop = 1;
+			}
+		}
+		if(seqStop)
+			break;
+	}
+	seqStop = 1;
+	pthread_join(writer, NULL);
+	printRate("readPlanes", seconds() - t, reads);
+	return;
+}
+
+#define SHARDPLANES 300
+#define SHARDROUNDS 40
+
+struct ShardProducer
+{
+	struct ShardSet *set;
+	const union AdsbFrame *frames;	//SHARDPLANES of them
+	const union AdsbFrame *pos;	//and a position for each
+	int first;			//every other plane from here
+};
+
+static void *shardProducer(void *arg)
+{
+	struct ShardProducer *p = arg;
+	int r, i;
+
+	for(r = 0;r < SHARDROUNDS;r++)
+		for(i = p->first;i < SHARDPLANES;i += 2)
+		{
+			routeFrame(p->set, &p->frames[i], 1000 + i);
+			routeFrame(p->set, &p->pos[i], 1000 + i);
+		}
+	return NULL;
+}
+
+//an airborne position frame for lat, lng, the encoding testCprRoundTrip checks
+static void setAirPosFrame(union AdsbFrame *f, int icao, double lat,
+	double lng)
+{
+	double dlat, dlng, yz;
+	int nl;
+
+	memset(f, 0, sizeof(*f));
+	adsbSetDf(f, 17);
+	adsbSetIcao(f, (uint64_t)icao);
+	adsbSetTc(f, 11);
+	adsbSetAbAlt(f, 0xC38);		//38000 ft
+	dlat = 360. / 60.;
+	yz = floor(131072. * fmod(lat + 360., dlat) / dlat + 0.5);
+	nl = refNL(dlat * (yz / 131072. + floor(lat / dlat)));
+	dlng = 360. / (nl > 1 ? nl : 1);
+	adsbSetAbLatCpr(f, (uint64_t)yz);
+	adsbSetAbLonCpr(f, (uint64_t)floor(131072. *
+		fmod(lng + 360., dlng) / dlng + 0.5));
+	adsbSetPi(f, computeCrc(f));
+	return;
+}
+
+static void countArchived(const struct ArchiveRecord *rec, void *arg)
+{
+	(void)rec;
+	(*(long *)arg)++;
+	return;
+}
+
+/*
+	testShards
+	Two producers, four shards, every plane merged once with all its
+	messages. The archive is attached to the merged cache, so each
+	plane is archived once when it is merged and never by the shards.
+*/
+static void testShards(void)
+{
+	static union AdsbFrame frames[SHARDPLANES], pos[SHARDPLANES];
+	static struct Plane buf[SHARDPLANES + 3];
+	static struct PlaneStats stats[SHARDPLANES + 3];
+	static uint8_t seen[SHARDPLANES];
+	struct ShardSet set;
+	struct ShardProducer prod[2];
+	pthread_t tid[2];
+	union AdsbFrame bad;
+	struct Archive arc;
+	struct ArchiveReader r;
+	char name[] = "/tmp/adsbshardXXXXXX", idxname[40];
+	unsigned long decoded = 0;
+	long archived = 0;
+	uint64_t call;
+	char text[9];
+	double t;
+	int i, k, fd, ok = 1;
+
+	for(i = 0;i < SHARDPLANES;i++)
+	{
+		memset(&frames[i], 0, sizeof(frames[i]));
+		adsbSetDf(&frames[i], 17);
+		adsbSetIcao(&frames[i], 0xA00000 + 7 * i);
+		adsbSetTc(&frames[i], 4);
+		snprintf(text, sizeof(text), "T%05d", i);
+		packCall(text, &call);
+		adsbSetIdCall(&frames[i], call);
+		adsbSetPi(&frames[i], computeCrc(&frames[i]));
+		setAirPosFrame(&pos[i], 0xA00000 + 7 * i,
+			rlat + (i % 20) * 0.01, rlng + (i / 20) * 0.01);
+	}
+
+	fd = mkstemp(name);
+	if(!CHECK(fd >= 0))
+		return;
+	close(fd);
+	snprintf(idxname, sizeof(idxname), "%s.idx", name);
+	if(!CHECK(openArchive(&arc, name) == 0))
+		return;
+
+	memset(buf, 0, sizeof(buf));
+	attachArchive(&arc, buf);
+
+	//room for every plane however they hash, since nothing is replaced
+	CHECK(startShards(&set, 4, SHARDPLANES, rlat, rlng) == 0);
+	bad = frames[0];
+	bad.frame[5] ^= 1;
+	CHECK(routeFrame(&set, &bad, 0) == -1);
+
+	t = seconds();
+	for(k = 0;k < 2;k++)
+	{
+		prod[k].set = &set;
+		prod[k].frames = frames;
+		prod[k].pos = pos;
+		prod[k].first = k;
+		pthread_create(&tid[k], NULL, shardProducer, &prod[k]);
+	}
+	for(k = 0;k < 2;k++)
+		pthread_join(tid[k], NULL);
+	stopShards(&set);
+	printRate("routed", seconds() - t, SHARDPLANES * SHARDROUNDS * 2);
+
+	memset(stats, 0, sizeof(stats));
+	mergeShards(&set, buf, stats);
+	CHECK(set.merged == SHARDPLANES);
+	for(k = 0;k < set.count;k++)
+		decoded += set.shards[k].frames;
+	CHECK(decoded == SHARDPLANES * SHARDROUNDS * 2);
+	for(i = 0;i < set.merged;i++)
+	{
+		k = (buf[i].icao - 0xA00000) / 7;
+		snprintf(text, sizeof(text), "T%05d", k);
+		packCall(text, &call);
+		ok &= k >= 0 && k < SHARDPLANES && !seen[k] && buf[i].call == call;
+		ok &= stats[i].icao == buf[i].icao &&
+			stats[i].msgs[STATS_IDENT] == SHARDROUNDS &&
+			stats[i].msgs[STATS_AIRBORNE] == SHARDROUNDS &&
+			(buf[i].pflags & POSVALID) &&
+			fabs(buf[i].lat - (rlat + (k % 20) * 0.01)) < 1e-4 &&
+			stats[i].levelMin == 1000 + k && stats[i].levelMax == 1000 + k;
+		if(k >= 0 && k < SHARDPLANES)
+			seen[k] = 1;
+	}
+	CHECK(ok);
+	CHECK(!(buf[SHARDPLANES].pflags & ICAOFL));
+
+	//a second merge with nothing new changes nothing
+	k = (int)buf[0].seq;
+	mergeShards(&set, buf, stats);
+	CHECK((int)buf[0].seq == k && set.merged == SHARDPLANES);
+	freeShards(&set);
+
+	attachArchive(NULL, NULL);
+	CHECK(closeArchive(&arc) == 0);
+	if(CHECK(openArchiveReader(&r, name) == 0))
+	{
+		CHECK(scanArchive(&r, 0, time(NULL) + 100, -1, countArchived,
+			&archived) == SHARDPLANES);
+		CHECK(archived == SHARDPLANES);
+		closeArchiveReader(&r);
+	}
+	unlink(name);
+	unlink(idxname);
+	return;
+}
+
+/*
+	refLogToFile
+	logToFile the way it was, one stdio call per field.
+*/
+static void refLogToFile(const struct Plane buf[], int bufsize, FILE *save)
 {
-	union AdsbFrame f1;
-	f1.frame[13] = 0x8D;	//0x8D4840D6202CC371C32CE0576098
-	f1.frame[12] = 0x48;	//ident message
-	f1.frame[11] = 0x40;	//callsign KLM1023_
-	f1.frame[10] = 0xD6;
-	f1.frame[9] = 0x20;
-	f1.frame[8] = 0x2C;
-	f1.frame[7] = 0xC3;
-	f1.frame[6] = 0x71;
-	f1.frame[5] = 0xC3;
-	f1.frame[4] = 0x2C;
-	f1.frame[3] = 0xE0;
-	f1.frame[2] = 0x57;
-	f1.frame[1] = 0x60;
-	f1.frame[0] = 0x98;
-
-	printf("AdsbFrame is %zu bytes\n", sizeof(union AdsbFrame));
-	printf("f1 content: %#X%X%X%X%X%X%X%X%X%X%X%X%X%X\n",
-		(unsigned int)f1.frame[13], (unsigned int)f1.frame[12],
-		(unsigned int)f1.frame[11], (unsigned int)f1.frame[10],
-		(unsigned int)f1.frame[9], (unsigned int)f1.frame[8],
-		(unsigned int)f1.frame[7], (unsigned int)f1.frame[6],
-		(unsigned int)f1.frame[5], (unsigned int)f1.frame[4],
-		(unsigned int)f1.frame[3], (unsigned int)f1.frame[2],
-		(unsigned int)f1.frame[1], (unsigned int)f1.frame[0]);
-
-	printf("F1: Callsign and Parity Test\n"
-		"DF: %u, CA: %u, ICAO: %#X, PI: %#X\n", (unsigned int)f1.df,
-		(unsigned int)f1.ca, (unsigned int)f1.icao, (unsigned int)f1.pi);
-	printf("Raw Message: %#X%X%X%X%X%X%X, TC:%u\n", (unsigned int)f1.me.me[6],
-		(unsigned int)f1.me.me[5], (unsigned int)f1.me.me[4],
-		(unsigned int)f1.me.me[3], (unsigned int)f1.me.me[2],
-		(unsigned int)f1.me.me[1], (unsigned int)f1.me.me[0],
-		(unsigned int)f1.me.id.tc);
-
-	char callsign[9], type[8];
-	callsign[8] = 0;
-	getIdent(&f1, callsign, type);
-	printf("Callsign: %s, Aircraft Type: %s, Category: %u\n", callsign, type,
-		(unsigned int)f1.me.id.cat);
-
-	//parity checks might get skipped in main app to save execution time
-	if(parityCheck(&f1))
-		printf("Parity Check Failed\n\n");
+	int i;
+	char text[9], call[9];
+	for(i = 0;i < bufsize && (buf[i].pflags & ICAOFL);i++)
+	{
+		fprintf(save, "%.6X,", buf[i].icao);
+		if(buf[i].pflags & IDENTVALID)
+		{
+			expandCall(buf[i].call, text);
+			sscanf(text, "%s", call);
+			fprintf(save, "%s,%s,", call, planeType(buf[i].cat));
+		}
+		else
+			fprintf(save, ",,");
+		if(buf[i].pflags & POSVALID)
+			fprintf(save, "%f,%f,", buf[i].lat, buf[i].lng);
+		else
+			fprintf(save, ",,");
+		if(buf[i].pflags & TRKVALID)
+			fprintf(save, "%f,", buf[i].trk);
+		else
+			fputc(',', save);
+		if(buf[i].pflags & SPDVALID)
+			fprintf(save, "%f,", buf[i].spd);
+		else
+			fputc(',', save);
+		if(buf[i].pflags & ALTVALID)
+			fprintf(save, "%d,", buf[i].alt);
+		else
+			fputc(',', save);
+		if(buf[i].pflags & VERTVALID)
+			fprintf(save, "%d,", buf[i].vert);
+		else
+			fputc(',', save);
+		fprintf(save, "%zd\n", buf[i].lstUpd);
+	}
+	return;
+}
+
+//reads a whole file, returns its length
+static long slurp(FILE *f, char **out)
+{
+	long len;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	rewind(f);
+	*out = malloc(len + 1);
+	if(*out == NULL || fread(*out, 1, len, f) != (size_t)len)
+		return -1;
+	return len;
+}
+
+/*
+	testOutput
+	Logs random planes through the output writer and through the
+	old stdio logToFile, enough to go through every buffer a few
+	times, and compares the files.
+*/
+static void testOutput(void)
+{
+	enum {PLANES = 2000, ROUNDS = 20};
+	static struct Plane buf[PLANES];
+	struct OutputWriter w;
+	char name[] = "/tmp/adsbtestXXXXXX", *a, *b, call[9];
+	FILE *ref, *f;
+	double t, tref = 0., tout = 0.;
+	long na, nb;
+	int i, fd;
+
+	memset(buf, 0, sizeof(buf));
+	for(i = 0;i < PLANES;i++)
+	{
+		buf[i].icao = (int)(random64() & 0xFFFFFF);
+		buf[i].pflags = ICAOFL | (random64() & (IDENTVALID | POSVALID |
+			TRKVALID | SPDVALID | ALTVALID | VERTVALID));
+		snprintf(call, sizeof(call), "%c%c%c%-5d",
+			'A' + (int)(random64() % 26), 'A' + (int)(random64() % 26),
+			'A' + (int)(random64() % 26), (int)(random64() % 10000));
+		packCall(call, &buf[i].call);
+		buf[i].cat = (uint8_t)(random64() % 050);
+		randomPosition(&buf[i].lat, &buf[i].lng);
+		buf[i].trk = uniform() * 360.;
+		buf[i].spd = uniform() * 600.;
+		buf[i].alt = (int)(random64() % 50000) - 1000;
+		buf[i].vert = (int)(random64() % 8000) - 4000;
+		//logToFile skips planes older than its last call
+		buf[i].lstUpd = time(NULL) + 1000;
+	}
+
+	fd = mkstemp(name);
+	ref = tmpfile();
+	if(!CHECK(fd >= 0 && ref != NULL))
+		return;
+	close(fd);
+	if(!CHECK(openOutput(&w, name, OUTPUT_NOSYNC) == 0))
+		return;
+	for(i = 0;i < ROUNDS;i++)
+	{
+		t = seconds();
+		refLogToFile(buf, PLANES, ref);
+		tref += seconds() - t;
+		t = seconds();
+		logToFile(buf, PLANES, &w);
+		flushOutput(&w, time(NULL) + OUTPUT_DELAY * (i & 1));
+		tout += seconds() - t;
+	}
+	CHECK(closeOutput(&w) == 0);
+	printRate("stdio per plane", tref, PLANES * ROUNDS);
+	printRate("output writer per plane", tout, PLANES * ROUNDS);
+
+	f = fopen(name, "rb");
+	CHECK(f != NULL);
+	na = f ? slurp(f, &a) : -1;
+	nb = slurp(ref, &b);
+	//the writer drops rather than wait if the disk is behind
+	CHECK(na + (long)w.dropped == nb);
+	if(w.dropped == 0)
+		CHECK(na == nb && memcmp(a, b, nb) == 0);
 	else
-		printf("Parity Check Success\n\n");
-
-	double olat, olng;	//O'Hare Airport for relative location
-	olat = 41.978611;
-	olng = -87.904722;
-
-	int falt;
-	double tlat, tlng, flat, flng;
-	tlat = 52.258;		//relative location for test frame
-	tlng = 3.918;
-
-	union AdsbFrame f2;
-	f2.frame[13] = 0x8D;	//0x8D40621D58C382D690C8AC2863A7
-	f2.frame[12] = 0x40;	//lat should be 52.257202
-	f2.frame[11] = 0x62;	//lng should be 3.91937256
-	f2.frame[10] = 0x1D;
-	f2.frame[9] = 0x58;
-	f2.frame[8] = 0xC3;
-	f2.frame[7] = 0x82;
-	f2.frame[6] = 0xD6;
-	f2.frame[5] = 0x90;
-	f2.frame[4] = 0xC8;
-	f2.frame[3] = 0xAC;
-	f2.frame[2] = 0x28;
-	f2.frame[1] = 0x63;
-	f2.frame[0] = 0xA7;
-
-	printf("F2: Position Test\n"
-		"DF: %u, CA: %u, ICAO: %#X, PI: %#X\n", (unsigned int)f2.df,
-		(unsigned int)f2.ca, (unsigned int)f2.icao, (unsigned int)f2.pi);
-
-	getAirPos(&f2, tlat, tlng, &falt, &flat, &flng);
-	printf("Alt: %d, Latitude: %f, Longitude: %f\n\n", falt, flat, flng);
-
-	double strack;
-	double sspeed, slat, slng;
-	union AdsbFrame f3;
-	f3.frame[13] = 0x8C;	//8C4841753A9A153237AEF0F275BE
-	f3.frame[12] = 0x48;
-	f3.frame[11] = 0x41;
-	f3.frame[10] = 0x75;
-	f3.frame[9] = 0x3A;
-	f3.frame[8] = 0x9A;
-	f3.frame[7] = 0x15;
-	f3.frame[6] = 0x32;
-	f3.frame[5] = 0x37;
-	f3.frame[4] = 0xAE;
-	f3.frame[3] = 0xF0;
-	f3.frame[2] = 0xF2;
-	f3.frame[1] = 0x75;
-	f3.frame[0] = 0xBE;
-
-	tlat = 51.990;		//reference for F3 test
-	tlng = 4.375;
-
-	switch(getSurfPos(&f3, tlat, tlng, &strack, &sspeed, &slat, &slng))
-	{
-	case 1:
-		printf("track invalid\n");
-		break;
-	case 2:
-		printf("speed invalid\n");
-		break;
-	case 3:
-		printf("track and speed invalid\n");
-	}
-
-	printf("F3: Surface Position Test\n"
-		"DF: %u, CA: %u, ICAO: %#X, PI: %#X\n"
-		"Track: %f, Speed: %f,\nLatitude: %f, Longitude %f\n\n",
-		(unsigned int)f3.df, (unsigned int)f3.ca, (unsigned int)f3.icao,
-		(unsigned int)f3.pi, strack, sspeed, slat, slng);
-
-	double atrk, aspd;
-	int vert;
-	union AdsbFrame f4;
-	f4.frame[13] = 0x8D;	//8D485020994409940838175B284F
-	f4.frame[12] = 0x48;	//Air Vel sub-type 1
-	f4.frame[11] = 0x50;
-	f4.frame[10] = 0x20;
-	f4.frame[9] = 0x99;
-	f4.frame[8] = 0x44;
-	f4.frame[7] = 0x09;
-	f4.frame[6] = 0x94;
-	f4.frame[5] = 0x08;
-	f4.frame[4] = 0x38;
-	f4.frame[3] = 0x17;
-	f4.frame[2] = 0x5B;
-	f4.frame[1] = 0x28;
-	f4.frame[0] = 0x4F;
-
-	switch(getAirVel(&f4, &atrk, &aspd, &vert))
-	{
-	case 0:
-		break;
-	default:
-		printf("return value error\n");
-	}
-
-	printf("F4.1: Airborne Velocity Test\n"
-		"DF: %u, CA: %u, ICAO: %#X, PI: %#X\n"
-		"Track: %f, Speed: %f, Vertical Rate: %d\n",
-		(unsigned int)f4.df, (unsigned int)f4.ca, (unsigned int)f4.icao,
-		(unsigned int)f4.pi, atrk, aspd, vert);
-
-	double atrk2, aspd2;
-	int vert2;
-	union AdsbFrame f42;
-	f42.frame[13] = 0x8D;	//8DA05F219B06B6AF189400CBC33F
-	f42.frame[12] = 0xA0;	//subtype 3
-	f42.frame[11] = 0x5F;
-	f42.frame[10] = 0x21;
-	f42.frame[9] = 0x9B;
-	f42.frame[8] = 0x06;
-	f42.frame[7] = 0xB6;
-	f42.frame[6] = 0xAF;
-	f42.frame[5] = 0x18;
-	f42.frame[4] = 0x94;
-	f42.frame[3] = 0x00;
-	f42.frame[2] = 0xCB;
-	f42.frame[1] = 0xC3;
-	f42.frame[0] = 0x3F;
-
-	switch(getAirVel(&f42, &atrk2, &aspd2, &vert2))
-	{
-	case 1:
-	case 2:
-		break;
-	default:
-		printf("return value error\n");
-	}
-
-	printf("F4.2: Airborne Velocity Test\n"
-		"DF: %u, CA: %u, ICAO: %#X, PI: %#X\n"
-		"Track: %f, Speed: %f, Vertical Rate: %d\n",
-		(unsigned int)f42.df, (unsigned int)f42.ca, (unsigned int)f42.icao,
-		(unsigned int)f42.pi, atrk2, aspd2, vert2);
+		printf("\tdisk was behind, %lu bytes dropped\n", w.dropped);
+	if(f)
+	{
+		free(a);
+		fclose(f);
+	}
+	free(b);
+	fclose(ref);
+	unlink(name);
+	return;
+}
+
+/*
+	testArchive
+	Archives tracks of planes flying around with some fields unknown,
+	then checks a scan of everything, scans of one plane in a time
+	window, and scans without the index or with only part of it,
+	against the updates that went in.
+*/
+#define ARCPLANES 200
+#define ARCUPDATES 200000
+
+struct ArchiveCheck
+{
+	const struct ArchiveRecord *sent;	//in the order they were sent
+	const int *next;			//next update of the same plane
+	int cursor[ARCPLANES];			//each plane's next expected
+	time_t from, to, last;
+	long count, wrong;
+};
+
+static void checkArchived(const struct ArchiveRecord *rec, void *arg)
+{
+	struct ArchiveCheck *c = arg;
+	const struct ArchiveRecord *s;
+	int p = rec->icao - 0xA00000, k;
+
+	if(p < 0 || p >= ARCPLANES || rec->time < c->last)
+	{
+		c->wrong++;
+		return;
+	}
+	c->last = rec->time;
+	c->count++;
+	//skip the plane's updates outside the window
+	for(k = c->cursor[p];k >= 0 && c->sent[k].time < c->from;k = c->next[k])
+		;
+	if(k < 0)
+	{
+		c->wrong++;
+		return;
+	}
+	s = &c->sent[k];
+	c->cursor[p] = c->next[k];
+	if(s->time != rec->time || s->flags != rec->flags ||
+		s->lat != rec->lat || s->lng != rec->lng ||
+		((s->flags & ALTVALID) && s->alt != rec->alt) ||
+		((s->flags & SPDVALID) && s->spd != rec->spd) ||
+		((s->flags & TRKVALID) && s->trk != rec->trk))
+		c->wrong++;
+	return;
+}
+
+static long scanCheck(struct ArchiveReader *r, struct ArchiveCheck *c,
+	const int first[], time_t from, time_t to, int icao)
+{
+	int i;
+	for(i = 0;i < ARCPLANES;i++)
+		c->cursor[i] = first[i];
+	c->from = from;
+	c->to = to;
+	c->last = 0;
+	c->count = 0;
+	c->wrong = 0;
+	return scanArchive(r, from, to, icao, checkArchived, c);
+}
+
+static void testArchive(void)
+{
+	static struct ArchiveRecord sent[ARCUPDATES];
+	static int next[ARCUPDATES];
+	static struct Plane planes[ARCPLANES];
+	int first[ARCPLANES], last[ARCPLANES];
+	struct ArchiveCheck c;
+	struct Archive a;
+	struct ArchiveReader r;
+	char name[] = "/tmp/adsbarcXXXXXX", idxname[40];
+	struct Plane *pl;
+	time_t now = 1700000000, from, to;
+	double t;
+	long n, expect, size;
+	int i, p, q, fd;
+	FILE *f;
+
+	fd = mkstemp(name);
+	if(!CHECK(fd >= 0))
+		return;
+	close(fd);
+	snprintf(idxname, sizeof(idxname), "%s.idx", name);
+	if(!CHECK(openArchive(&a, name) == 0))
+		return;
+
+	memset(planes, 0, sizeof(planes));
+	for(p = 0;p < ARCPLANES;p++)
+	{
+		planes[p].icao = 0xA00000 + p;
+		randomPosition(&planes[p].lat, &planes[p].lng);
+		planes[p].alt = (int)(random64() % 40000);
+		planes[p].spd = 100. + uniform() * 400.;
+		planes[p].trk = uniform() * 360.;
+		first[p] = last[p] = -1;
+	}
+	t = seconds();
+	for(i = 0;i < ARCUPDATES;i++)
+	{
+		//about 20 updates a second, gaps now and then
+		if(random64() % 20 == 0)
+			now += random64() % 100 ? 1 : 300;
+		p = (int)(random64() % ARCPLANES);
+		pl = &planes[p];
+		pl->lat = fmin(fmax(pl->lat + (uniform() - 0.5) * 0.01, -89.), 89.);
+		pl->lng += (uniform() - 0.5) * 0.01;
+		pl->alt += (int)(random64() % 9) * 25 - 100;
+		pl->spd += uniform() - 0.5;
+		pl->trk = fmod(pl->trk + uniform(), 360.);
+		pl->pflags = ICAOFL | POSVALID | (random64() % 8 ? ALTVALID : 0) |
+			(random64() % 4 ? SPDVALID | TRKVALID : 0);
+		archivePlane(&a, pl, now);
+
+		//what should come back out
+		sent[i].icao = pl->icao;
+		sent[i].time = now;
+		sent[i].lat = (double)llround(pl->lat * ARCHIVE_LATLNG) /
+			ARCHIVE_LATLNG;
+		sent[i].lng = (double)llround(pl->lng * ARCHIVE_LATLNG) /
+			ARCHIVE_LATLNG;
+		sent[i].alt = pl->alt;
+		sent[i].spd = (double)llround(pl->spd * 10.) / 10.;
+		sent[i].trk = (double)llround(pl->trk * 10.) / 10.;
+		sent[i].flags = pl->pflags & (POSVALID | ALTVALID | SPDVALID |
+			TRKVALID);
+		next[i] = -1;
+		if(last[p] >= 0)
+			next[last[p]] = i;
+		else
+			first[p] = i;
+		last[p] = i;
+		flushArchive(&a, now);
+	}
+	CHECK(closeArchive(&a) == 0);
+	printRate("archiving", seconds() - t, ARCUPDATES);
+	CHECK(a.data.dropped == 0);
+
+	f = fopen(name, "rb");
+	if(!CHECK(f != NULL))
+		return;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fclose(f);
+	printf("\t%.2f bytes an update\n", (double)size / ARCUPDATES);
+
+	c.sent = sent;
+	c.next = next;
+	if(!CHECK(openArchiveReader(&r, name) == 0))
+		return;
+	t = seconds();
+	n = scanCheck(&r, &c, first, 0, now, -1);
+	printRate("scanning", seconds() - t, ARCUPDATES);
+	CHECK(n == ARCUPDATES && c.count == n && c.wrong == 0);
+
+	//one plane in a window, against counting what was sent
+	for(q = 0;q < 50;q++)
+	{
+		p = (int)(random64() % ARCPLANES);
+		from = 1700000000 + (time_t)(random64() % (now - 1700000000));
+		to = from + (time_t)(random64() % 2000);
+		for(expect = 0, i = first[p];i >= 0;i = next[i])
+			if(sent[i].time >= from && sent[i].time <= to)
+				expect++;
+		n = scanCheck(&r, &c, first, from, to, 0xA00000 + p);
+		if(!CHECK(n == expect && c.wrong == 0))
+		{
+			printf("\tplane %d from %ld to %ld: %ld of %ld\n", p,
+				(long)from, (long)to, n, expect);
+			break;
+		}
+	}
+	closeArchiveReader(&r);
+
+	//the blocks the index is missing are found from their headers
+	CHECK(truncate(idxname, ARCHIVE_ENTRY * 10 + 7) == 0);
+	CHECK(openArchiveReader(&r, name) == 0);
+	CHECK(scanCheck(&r, &c, first, 0, now, -1) == ARCUPDATES &&
+		c.wrong == 0);
+	closeArchiveReader(&r);
+	unlink(idxname);
+	CHECK(openArchiveReader(&r, name) == 0);
+	CHECK(scanCheck(&r, &c, first, 0, now, -1) == ARCUPDATES &&
+		c.wrong == 0);
+	closeArchiveReader(&r);
+	unlink(name);
+	return;
+}
+
+/*
+	testSteady
+	The arena grows to what a round used once it spills, and after a
+	round to warm up, decoding, logging, merging into a second cache,
+	the log file and the archive don't malloc anything. The test is
+	linked with the counting malloc, see alloc.h.
+*/
+#define STEADYPLANES 500
+#define STEADYROUNDS 20
+
+static void testSteady(void)
+{
+	static union AdsbFrame frames[STEADYPLANES];
+	static struct Plane buf[STEADYPLANES], merged[STEADYPLANES];
+	static struct PlaneStats stats[STEADYPLANES];
+	struct Arena a;
+	struct AdsbEvent ev;
+	struct PlaneGrid g;
+	struct OutputWriter w;
+	struct Archive arc;
+	char name[] = "/tmp/adsbsteadyXXXXXX", arcname[40], idxname[48];
+	char text[9];
+	void *volatile p;
+	char *x, *y;
+	unsigned long before, used = 0;
+	uint64_t call;
+	time_t now = time(NULL) + 1000;
+	size_t mark;
+	int i, r, slot, fd;
+
+	//the counter sees malloc, and the arena only mallocs while it spills
+	before = heapAllocations();
+	p = malloc(16);
+	free(p);
+	CHECK(heapAllocations() == before + 1);
+
+	memset(&a, 0, sizeof(a));
+	x = arenaAlloc(&a, 100);
+	mark = arenaMark(&a);
+	y = arenaAlloc(&a, 5000);
+	CHECK(x != NULL && y != NULL && a.spill != NULL);
+	CHECK(((uintptr_t)x | (uintptr_t)y) % ARENA_ALIGN == 0);
+	arenaRelease(&a, mark);
+	CHECK(arenaMark(&a) == mark);
+	arenaRelease(&a, 0);
+	CHECK(a.spill == NULL && a.size >= 5100);
+	before = heapAllocations();
+	x = arenaAlloc(&a, 100);
+	y = arenaAlloc(&a, 5000);
+	CHECK(heapAllocations() == before);
+	CHECK(x == a.base && y >= a.base && y + 5000 <= a.base + a.size);
+	arenaRelease(&a, 0);
+	CHECK(heapAllocations() == before && a.used == 0);
+	freeArena(&a);
+	CHECK(a.base == NULL && a.size == 0);
+
+	for(i = 0;i < STEADYPLANES;i++)
+	{
+		memset(&frames[i], 0, sizeof(frames[i]));
+		adsbSetDf(&frames[i], 17);
+		adsbSetIcao(&frames[i], 0xB00000 + 3 * i);
+		adsbSetTc(&frames[i], 4);
+		snprintf(text, sizeof(text), "S%05d", i);
+		packCall(text, &call);
+		adsbSetIdCall(&frames[i], call);
+		adsbSetPi(&frames[i], computeCrc(&frames[i]));
+	}
+
+	fd = mkstemp(name);
+	if(!CHECK(fd >= 0))
+		return;
+	close(fd);
+	snprintf(arcname, sizeof(arcname), "%s.arc", name);
+	snprintf(idxname, sizeof(idxname), "%s.idx", arcname);
+	memset(buf, 0, sizeof(buf));
+	memset(merged, 0, sizeof(merged));
+	memset(stats, 0, sizeof(stats));
+	if(!CHECK(initGrid(&g, merged, STEADYPLANES) == 0))
+		return;
+	if(!CHECK(openOutput(&w, name, OUTPUT_NOSYNC) == 0))
+		return;
+	if(!CHECK(openArchive(&arc, arcname) == 0))
+		return;
+	attachGrid(&g);
+	attachArchive(&arc, merged);
+
+	//round 0 warms up stdio's buffers and the timezone
+	for(r = 0;r < STEADYROUNDS;r++)
+	{
+		if(r == 1)
+			before = heapAllocations();
+		for(i = 0;i < STEADYPLANES;i++)
+		{
+			if(decodeEvent(&frames[i], rlat, rlng, &ev))
+				continue;
+			slot = logEvent(buf, STEADYPLANES, &ev, now + r);
+			countMessage(&stats[slot], ev.icao, ev.tc, 1000, now + r);
+			//and a position, as if from another message
+			memset(&ev, 0, sizeof(ev));
+			ev.icao = 0xB00000 + 3 * i;
+			ev.lat = rlat + (i % 50 - 25) * 0.02 + r * 0.001;
+			ev.lng = rlng + (i / 50 - 5) * 0.02;
+			ev.alt = 1000 * (i % 40);
+			ev.fl = POSVALID | ALTVALID;
+			slot = logEvent(buf, STEADYPLANES, &ev, now + r);
+			storePlane(merged, slot, &buf[slot]);
+		}
+		logToFile(merged, STEADYPLANES, &w);
+		flushOutput(&w, now + r);
+		flushArchive(&arc, now + r);
+	}
+	used = heapAllocations() - before;
+	CHECK(used == 0);
+	if(used)
+		printf("\t%lu allocations after warming up\n", used);
+	CHECK(merged[STEADYPLANES - 1].icao == 0xB00000 + 3 * (STEADYPLANES - 1));
+
+	attachGrid(NULL);
+	attachArchive(NULL, NULL);
+	CHECK(closeArchive(&arc) == 0);
+	CHECK(closeOutput(&w) == 0);
+	freeGrid(&g);
+	unlink(name);
+	unlink(arcname);
+	unlink(idxname);
+	return;
+}
+
+/*
+	queryReply
+	Returns the length of the reply to req, or -1 if it didn't come
+	whole within 2 seconds. Sends req to the query socket fd and
+	reads until the reply is complete for the format the client is in.
+*/
+static long queryReply(int fd, const char *req, int binary, char *out,
+	size_t size)
+{
+	struct pollfd pfd;
+	size_t len = 0;
+	long n;
+
+	if(send(fd, req, strlen(req), 0) != (long)strlen(req))
+		return -1;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while(len < size && poll(&pfd, 1, 2000) > 0)
+	{
+		n = (long)recv(fd, out + len, size - len, 0);
+		if(n <= 0)
+			return -1;
+		len += (size_t)n;
+		if(len >= 6 && memcmp(out, "error ", 6) == 0)
+		{
+			if(out[len - 1] == '\n')
+				return (long)len;
+		}
+		else if(binary)
+		{
+			if(len >= 16 && len == 16 + 44 * (size_t)(
+				(uint8_t)out[4] | (uint8_t)out[5] << 8))
+				return (long)len;
+		}
+		else if((len == 1 && out[0] == '\n') ||
+			(len >= 2 && out[len - 2] == '\n' && out[len - 1] == '\n'))
+			return (long)len;
+	}
+	return -1;
+}
+
+static uint32_t getLE(const char *p, int bytes)
+{
+	uint32_t v = 0;
+	int i;
+	for(i = 0;i < bytes;i++)
+		v |= (uint32_t)(uint8_t)p[i] << 8 * i;
+	return v;
+}
+
+/*
+	testQuery
+	Asks a query server over its socket for planes by ICAO, callsign
+	prefix, box and nearest, in both formats, and checks the binary
+	record layout and the error replies.
+*/
+static void testQuery(void)
+{
+	static struct Plane buf[8];
+	static char reply[4096];
+	const char *calls[3] = {"UAL123", "UAL9", "BAW12"};
+	struct QueryServer q;
+	struct sockaddr_un addr;
+	char name[] = "/tmp/adsbqueryXXXXXX", line[200];
+	time_t now = time(NULL);
+	long n;
+	int i, fd;
+
+	CHECK(sizeof(struct QueryHeader) == 16);
+	CHECK(sizeof(struct QueryRecord) == 44);
+
+	memset(buf, 0, sizeof(buf));
+	for(i = 0;i < 3;i++)
+	{
+		buf[i].pflags = ICAOFL | IDENTVALID | POSVALID;
+		packCall(calls[i], &buf[i].call);
+		buf[i].cat = 0;
+		buf[i].lat = rlat + 0.1 * (i + 1) - (i == 2 ? 2. : 0.);
+		buf[i].lng = rlng;
+		buf[i].lstUpd = now - 3;
+	}
+	buf[0].icao = 0xA1B2C3;
+	buf[1].icao = 0xA1B2C4;
+	buf[2].icao = 0x400001;
+	buf[0].pflags |= ALTVALID | VERTVALID | TRKVALID | SPDVALID;
+	buf[0].alt = 35000;
+	buf[0].vert = -640;
+	buf[0].trk = 90.5;
+	buf[0].spd = 450.25;
+	//known but nothing else
+	buf[3].icao = 0x400002;
+	buf[3].pflags = ICAOFL;
+	buf[3].lstUpd = now;
+
+	fd = mkstemp(name);
+	if(!CHECK(fd >= 0))
+		return;
+	close(fd);
+	if(!CHECK(startQuery(&q, name, buf, 8) == 0))
+		return;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, name);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(!CHECK(fd >= 0 && connect(fd, (struct sockaddr*)&addr,
+		sizeof(addr)) == 0))
+		goto done;
+
+	//binary by default
+	n = queryReply(fd, "icao a1b2c3\n", 1, reply, sizeof(reply));
+	if(CHECK(n == 16 + 44))
+	{
+		CHECK(memcmp(reply, QUERY_MAGIC, 4) == 0 && getLE(reply + 4, 4) == 1);
+		CHECK(getLE(reply + 8, 4) >= (uint32_t)now &&
+			getLE(reply + 12, 4) == 0);
+		CHECK(getLE(reply + 16, 4) == 0xA1B2C3);
+		CHECK(getLE(reply + 20, 4) == (uint32_t)buf[0].pflags);
+		CHECK((int32_t)getLE(reply + 24, 4) == (int32_t)(buf[0].lat * 1e6));
+		CHECK((int32_t)getLE(reply + 28, 4) == (int32_t)(rlng * 1e6));
+		CHECK((int32_t)getLE(reply + 32, 4) == 35000);
+		CHECK((int32_t)getLE(reply + 36, 4) == -640);
+		CHECK(getLE(reply + 40, 2) == 9050 && getLE(reply + 42, 2) == 4502);
+		CHECK(getLE(reply + 44, 4) >= 3 && getLE(reply + 44, 4) <= 5);
+		CHECK(memcmp(reply + 48, "UAL123  ", 8) == 0);
+		CHECK(strncmp(reply + 56, planeType(0), 4) == 0);
+	}
+	//fields without their flag are 0
+	n = queryReply(fd, "icao 400002\n", 1, reply, sizeof(reply));
+	if(CHECK(n == 16 + 44))
+	{
+		CHECK(getLE(reply + 16, 4) == 0x400002);
+		for(i = 24;i < 44;i += 4)
+			CHECK(getLE(reply + i, 4) == 0);
+		CHECK(reply[48] == 0 && reply[56] == 0);
+	}
+
+	//the prefix is compared 6 bits a char, for as many as were sent
+	n = queryReply(fd, "call UAL\n", 1, reply, sizeof(reply));
+	CHECK(n == 16 + 2 * 44 && getLE(reply + 4, 4) == 2);
+	n = queryReply(fd, "call ual12\n", 1, reply, sizeof(reply));
+	CHECK(n == 16 + 44 && getLE(reply + 16, 4) == 0xA1B2C3);
+	n = queryReply(fd, "call UAL9\n", 1, reply, sizeof(reply));
+	CHECK(n == 16 + 44 && getLE(reply + 16, 4) == 0xA1B2C4);
+	n = queryReply(fd, "call UAL1234\n", 1, reply, sizeof(reply));
+	CHECK(n == 16 && getLE(reply + 4, 4) == 0);
+	n = queryReply(fd, "call U@L\n", 1, reply, sizeof(reply));
+	CHECK(n == 16);
+
+	snprintf(line, sizeof(line), "box %f %f %f %f\n", rlat, rlng - 0.5,
+		rlat + 0.5, rlng + 0.5);
+	n = queryReply(fd, line, 1, reply, sizeof(reply));
+	CHECK(n == 16 + 2 * 44);
+	snprintf(line, sizeof(line), "near %f %f 1\n", rlat, rlng);
+	n = queryReply(fd, line, 1, reply, sizeof(reply));
+	CHECK(n == 16 + 44 && getLE(reply + 16, 4) == 0xA1B2C3);
+
+	n = queryReply(fd, "near 1 2\n", 1, reply, sizeof(reply));
+	CHECK(n > 0 && strncmp(reply, "error near needs lat lng k\n", n) == 0);
+	n = queryReply(fd, "icao\n", 1, reply, sizeof(reply));
+	CHECK(n > 0 && strncmp(reply, "error icao needs a hex address\n", n) == 0);
+
+	//text gets no reply, the next request is answered in text
+	CHECK(send(fd, "text\n", 5, 0) == 5);
+	n = queryReply(fd, "icao A1B2C3\n", 0, reply, sizeof(reply) - 1);
+	snprintf(line, sizeof(line), "A1B2C3 UAL123 %s %.6f %.6f 90.5 450.2 "
+		"35000 -640 ", planeType(0), buf[0].lat, buf[0].lng);
+	CHECK(n > (long)strlen(line) && strncmp(reply, line, strlen(line)) == 0);
+	CHECK(n > 2 && reply[n - 2] == '\n' && reply[n - 1] == '\n');
+	n = queryReply(fd, "icao 400002\n", 0, reply, sizeof(reply) - 1);
+	CHECK(n > 0 && strncmp(reply, "400002 - - - - - - - - ", 23) == 0);
+	snprintf(line, sizeof(line), "near %f %f 2\n", rlat, rlng);
+	n = queryReply(fd, line, 0, reply, sizeof(reply) - 1);
+	CHECK(n > 0 && strncmp(reply, "A1B2C3 ", 7) == 0 &&
+		memchr(reply, '\n', n) != NULL &&
+		strncmp((char*)memchr(reply, '\n', n) + 1, "A1B2C4 UAL9 ", 12) == 0);
+	n = queryReply(fd, "call KLM\n", 0, reply, sizeof(reply) - 1);
+	CHECK(n == 1 && reply[0] == '\n');
+	n = queryReply(fd, "bogus 1\n", 0, reply, sizeof(reply) - 1);
+	CHECK(n > 0 && strncmp(reply, "error unknown request\n", n) == 0);
+	close(fd);
+
+done:
+	stopQuery(&q);
+	CHECK(access(name, F_OK) != 0);
+	return;
+}
 
 #ifdef MAPPING
-	printf("\nGMT MAPPING TEST\n\n");
+static void testMap(void)
+{
 	int i;
 	struct Plane planes[5];
 	for(i = 0;i < 5;i++)
@@ -202,11 +1950,10 @@ int main()
 	//check for overflows
 	//should make blank image centered around
 	//rlat rlng
-	rlat = olat;
-	rlng = olng;
+	rlat = 41.978611;	//O'Hare
+	rlng = -87.904722;
 	createImage(planes, 5);
-	printf("Finished Empty Map\nTesting Single Plane Multiple Points\n");
-	logPlane(planes, 5, 0x1, NULL, NULL, rlat, rlng, 0, 0, 1000, 0,
+	logPlane(planes, 5, 0x1, 0, 0, rlat, rlng, 0, 0, 1000, 0,
 		ICAOFL | POSVALID | ALTVALID);
 	planes[1].pflags = ICAOFL | POSVALID | ALTVALID;
 	planes[1].icao = 1;
@@ -215,9 +1962,61 @@ int main()
 	planes[1].alt = 5000;
 	planes[1].lstUpd = planes[0].lstUpd + 10;	//doesn't really matter
 	createImage(planes, 5);
-	printf("Finished Single Plane Two Points\n");
 	endGMTSession();
+	return;
+}
 #endif
 
-	return 0;
+static const struct
+{
+	const char *name;
+	void (*run)(void);
+} tests[] =
+{
+	{"ident", testIdent},
+	{"frame fields", testFields},
+	{"airborne position", testAirPos},
+	{"surface position", testSurfPos},
+	{"airborne velocity", testAirVel},
+	{"CPR NL", testCprNL},
+	{"CPR round trip", testCprRoundTrip},
+	{"CRC", testCrc},
+	{"hex parsing", testParseHex},
+	{"line reader", testLines},
+	{"demodulator", testDemod},
+	{"2.4 Msps demodulator", testDemodOversampled},
+	{"noise floor", testNoiseFloor},
+	{"demod kernels", testKernels},
+	{"decoder library", testDecoder},
+	{"spatial grid", testGrid},
+	{"seqlock", testSeqlock},
+	{"shards", testShards},
+	{"plane stats", testStats},
+	{"output writer", testOutput},
+	{"archive", testArchive},
+	{"steady state", testSteady},
+	{"query socket", testQuery},
+#ifdef MAPPING
+	{"GMT map", testMap},
+#endif
+};
+
+int main()
+{
+	size_t i;
+	int before;
+	double t;
+
+	for(i = 0;i < sizeof(tests) / sizeof(tests[0]);i++)
+	{
+		printf("%s\n", tests[i].name);
+		before = failures;
+		t = seconds();
+		tests[i].run();
+		printf("%s %s (%.2f ms)\n", failures == before ? "PASS" : "FAIL",
+			tests[i].name, (seconds() - t) * 1e3);
+	}
+
+	printf("\n%d checks, %d failed\n", checks, failures);
+	return failures ? 1 : 0;
 }